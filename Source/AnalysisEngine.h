@@ -0,0 +1,817 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "AnalysisPipeline.h"
+#include "AnomalyDetector.h"
+#include "BandStatistics.h"
+#include "BatchedAnalyser.h"
+#include "FilterbankAnalyser.h"
+#include "FramePool.h"
+#include "FrameSubscription.h"
+#include "ReassignedSpectrogram.h"
+#include "RtpReceiver.h"
+#include "SampleHistory.h"
+#include "SilenceGate.h"
+#include "SpectrumHistory.h"
+#include "SpectrumAnalyser.h"
+#include "ThreadPlacement.h"
+#include "TriggeredAverager.h"
+#include "WaveletAnalyser.h"
+
+//==============================================================================
+/** What the analysis should run at, as requested on the command line. */
+struct AnalysisSettings
+{
+    enum class Analyser { fft, filterbank, wavelet };
+
+    Analyser analyser = Analyser::fft;
+    int fftOrder = 11;
+    int overlap = 2;        // analysis frames per fftSize samples
+    int groupNotes = 2;     // how many notes of the tempered scale share a bar
+    bool perChannel = false;    // analyse every input channel at once, rather than just the first (FFT only)
+    int inputChannels = 2;      // taken from the input and kept in the history, each ~2 MB
+    AnalysisPipeline::Options stages;   // weighting, calibration, averaging and ballistics for the FFT analyser
+    float silenceThresholdDb = -70.0f;
+    double historyMinutes = 10.0;   // of band levels kept for freeze and scrub, 0 to disable
+    juce::File fingerprintIndex;    // references to recognise in the input, if any
+    juce::File baseline;            // what the input normally sounds like, for anomaly detection
+    float anomalyThreshold = 3.0f;  // RMS z-score against the baseline
+    double trainSeconds = 0.0;      // if set, learn a new baseline for this long and save it
+    ThreadPlacement placement;
+    RtpReceiver::Format rtp;        // analyse this network stream instead of the audio device, if enabled
+    juce::File followFile;          // or this WAV file as it's being recorded
+    double followLatencySeconds = 0.5;  // how far behind its writer following may fall before skipping ahead
+    TriggeredAverager::Settings trigger;
+
+    static AnalysisSettings fromArguments (const juce::ArgumentList& args)
+    {
+        AnalysisSettings settings;
+
+        if (args.getValueForOption ("--analyser") == "filterbank")
+            settings.analyser = Analyser::filterbank;
+        else if (args.getValueForOption ("--analyser") == "cwt")
+            settings.analyser = Analyser::wavelet;
+
+        if (args.containsOption ("--fft-order"))
+            settings.fftOrder = juce::jlimit (minFftOrder, maxFftOrder, args.getValueForOption ("--fft-order").getIntValue());
+
+        if (args.containsOption ("--overlap"))
+            settings.overlap = juce::jlimit (1, 16, args.getValueForOption ("--overlap").getIntValue());
+
+        settings.perChannel = args.containsOption ("--per-channel");
+
+        if (args.containsOption ("--input-channels"))
+            settings.inputChannels = juce::jlimit (2, maxInputChannels, args.getValueForOption ("--input-channels").getIntValue());
+
+        if (args.containsOption ("--stages"))
+            settings.stages = AnalysisPipeline::Options::fromString (args.getValueForOption ("--stages"));
+
+        if (args.containsOption ("--silence-threshold"))
+        {
+            auto threshold = args.getValueForOption ("--silence-threshold");
+            settings.silenceThresholdDb = threshold == "off" ? -1000.0f : threshold.getFloatValue();
+        }
+
+        if (args.containsOption ("--history-minutes"))
+            settings.historyMinutes = juce::jmax (0.0, args.getValueForOption ("--history-minutes").getDoubleValue());
+
+        if (args.containsOption ("--fingerprint-index"))
+            settings.fingerprintIndex = args.getFileForOption ("--fingerprint-index");
+
+        if (args.containsOption ("--baseline"))
+            settings.baseline = args.getFileForOption ("--baseline");
+
+        if (args.containsOption ("--anomaly-threshold"))
+            settings.anomalyThreshold = juce::jmax (0.1f, args.getValueForOption ("--anomaly-threshold").getFloatValue());
+
+        if (args.containsOption ("--train-baseline"))
+            settings.trainSeconds = juce::jmax (1.0, args.getValueForOption ("--train-baseline").getDoubleValue());
+
+        settings.placement = ThreadPlacement::fromArguments (args, "--analysis");
+        settings.rtp = RtpReceiver::Format::fromArguments (args);
+        settings.trigger = TriggeredAverager::Settings::fromArguments (args);
+
+        if (args.containsOption ("--follow"))
+            settings.followFile = args.getFileForOption ("--follow");
+
+        if (args.containsOption ("--follow-latency"))
+            settings.followLatencySeconds = juce::jlimit (0.05, 10.0, args.getValueForOption ("--follow-latency").getDoubleValue());
+        return settings;
+    }
+
+    static constexpr int minFftOrder = 8;
+    static constexpr int maxFftOrder = 16;
+    static constexpr int maxInputChannels = 32;
+};
+
+//==============================================================================
+/**
+    Runs the FFT and banding on a dedicated worker thread.
+
+    The audio thread writes into a SampleHistory and wakes the worker; the
+    worker analyses one frame every hop (fftSize / overlap samples) and
+    publishes the band levels (in dB) for the message thread to pick up.
+
+    With the FFT analyser each frame goes through an AnalysisPipeline, which
+    reconfigure() compiles from the standard graph with the optional stages
+    in AnalysisSettings::stages, for the band levels and the bin magnitudes.
+    The SpectrumAnalyser keeps the scale the other analysers share, and only
+    runs on the frame as well while the cepstral stage is on.
+
+    If the worker falls more than a few hops behind it jumps to the newest
+    frame and counts the ones it skipped, which the QualityGovernor treats
+    as overload.
+
+    While the SilenceGate is closed the worker isn't woken and skips the FFT,
+    then resumes from the newest frame. Hiding the display only suspends its
+    own subscription and the waterfall: the worker carries on analysing for
+    everything else.
+
+    The worker also records the band levels into a SpectrumHistory at a fixed
+    rate. Silence is recorded as such.
+    Every analysed frame is also added to the long-term BandStatistics and
+    scored by the AnomalyDetector. While the gate is closed the detector is
+    given silent frames at the same rate instead, so going quiet can be
+    learned or flagged like anything else; the statistics leave silence
+    out, but count how much of it there was.
+
+    With the filterbank analyser the worker is woken for every block instead
+    of every hop, and runs whatever has arrived through a FilterbankAnalyser
+    on the same bands, so levels lag the input by a block rather than a frame.
+    The FFT is still prepared, for the banding and for setResolution(), but
+    not run.
+
+    With the wavelet analyser frames are taken every hop as usual, but the
+    samples since the last one are pushed into a WaveletAnalyser on the same
+    bands instead of being transformed and banded; after a gap it's reset and
+    refilled from the history. The history may hold less than the slowest
+    bands need (long wavelets at high sample rates), so those read mindB
+    until they've settled, and until then frames are published and recorded
+    but not added to the statistics or scored.
+
+    With per-channel analysis, every input channel's frame is transformed at
+    once by a BatchedAnalyser instead, which costs about the same as one
+    channel per batch of four. The device, stream or file is read for
+    --input-channels channels (two by default, up to 32), and any it lacks
+    are analysed as silence. Each channel's band levels are published in the AnalysisFrame,
+    and the levels everything else uses are the loudest channel's in each
+    band. There are no bin magnitudes or cepstrum in this mode.
+
+    While the waterfall is shown, each FFT frame is also added to a
+    ReassignedSpectrogram with one column per hop.
+
+    Every analysed frame's levels (and, with the FFT, its bin magnitudes) are
+    published in an AnalysisFrame from a FramePool, which any number of
+    consumers can hold on to without copying. While they hold every frame in
+    the pool, new frames are dropped and counted instead. Each consumer that
+    wants every frame subscribes with its own FrameSubscription policy, so a
+    slow one only loses its own frames; the display's is latest-only.
+*/
+class AnalysisEngine  : private juce::Thread
+{
+public:
+    explicit AnalysisEngine (const AnalysisSettings& settingsToUse)
+        : juce::Thread ("Analysis"),
+          settings (settingsToUse),
+          history (settingsToUse.inputChannels),
+          spectrumHistory (historyFramesPerSecond, settings.historyMinutes, mindB, maxdB),
+          statistics (mindB, maxdB)
+    {
+        gate.setThreshold (settings.silenceThresholdDb);
+        reconfigure (settings.fftOrder, settings.overlap);
+        displayFrames = &subscribe (FrameSubscription::Settings::latestOnly());
+    }
+
+    ~AnalysisEngine() override
+    {
+        stopAnalysis();
+    }
+
+    //==============================================================================
+    /** Rebuilds the banding for a new sample rate. */
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        gate.prepare (sampleRate);
+        reconfigure (settings.fftOrder, settings.overlap);
+
+        // a baseline belongs to a sample rate, so it's loaded or learned once the input's is known
+        if (! anomalySetUp)
+        {
+            anomalySetUp = true;
+            setUpAnomalyDetector();
+        }
+    }
+
+    /** Changes the FFT size and overlap; called on the message thread. */
+    void setResolution (int newFftOrder, int newOverlap)
+    {
+        if (newFftOrder != settings.fftOrder || newOverlap != settings.overlap)
+            reconfigure (newFftOrder, newOverlap);
+    }
+
+    void startAnalysis()    { startThread(); }
+    void stopAnalysis()     { stopThread (1000); }
+
+    /** Stops feeding the display and the waterfall while nobody can see them, e.g. when the window is minimised. Message thread only. */
+    void setSuspended (bool shouldBeSuspended) noexcept
+    {
+        displaySuspended = shouldBeSuspended;
+        displayFrames->setPaused (shouldBeSuspended);
+    }
+
+    /** False while the input has been below the silence threshold for a while. */
+    bool isSignalPresent() const noexcept       { return gate.isOpen(); }
+
+    /** Called on the audio thread when signal returns after silence. */
+    std::function<void()> onSignalResumed;
+
+    //==============================================================================
+    /** Called on the audio thread. */
+    void pushSamples (const float* const* channelData, int numChannels, int numSamples) noexcept
+    {
+        history.write (channelData, numChannels, numSamples);
+
+        if (gate.process (channelData, numChannels, numSamples) && onSignalResumed != nullptr)
+            onSignalResumed();
+
+        if (isActive() && history.getWritePosition() >= nextFrameEnd.load (std::memory_order_relaxed))
+            notify();
+    }
+
+    /** Copies the most recent band levels into dest; returns false if nothing new was analysed. For the display. */
+    bool pullLatestLevels (std::vector<float>& dest)
+    {
+        FrameView latest;
+
+        if (! displayFrames->popLatest (latest))
+            return false;
+
+        dest.assign (latest->levels.begin(), latest->levels.end());
+        return true;
+    }
+
+    /** The display's subscription, for its counters. */
+    const FrameSubscription& getDisplayFrames() const noexcept      { return *displayFrames; }
+
+    /** Starts offering every published frame to a new consumer with the given policy. The engine owns it. */
+    FrameSubscription& subscribe (const FrameSubscription::Settings& policy)
+    {
+        const juce::ScopedLock sl (analysisLock);
+        subscriptions.emplace_back (new FrameSubscription (policy));
+        return *subscriptions.back();
+    }
+
+    /** A reference to the most recent frame, with nothing copied; keep it no longer than needed, or frames will be dropped. */
+    FrameView getLatestFrame() const
+    {
+        const juce::SpinLock::ScopedLockType sl (publishLock);
+        return publishedFrame;
+    }
+
+    /** The frames handed out to consumers, and how many of them couldn't be produced because all were in use. */
+    const FramePool& getFramePool() const noexcept                  { return framePool; }
+
+    struct Cepstrum
+    {
+        std::vector<float> envelope;        // smooth spectral envelope per band, in dB
+        SpectrumAnalyser::CepstralPeak peak;    // the strongest echo or periodicity
+    };
+
+    /** Turns the cepstral stage on or off; called on the message thread. FFT analyser only. */
+    void setCepstrumEnabled (bool shouldBeEnabled)
+    {
+        const juce::ScopedLock sl (analysisLock);
+        analyser.setCepstrumEnabled (shouldBeEnabled);
+    }
+
+    /** Copies the most recent cepstral results into dest; returns false if the stage is off or nothing is new. */
+    bool pullLatestCepstrum (Cepstrum& dest)
+    {
+        if (! newCepstrumAvailable.exchange (false))
+            return false;
+
+        const juce::SpinLock::ScopedLockType sl (publishLock);
+        dest.envelope = publishedCepstrum.envelope;
+        dest.peak = publishedCepstrum.peak;
+        return true;
+    }
+
+    /** Starts or stops feeding frames to the spectrogram; called on the message thread. FFT analyser only. */
+    void setSpectrogramEnabled (bool shouldBeEnabled)
+    {
+        const juce::ScopedLock sl (analysisLock);
+        spectrogramEnabled = shouldBeEnabled;
+    }
+
+    /** The waterfall's grid, which the message thread reads finished columns from. */
+    ReassignedSpectrogram& getSpectrogram() noexcept                { return spectrogram; }
+
+    struct Timing
+    {
+        double totalMs = 0.0;
+        int numFrames = 0;
+        int numSkipped = 0;
+        double hopMs = 0.0;
+    };
+
+    /** Returns how long the frames analysed since the last call took. */
+    Timing popTiming()
+    {
+        const juce::SpinLock::ScopedLockType sl (timingLock);
+        auto result = timing;
+        timing = {};
+        timing.hopMs = result.hopMs;
+        return result;
+    }
+
+    /** The raw input, for other consumers that read it at their own pace. */
+    const SampleHistory& getSampleHistory() const noexcept          { return history; }
+
+    /** Band levels recorded for freeze and scrub. */
+    const SpectrumHistory& getSpectrumHistory() const noexcept     { return spectrumHistory; }
+
+    /** Long-term average spectrum and level percentiles of everything analysed so far. */
+    BandStatistics& getBandStatistics() noexcept                    { return statistics; }
+
+    /** Learns and scores against the baseline. */
+    AnomalyDetector& getAnomalyDetector() noexcept                  { return anomaly; }
+
+    /** The centre frequency of each band. */
+    std::vector<float> getBandFrequencies() const
+    {
+        const juce::ScopedLock sl (analysisLock);
+        return analyser.getScale().getFrequencies();
+    }
+
+    static constexpr float mindB = SpectrumAnalyser::mindB;
+    static constexpr float maxdB = SpectrumAnalyser::maxdB;
+    static constexpr double historyFramesPerSecond = 60.0;
+
+    /** Channels kept in the SampleHistory: the first is analysed (or all, per channel); stereo views and triggering read the second too. */
+    int getNumInputChannels() const noexcept       { return history.getNumChannels(); }
+
+private:
+    //==============================================================================
+    bool isActive() const noexcept      { return gate.isOpen(); }
+    bool usesFilterbank() const noexcept    { return settings.analyser == AnalysisSettings::Analyser::filterbank; }
+    bool usesWavelets() const noexcept      { return settings.analyser == AnalysisSettings::Analyser::wavelet; }
+    bool usesBatched() const noexcept       { return settings.perChannel && settings.analyser == AnalysisSettings::Analyser::fft; }
+    bool usesPipeline() const noexcept      { return ! settings.perChannel && settings.analyser == AnalysisSettings::Analyser::fft; }
+
+    void reconfigure (int newFftOrder, int newOverlap)
+    {
+        const juce::ScopedLock sl (analysisLock);
+
+        settings.fftOrder = newFftOrder;
+        settings.overlap = newOverlap;
+
+        analyser.prepare (settings.fftOrder, sampleRate, settings.groupNotes);
+        frame.resize ((size_t) analyser.getFFTSize());
+        hopSize = juce::jmax (1, analyser.getFFTSize() / settings.overlap);
+
+        if (usesFilterbank())
+            filterbank.prepare (analyser.getScale().getFrequencies(), sampleRate);
+
+        if (usesWavelets())
+        {
+            wavelets.prepare (analyser.getScale().getFrequencies(), settings.fftOrder, sampleRate);
+            waveletEnd = -1;
+        }
+
+        if (usesPipeline())
+        {
+            juce::String error;
+            pipelineReady = pipeline.prepare (AnalysisPipeline::Graph::standard (settings.stages), { "levels", "fft" },
+                                              settings.fftOrder, sampleRate, settings.groupNotes, error);
+
+            // the standard graph should always compile; if it somehow doesn't, the analyser's own banding stands in
+            if (! pipelineReady)
+            {
+                std::cout << "analysis pipeline: " << error << std::endl;
+                jassertfalse;
+            }
+
+            pipelineLevels.assign ((size_t) analyser.getNumBands(), (float) mindB);
+        }
+
+        if (usesBatched())
+        {
+            batched.reset (new BatchedAnalyser<batchLanes> (settings.fftOrder, getNumInputChannels(), sampleRate, settings.groupNotes));
+            batched->setBallistics (1.0f, 1.0f);
+            channelFrames.assign ((size_t) (getNumInputChannels() * analyser.getFFTSize()), 0.0f);
+            channelLevels.assign ((size_t) (getNumInputChannels() * analyser.getNumBands()), (float) mindB);
+            loudestLevels.assign ((size_t) analyser.getNumBands(), (float) mindB);
+        }
+
+        spectrogram.prepare (settings.fftOrder, sampleRate, analyser.getScale().getFrequencies(), hopSize);
+
+        spectrumHistory.prepare (analyser.getNumBands());
+        statistics.prepare (analyser.getNumBands());
+        anomaly.prepare ({ analyser.getNumBands(), settings.fftOrder, settings.groupNotes, sampleRate });
+        silence.assign ((size_t) analyser.getNumBands(), (float) mindB);
+        framePool.prepare (usesPipeline() && pipelineReady ? analyser.getFFTSize() / 2 : 0,
+                           analyser.getNumBands(), usesBatched() ? (int) channelLevels.size() : 0);
+        historyInterval = sampleRate / historyFramesPerSecond;
+
+        lastFrameEnd = history.getWritePosition();
+        nextFrameEnd = lastFrameEnd + (usesFilterbank() ? 1 : hopSize);
+
+        // the filterbank's "hop" is however much each wake-up finds, so it's measured as it goes
+        const juce::SpinLock::ScopedLockType timingScope (timingLock);
+        timing = {};
+        timing.hopMs = usesFilterbank() ? 0.0 : 1000.0 * hopSize / sampleRate;
+    }
+
+    void run() override
+    {
+        std::cout << "analysis thread: " << settings.placement.applyToCurrentThread() << std::endl;
+
+        while (! threadShouldExit())
+        {
+            if (! isActive())
+            {
+                idle = true;
+                recordSilence();
+                wait (100);
+                continue;
+            }
+
+            if (history.getWritePosition() < nextFrameEnd.load())
+            {
+                wait (100);
+                continue;
+            }
+
+            if (usesFilterbank())
+                analyseNewSamples();
+            else
+                analyseNextFrame();
+        }
+    }
+
+    void analyseNextFrame()
+    {
+        const juce::ScopedLock sl (analysisLock);
+
+        if (idle)
+        {
+            // nothing was analysed while idle, so those frames aren't overload
+            idle = false;
+            lastFrameEnd = history.getWritePosition() - hopSize;
+        }
+
+        auto available = (history.getWritePosition() - lastFrameEnd) / hopSize;
+
+        if (available <= 0)
+            return;
+
+        auto skipped = available > maxFramesBehind ? (int) (available - 1) : 0;
+        lastFrameEnd += (skipped + 1) * (juce::int64) hopSize;
+        nextFrameEnd = lastFrameEnd + hopSize;
+
+        auto start = Clock::now();
+
+        auto& newLevels = usesWavelets() ? transformWavelets() : (usesBatched() ? transformChannels() : transformFrame());
+
+        auto elapsedMs = std::chrono::duration<double, std::milli> (Clock::now() - start).count();
+
+        useLevels (newLevels, (skipped + 1) * (double) hopSize / sampleRate, ! usesWavelets() || wavelets.isSettled());
+
+        if (analyser.isCepstrumEnabled() && usesPipeline())
+        {
+            // echoes and periods from 1 ms (1 kHz) up to half a frame
+            auto peak = analyser.findCepstralPeak (0.001, 1.0);
+
+            const juce::SpinLock::ScopedLockType levelsLock (publishLock);
+            publishedCepstrum.envelope = analyser.getEnvelope();
+            publishedCepstrum.peak = peak;
+            newCepstrumAvailable = true;
+        }
+
+        const juce::SpinLock::ScopedLockType timingScope (timingLock);
+        timing.totalMs += elapsedMs;
+        timing.numFrames++;
+        timing.numSkipped += skipped;
+    }
+
+    /** Runs the frame ending at lastFrameEnd through the pipeline, and adds it to the spectrogram if that's on. */
+    const std::vector<float>& transformFrame()
+    {
+        history.read (0, lastFrameEnd, frame.data(), analyser.getFFTSize());
+
+        if (! pipelineReady)
+        {
+            analyser.process (frame.data());
+            std::copy (analyser.getLevels().begin(), analyser.getLevels().end(), pipelineLevels.begin());
+
+            if (spectrogramEnabled && ! displaySuspended)
+                spectrogram.process (frame.data(), lastFrameEnd);
+
+            return pipelineLevels;
+        }
+
+        pipeline.process (frame.data());
+
+        auto* levels = pipeline.getOutput (levelsOutput);
+        std::copy (levels, levels + pipelineLevels.size(), pipelineLevels.begin());
+
+        // the cepstrum is taken from the analyser's own transform
+        if (analyser.isCepstrumEnabled())
+            analyser.process (frame.data());
+
+        if (spectrogramEnabled && ! displaySuspended)
+            spectrogram.process (frame.data(), lastFrameEnd);
+
+        return pipelineLevels;
+    }
+
+    /** Analyses every channel's frame ending at lastFrameEnd together, and returns the loudest channel's level per band. */
+    const std::vector<float>& transformChannels()
+    {
+        auto fftSize = analyser.getFFTSize();
+        auto numBands = analyser.getNumBands();
+        const float* frames[AnalysisSettings::maxInputChannels];
+
+        for (int ch = 0; ch < getNumInputChannels(); ++ch)
+        {
+            auto* dest = channelFrames.data() + ch * fftSize;
+            history.read (ch, lastFrameEnd, dest, fftSize);
+            frames[ch] = dest;
+        }
+
+        batched->process (frames);
+        std::fill (loudestLevels.begin(), loudestLevels.end(), (float) mindB);
+
+        for (int ch = 0; ch < getNumInputChannels(); ++ch)
+        {
+            auto* levels = channelLevels.data() + ch * numBands;
+            batched->copyBandLevels (ch, levels);
+
+            for (int b = 0; b < numBands; ++b)
+                loudestLevels[(size_t) b] = juce::jmax (loudestLevels[(size_t) b], levels[b]);
+        }
+
+        if (spectrogramEnabled && ! displaySuspended)
+            spectrogram.process (frames[0], lastFrameEnd);
+
+        return loudestLevels;
+    }
+
+    /** Brings the wavelet analyser up to lastFrameEnd, restarting it from recent input after a gap. */
+    const std::vector<float>& transformWavelets()
+    {
+        // the ring may hold less than the slowest bands need; they read mindB until they've had it
+        auto refill = (juce::int64) juce::jmin (wavelets.getHistoryLength(), (int) SampleHistory::capacity / 2);
+
+        if (waveletEnd < 0 || waveletEnd > lastFrameEnd || lastFrameEnd - waveletEnd > refill)
+        {
+            wavelets.reset();
+            waveletEnd = juce::jmax ((juce::int64) 0, lastFrameEnd - refill);
+        }
+
+        while (waveletEnd < lastFrameEnd)
+        {
+            auto chunk = (int) juce::jmin ((juce::int64) frame.size(), lastFrameEnd - waveletEnd);
+            waveletEnd += chunk;
+            history.read (0, waveletEnd, frame.data(), chunk);
+            wavelets.push (frame.data(), chunk);
+        }
+
+        wavelets.update();
+        return wavelets.getLevels();
+    }
+
+    /** Runs everything that has arrived since the last call through the filterbank. */
+    void analyseNewSamples()
+    {
+        const juce::ScopedLock sl (analysisLock);
+
+        auto writePosition = history.getWritePosition();
+        auto backlog = writePosition - lastFrameEnd;
+        int skipped = 0;
+
+        // after idling, start afresh from now; after falling behind, too, but count it as overload
+        if (idle || backlog > (juce::int64) maxFramesBehind * hopSize)
+        {
+            skipped = idle ? 0 : (int) (backlog / hopSize);
+            idle = false;
+            filterbank.reset();
+            lastFrameEnd = writePosition - juce::jmin (backlog, (juce::int64) hopSize);
+        }
+
+        auto numSamples = writePosition - lastFrameEnd;
+
+        if (numSamples <= 0)
+            return;
+
+        auto start = Clock::now();
+
+        while (lastFrameEnd < writePosition)
+        {
+            auto chunk = (int) juce::jmin ((juce::int64) frame.size(), writePosition - lastFrameEnd);
+            lastFrameEnd += chunk;
+            history.read (0, lastFrameEnd, frame.data(), chunk);
+            filterbank.process (frame.data(), chunk);
+        }
+
+        nextFrameEnd = lastFrameEnd + 1;
+
+        auto elapsedMs = std::chrono::duration<double, std::milli> (Clock::now() - start).count();
+        auto seconds = (double) numSamples / sampleRate;
+
+        useLevels (filterbank.getLevels(), seconds);
+
+        const juce::SpinLock::ScopedLockType timingScope (timingLock);
+        timing.totalMs += elapsedMs;
+        timing.numFrames++;
+        timing.numSkipped += skipped;
+        timing.hopMs += (1000.0 * seconds - timing.hopMs) / timing.numFrames;
+    }
+
+    /** Records, scores and publishes one set of band levels covering the given stretch of input; unsettled ones are only recorded and published. */
+    void useLevels (const std::vector<float>& levels, double seconds, bool settled = true)
+    {
+        recordHistory (lastFrameEnd, levels.data());
+
+        if (settled)
+        {
+            statistics.addFrame (levels.data());
+            anomaly.process (levels.data(), seconds);
+            finishTrainingIfDue();
+        }
+
+        publishFrame (levels, seconds);
+    }
+
+    /** Fills in a frame from the pool and makes it the latest; if none is free this one is dropped. */
+    void publishFrame (const std::vector<float>& levels, double seconds)
+    {
+        auto view = framePool.acquire();
+
+        if (! view)
+            return;
+
+        auto& frame = FramePool::getWritableFrame (view);
+        frame.position = lastFrameEnd;
+        frame.seconds = seconds;
+        frame.analysedAt = juce::Time::getMillisecondCounterHiRes();
+        std::copy (levels.begin(), levels.end(), frame.levels.begin());
+
+        if (! frame.magnitudes.empty())
+        {
+            auto* magnitudes = pipeline.getOutput (magnitudesOutput);
+            std::copy (magnitudes, magnitudes + frame.magnitudes.size(), frame.magnitudes.begin());
+        }
+
+        if (! frame.channelLevels.empty())
+            std::copy (channelLevels.begin(), channelLevels.end(), frame.channelLevels.begin());
+
+        for (auto& subscription : subscriptions)
+            subscription->offer (view);
+
+        const juce::SpinLock::ScopedLockType sl (publishLock);
+        publishedFrame.swapWith (view);
+    }
+
+    void setUpAnomalyDetector()
+    {
+        anomaly.setThreshold (settings.anomalyThreshold);
+
+        if (settings.trainSeconds > 0.0)
+        {
+            std::cout << "learning a baseline for " << settings.trainSeconds << " s" << std::endl;
+            anomaly.startTraining();
+        }
+        else if (settings.baseline.existsAsFile())
+        {
+            juce::String error;
+
+            if (anomaly.load (settings.baseline, error))
+                std::cout << "monitoring against " << settings.baseline.getFullPathName() << std::endl;
+            else
+                std::cout << error << std::endl;
+        }
+    }
+
+    void finishTrainingIfDue()
+    {
+        if (settings.trainSeconds <= 0.0)
+            return;
+
+        auto status = anomaly.getStatus();
+
+        if (status.mode != AnomalyDetector::Mode::training || status.trainedSeconds < settings.trainSeconds)
+            return;
+
+        settings.trainSeconds = 0.0;
+
+        if (anomaly.finishTraining() && settings.baseline != juce::File())
+            std::cout << (anomaly.save (settings.baseline) ? "saved baseline to " : "couldn't save baseline to ")
+                      << settings.baseline.getFullPathName() << std::endl;
+    }
+
+    void recordSilence()
+    {
+        const juce::ScopedLock sl (analysisLock);
+
+        auto position = history.getWritePosition();
+        recordHistory (position, silence.data());
+
+        // whatever came in since the last analysed frame, or the last call, wasn't analysed
+        auto from = juce::jmax (lastFrameEnd, silenceEnd);
+        auto numHops = (position - from) / hopSize;
+
+        if (numHops <= 0)
+            return;
+
+        silenceEnd = from + numHops * hopSize;
+        statistics.addSilence ((double) (numHops * hopSize) / sampleRate);
+
+        // silence is a state like any other, so the baseline learns it and monitoring scores it, a hop at a time
+        for (juce::int64 i = 0; i < numHops; ++i)
+            anomaly.process (silence.data(), hopSize / sampleRate);
+
+        finishTrainingIfDue();
+    }
+
+    /** Pushes as many history frames as are due by the given sample position. */
+    void recordHistory (juce::int64 position, const float* levels)
+    {
+        if (! spectrumHistory.isEnabled())
+            return;
+
+        // after a gap (e.g. a change of resolution), carry on from now rather than back-filling it
+        if (position - nextHistoryPosition > sampleRate)
+            nextHistoryPosition = (double) position;
+
+        while (nextHistoryPosition <= (double) position)
+        {
+            spectrumHistory.push (levels);
+            nextHistoryPosition += historyInterval;
+        }
+    }
+
+    //==============================================================================
+    using Clock = std::chrono::high_resolution_clock;
+
+    static constexpr int maxFramesBehind = 4;
+
+    // channels per batch: 4 suits SSE and NEON, and stereo input fills two of them
+    enum { batchLanes = 4 };
+
+    // what reconfigure() asks the pipeline for, in order
+    enum { levelsOutput, magnitudesOutput };
+
+    AnalysisSettings settings;
+    double sampleRate = 44100.0;
+
+    SampleHistory history;
+    std::atomic<juce::int64> nextFrameEnd { 0 };
+
+    juce::CriticalSection analysisLock;
+    SpectrumAnalyser analyser;
+    AnalysisPipeline pipeline;
+    bool pipelineReady = false;     // false if the graph failed to compile, when frames go through analyser instead
+    std::vector<float> pipelineLevels;
+    FilterbankAnalyser filterbank;
+    WaveletAnalyser wavelets;
+    juce::int64 waveletEnd = -1;
+    std::unique_ptr<BatchedAnalyser<batchLanes>> batched;
+    std::vector<float> channelFrames, channelLevels, loudestLevels;
+    ReassignedSpectrogram spectrogram;
+    bool spectrogramEnabled = false;
+    std::vector<float> frame;
+    int hopSize = 1;
+    juce::int64 lastFrameEnd = 0;
+    bool idle = false;
+    juce::int64 silenceEnd = 0;
+
+    SilenceGate gate;
+    std::atomic<bool> displaySuspended { false };
+
+    SpectrumHistory spectrumHistory;
+    std::vector<float> silence;
+    double historyInterval = 735.0, nextHistoryPosition = 0.0;
+
+    BandStatistics statistics;
+    AnomalyDetector anomaly;
+    bool anomalySetUp = false;
+
+    FramePool framePool;
+    juce::SpinLock publishLock;
+    FrameView publishedFrame;
+    std::vector<std::unique_ptr<FrameSubscription>> subscriptions;
+    FrameSubscription* displayFrames = nullptr;
+    Cepstrum publishedCepstrum;
+    std::atomic<bool> newCepstrumAvailable { false };
+
+    juce::SpinLock timingLock;
+    Timing timing;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisEngine)
+};
@@ -0,0 +1,552 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "FrameKernels.h"
+#include "SpectrumAnalyser.h"
+#include "TemperedScale.h"
+
+//==============================================================================
+/**
+    The analysis of a frame as a graph of stages configured at run time:
+    windowing, FFT, frequency weighting, calibration, averaging over frames,
+    tempered-scale banding, ballistics and features.
+
+    A Graph names its nodes and what each one reads ("input" is the frame
+    passed to process()); the consumers name the nodes they want. prepare()
+    compiles that into a flat list of steps, and process() just runs them,
+    with no allocation and no look-ups:
+
+    - nodes that no requested output depends on are pruned, so a stage only
+      costs something in the configurations that use it;
+    - nodes set up to do nothing (no weighting, 0 dB calibration, no
+      averaging or ballistics) are bypassed, their readers wired to their input;
+    - intermediate results live in a few scratch buffers assigned by
+      liveness: a buffer is reused once the last step reading it has run, and
+      a stage that can work in place writes over its input when it's that
+      input's last reader. All scratch buffers are one size (enough for an
+      FFT frame), so any one can take any result.
+
+    Stateful stages (averaging, ballistics) keep their state per node, apart
+    from the scratch buffers. Like SpectrumAnalyser it has no threads or
+    locks; it's driven with frames of getFFTSize() samples.
+*/
+class AnalysisPipeline
+{
+public:
+    enum class Stage { window, fft, weighting, calibration, averaging, banding, ballistics, features };
+
+    struct Node
+    {
+        juce::String name;
+        Stage stage = Stage::window;
+        juce::String input;         // another node's name, or "input"
+        float parameter = 0.0f;     // see Options for what each stage takes
+        float parameter2 = 0.0f;
+    };
+
+    /** How the standard graph's optional stages are set up; the defaults do nothing. */
+    struct Options
+    {
+        bool aWeighting = false;    // weighting: A-weighted when parameter is 1
+        float calibrationDb = 0.0f; // calibration: gain in dB
+        float averaging = 1.0f;     // averaging: how much of each new frame goes into the average, (0, 1]
+        float attack = 1.0f;        // ballistics: the same per frame, rising and falling
+        float release = 1.0f;
+
+        /** Reads e.g. "weighting=a,calibration=3,average=0.3,ballistics=0.8:0.1". */
+        static Options fromString (const juce::String& text)
+        {
+            Options options;
+
+            for (auto& item : juce::StringArray::fromTokens (text, ",", ""))
+            {
+                auto key = item.upToFirstOccurrenceOf ("=", false, false).trim();
+                auto value = item.fromFirstOccurrenceOf ("=", false, false).trim();
+
+                if (key == "weighting")
+                    options.aWeighting = value.equalsIgnoreCase ("a");
+                else if (key == "calibration")
+                    options.calibrationDb = value.getFloatValue();
+                else if (key == "average")
+                    options.averaging = juce::jlimit (0.001f, 1.0f, value.getFloatValue());
+                else if (key == "ballistics")
+                {
+                    options.attack = juce::jlimit (0.001f, 1.0f, value.upToFirstOccurrenceOf (":", false, false).getFloatValue());
+                    options.release = value.contains (":") ? juce::jlimit (0.001f, 1.0f, value.fromFirstOccurrenceOf (":", false, false).getFloatValue())
+                                                           : options.attack;
+                }
+            }
+
+            return options;
+        }
+    };
+
+    struct Graph
+    {
+        std::vector<Node> nodes;
+
+        Graph& add (const juce::String& name, Stage stage, const juce::String& input,
+                    float parameter = 0.0f, float parameter2 = 0.0f)
+        {
+            nodes.push_back ({ name, stage, input, parameter, parameter2 });
+            return *this;
+        }
+
+        /** input > window > fft > weighting > calibration > averaging > "bands" > "levels" (ballistics) > "features". */
+        static Graph standard (const Options& options)
+        {
+            Graph graph;
+            graph.add ("window", Stage::window, "input")
+                 .add ("fft", Stage::fft, "window")
+                 .add ("weighting", Stage::weighting, "fft", options.aWeighting ? 1.0f : 0.0f)
+                 .add ("calibration", Stage::calibration, "weighting", options.calibrationDb)
+                 .add ("averaging", Stage::averaging, "calibration", options.averaging)
+                 .add ("bands", Stage::banding, "averaging")
+                 .add ("levels", Stage::ballistics, "bands", options.attack, options.release)
+                 .add ("features", Stage::features, "levels");
+            return graph;
+        }
+    };
+
+    AnalysisPipeline() = default;
+
+    //==============================================================================
+    /**
+        Compiles the graph for the named outputs and allocates everything it
+        needs. Returns false, with the reason in error, if a node reads one
+        that doesn't exist or gives the wrong kind of data, or if they form a loop.
+    */
+    bool prepare (const Graph& graph, const juce::StringArray& outputNames,
+                  int newFftOrder, double sampleRate, int groupNotes, juce::String& error)
+    {
+        fftOrder = newFftOrder;
+        fftSize = 1 << fftOrder;
+        nodes = graph.nodes;
+        steps.clear();
+        outputs.clear();
+
+        scale.build (groupNotes, fftSize, sampleRate, minFreq, maxFreq);
+        binHz = (float) (sampleRate / fftSize);
+
+        if (! resolveInputs (error))
+            return false;
+
+        std::vector<int> order;
+        std::vector<int> visits (nodes.size(), 0);
+
+        for (auto& name : outputNames)
+        {
+            auto node = findNode (name);
+
+            if (node < 0)
+            {
+                error = "no pipeline node called \"" + name + "\"";
+                return false;
+            }
+
+            if (! visit (node, visits, order, error))
+                return false;
+
+            outputs.push_back (node);
+        }
+
+        assignBuffers (order);
+        prepareStages();
+        reset();
+        return true;
+    }
+
+    /** Clears the averages and ballistics. */
+    void reset() noexcept
+    {
+        for (auto& step : steps)
+        {
+            if (step.stage == Stage::averaging)
+                std::fill (step.state.begin(), step.state.end(), 0.0f);
+            else if (step.stage == Stage::ballistics)
+                std::fill (step.state.begin(), step.state.end(), (float) mindB);
+        }
+    }
+
+    /** Runs one frame of getFFTSize() samples through the steps. */
+    void process (const float* frame) noexcept
+    {
+        for (auto& step : steps)
+        {
+            auto* in = step.input < 0 ? frame : buffers[(size_t) step.input].data();
+            auto* out = buffers[(size_t) step.output].data();
+            run (step, in, out);
+        }
+    }
+
+    //==============================================================================
+    int getNumOutputs() const noexcept                  { return (int) outputs.size(); }
+
+    /** An output's values after process(): bin magnitudes, band levels in dB, or features. */
+    const float* getOutput (int index) const noexcept  { return buffers[(size_t) nodeBuffer[(size_t) outputs[(size_t) index]]].data(); }
+    int getOutputSize (int index) const noexcept        { return sizeOf (kindOf (outputs[(size_t) index])); }
+
+    int getFFTSize() const noexcept                     { return fftSize; }
+    const TemperedScale& getScale() const noexcept      { return scale; }
+
+    /** The steps that run and how many scratch buffers they share, e.g. "window > fft > bands (2 buffers)". */
+    juce::String describePlan() const
+    {
+        juce::StringArray names;
+
+        for (auto& step : steps)
+            names.add (nodes[(size_t) step.node].name);
+
+        return names.joinIntoString (" > ") + " (" + juce::String ((int) buffers.size()) + " buffers)";
+    }
+
+    /** Overall level (mean band power, in dB), loudest band and power-weighted centroid, in Hz. */
+    static void computeFeatures (const float* levels, int numBands, const std::vector<float>& frequencies, float* features) noexcept
+    {
+        double totalPower = 0.0, weightedFrequency = 0.0;
+        int loudest = 0;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto power = std::pow (10.0, levels[b] / 10.0);
+            totalPower += power;
+            weightedFrequency += power * frequencies[(size_t) b];
+
+            if (levels[b] > levels[loudest])
+                loudest = b;
+        }
+
+        features[0] = (float) (10.0 * std::log10 (juce::jmax (totalPower / (double) juce::jmax (1, numBands), 1.0e-12)));
+        features[1] = numBands > 0 ? frequencies[(size_t) loudest] : 0.0f;
+        features[2] = totalPower > 0.0 ? (float) (weightedFrequency / totalPower) : 0.0f;
+    }
+
+    enum { numFeatures = 3 };
+
+    static constexpr float mindB = SpectrumAnalyser::mindB;
+    static constexpr float maxdB = SpectrumAnalyser::maxdB;
+
+private:
+    //==============================================================================
+    enum class Kind { samples, frame, spectrum, bands, features };
+
+    struct Step
+    {
+        Stage stage;
+        int node = 0, input = -1, output = 0;   // buffer indices; input -1 is the frame passed to process()
+        float parameter = 0.0f, parameter2 = 0.0f;
+        std::vector<float> state;               // per-bin weights, or the running average
+    };
+
+    static Kind outputKindOf (Stage stage) noexcept
+    {
+        switch (stage)
+        {
+            case Stage::window:         return Kind::frame;
+            case Stage::banding:
+            case Stage::ballistics:     return Kind::bands;
+            case Stage::features:       return Kind::features;
+            default:                    return Kind::spectrum;
+        }
+    }
+
+    static Kind inputKindOf (Stage stage) noexcept
+    {
+        switch (stage)
+        {
+            case Stage::window:         return Kind::samples;
+            case Stage::fft:            return Kind::frame;
+            case Stage::ballistics:
+            case Stage::features:       return Kind::bands;
+            default:                    return Kind::spectrum;
+        }
+    }
+
+    /** Whether a stage gives the same result written over its input; the FFT has to be. */
+    static bool worksInPlace (Stage stage) noexcept
+    {
+        return stage != Stage::window && stage != Stage::banding && stage != Stage::features;
+    }
+
+    /** Whether a node as configured passes its input through unchanged. */
+    static bool isBypassed (const Node& node) noexcept
+    {
+        switch (node.stage)
+        {
+            case Stage::weighting:      return node.parameter == 0.0f;
+            case Stage::calibration:    return node.parameter == 0.0f;
+            case Stage::averaging:      return node.parameter >= 1.0f;
+            case Stage::ballistics:     return node.parameter >= 1.0f && node.parameter2 >= 1.0f;
+            default:                    return false;
+        }
+    }
+
+    int sizeOf (Kind kind) const noexcept
+    {
+        switch (kind)
+        {
+            case Kind::samples:
+            case Kind::frame:           return fftSize;
+            case Kind::spectrum:        return fftSize / 2;
+            case Kind::bands:           return scale.getNumBands();
+            case Kind::features:        return numFeatures;
+        }
+
+        return 0;
+    }
+
+    int findNode (const juce::String& name) const noexcept
+    {
+        for (size_t i = 0; i < nodes.size(); ++i)
+            if (nodes[i].name == name)
+                return (int) i;
+
+        return -1;
+    }
+
+    /** What kind of result a node gives; -1 is the frame passed to process(). */
+    Kind kindOf (int node) const noexcept
+    {
+        return node < 0 ? Kind::samples : outputKindOf (nodes[(size_t) node].stage);
+    }
+
+    bool resolveInputs (juce::String& error)
+    {
+        inputNode.assign (nodes.size(), -1);
+
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            auto& node = nodes[i];
+            auto input = node.input == "input" ? -1 : findNode (node.input);
+
+            if (input < 0 && node.input != "input")
+            {
+                error = "pipeline node \"" + node.name + "\" reads \"" + node.input + "\", which doesn't exist";
+                return false;
+            }
+
+            if (kindOf (input) != inputKindOf (node.stage))
+            {
+                error = "pipeline node \"" + node.name + "\" can't read \"" + node.input + "\"";
+                return false;
+            }
+
+            inputNode[i] = input;
+        }
+
+        return true;
+    }
+
+    /** Depth-first from an output, appending nodes after everything they read. */
+    bool visit (int node, std::vector<int>& visits, std::vector<int>& order, juce::String& error)
+    {
+        if (node < 0 || visits[(size_t) node] == 2)
+            return true;
+
+        if (visits[(size_t) node] == 1)
+        {
+            error = "pipeline node \"" + nodes[(size_t) node].name + "\" depends on itself";
+            return false;
+        }
+
+        visits[(size_t) node] = 1;
+
+        if (! visit (inputNode[(size_t) node], visits, order, error))
+            return false;
+
+        visits[(size_t) node] = 2;
+        order.push_back (node);
+        return true;
+    }
+
+    void assignBuffers (const std::vector<int>& order)
+    {
+        // a bypassed node's result is whatever it reads
+        std::vector<int> source (nodes.size(), -1);
+
+        auto sourceOf = [&] (int node) { return node < 0 ? -1 : source[(size_t) node]; };
+
+        for (auto node : order)
+            source[(size_t) node] = isBypassed (nodes[(size_t) node]) ? sourceOf (inputNode[(size_t) node]) : node;
+
+        // liveness: the last step that reads each result; outputs are read after every step
+        std::vector<int> running;
+
+        for (auto node : order)
+            if (source[(size_t) node] == node)
+                running.push_back (node);
+
+        std::vector<int> lastUse (nodes.size(), -1);
+
+        for (size_t s = 0; s < running.size(); ++s)
+        {
+            auto input = sourceOf (inputNode[(size_t) running[s]]);
+
+            if (input >= 0)
+                lastUse[(size_t) input] = (int) s;
+        }
+
+        for (auto& output : outputs)
+        {
+            output = source[(size_t) output];
+            lastUse[(size_t) output] = std::numeric_limits<int>::max();
+        }
+
+        nodeBuffer.assign (nodes.size(), -1);
+        std::vector<int> freeBuffers;
+        int numBuffers = 0;
+
+        for (size_t s = 0; s < running.size(); ++s)
+        {
+            auto node = running[s];
+            auto input = sourceOf (inputNode[(size_t) node]);
+            auto inputBuffer = input < 0 ? -1 : nodeBuffer[(size_t) input];
+
+            Step step;
+            step.stage = nodes[(size_t) node].stage;
+            step.node = node;
+            step.input = inputBuffer;
+            step.parameter = nodes[(size_t) node].parameter;
+            step.parameter2 = nodes[(size_t) node].parameter2;
+
+            if (inputBuffer >= 0 && worksInPlace (step.stage) && lastUse[(size_t) input] == (int) s)
+            {
+                step.output = inputBuffer;
+            }
+            else
+            {
+                if (freeBuffers.empty())
+                    freeBuffers.push_back (numBuffers++);
+
+                step.output = freeBuffers.back();
+                freeBuffers.pop_back();
+
+                if (inputBuffer >= 0 && lastUse[(size_t) input] == (int) s)
+                    freeBuffers.push_back (inputBuffer);
+            }
+
+            nodeBuffer[(size_t) node] = step.output;
+            steps.push_back (std::move (step));
+        }
+
+        buffers.resize ((size_t) numBuffers);
+
+        for (auto& buffer : buffers)
+            buffer.assign ((size_t) juce::jmax (2 * fftSize, scale.getNumBands(), (int) numFeatures), 0.0f);
+    }
+
+    void prepareStages()
+    {
+        window.resize ((size_t) fftSize);
+        juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), (size_t) fftSize,
+                                                                  juce::dsp::WindowingFunction<float>::hann, true);
+        fft.reset (new juce::dsp::FFT (fftOrder));
+        windowFrame = FrameKernels<float>::getWindowFunction<float> (fftOrder);
+        computeLevels = FrameKernels<float>::getLevelsFunction (fftOrder);
+
+        for (auto& step : steps)
+        {
+            switch (step.stage)
+            {
+                case Stage::weighting:
+                    step.state.resize ((size_t) (fftSize / 2));
+
+                    for (int k = 0; k < fftSize / 2; ++k)
+                        step.state[(size_t) k] = aWeighting ((float) k * binHz);
+
+                    break;
+
+                case Stage::averaging:      step.state.assign ((size_t) (fftSize / 2), 0.0f); break;
+                case Stage::ballistics:     step.state.assign ((size_t) scale.getNumBands(), (float) mindB); break;
+                default:                    break;
+            }
+        }
+    }
+
+    /** The A-weighting gain at a frequency (IEC 61672), 1 at 1 kHz. */
+    static float aWeighting (float frequency) noexcept
+    {
+        auto f2 = (double) frequency * frequency;
+        auto ra = 12194.0 * 12194.0 * f2 * f2
+                    / ((f2 + 20.6 * 20.6) * std::sqrt ((f2 + 107.7 * 107.7) * (f2 + 737.9 * 737.9)) * (f2 + 12194.0 * 12194.0));
+
+        return (float) (ra * 1.2589);   // +2.0 dB
+    }
+
+    void run (Step& step, const float* in, float* out) noexcept
+    {
+        auto numBins = fftSize / 2;
+
+        switch (step.stage)
+        {
+            case Stage::window:
+                windowFrame (in, window.data(), out, fftSize);
+                break;
+
+            case Stage::fft:
+                // the window left the second half clear; a copy has to clear it again
+                if (in != out)
+                {
+                    std::copy (in, in + fftSize, out);
+                    std::fill (out + fftSize, out + 2 * fftSize, 0.0f);
+                }
+
+                fft->performFrequencyOnlyForwardTransform (out);
+                break;
+
+            case Stage::weighting:
+                juce::FloatVectorOperations::multiply (out, in, step.state.data(), numBins);
+                break;
+
+            case Stage::calibration:
+                juce::FloatVectorOperations::multiply (out, in, juce::Decibels::decibelsToGain (step.parameter), numBins);
+                break;
+
+            case Stage::averaging:
+                for (int k = 0; k < numBins; ++k)
+                    out[k] = step.state[(size_t) k] += step.parameter * (in[k] - step.state[(size_t) k]);
+                break;
+
+            case Stage::banding:
+                computeLevels (in, scale.getBars(), out, fftSize, mindB, maxdB);
+                break;
+
+            case Stage::ballistics:
+                for (int b = 0; b < scale.getNumBands(); ++b)
+                {
+                    auto& smoothed = step.state[(size_t) b];
+                    smoothed += (in[b] > smoothed ? step.parameter : step.parameter2) * (in[b] - smoothed);
+                    out[b] = smoothed;
+                }
+                break;
+
+            case Stage::features:
+                computeFeatures (in, scale.getNumBands(), scale.getFrequencies(), out);
+                break;
+        }
+    }
+
+    //==============================================================================
+    static constexpr float minFreq = 20.0f;
+    static constexpr float maxFreq = 22000.0f;
+
+    int fftOrder = 0, fftSize = 0;
+    float binHz = 1.0f;
+    TemperedScale scale;
+
+    std::vector<Node> nodes;
+    std::vector<int> inputNode, nodeBuffer, outputs;
+    std::vector<Step> steps;
+    std::vector<std::vector<float>> buffers;
+
+    std::vector<float> window;
+    std::unique_ptr<juce::dsp::FFT> fft;
+    FrameKernels<float>::WindowFunction<float> windowFrame = nullptr;
+    FrameKernels<float>::LevelsFunction computeLevels = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisPipeline)
+};
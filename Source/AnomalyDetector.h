@@ -0,0 +1,340 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+//==============================================================================
+/**
+    Learns what a machine normally sounds like and flags frames that don't fit.
+
+    While training, every frame updates a running mean and variance per band
+    (Welford's method, in double precision). Once trained, each frame is
+    scored as the RMS of its bands' z-scores against that baseline, in a few
+    vector passes over the bands; the score is smoothed over windowSeconds and
+    an alert is raised while the smoothed score is above the threshold (and
+    cleared once it falls below 80% of it, so it doesn't flicker).
+
+    A baseline only means something for the analysis it was learned from, so
+    it keeps that Layout (band count, FFT order, sample rate and notes per
+    band). Baselines are saved as a small little-endian file: a header with
+    the layout, then the mean and standard deviation of each band as 32-bit
+    floats. A file learned with a different layout won't load, and while the
+    analysis runs with a different one (say the QualityGovernor has lowered
+    the FFT order) frames are neither learned from nor scored, until it's
+    back.
+
+    Thread-safe: the analysis worker calls process() while the message thread
+    trains, saves and loads.
+*/
+class AnomalyDetector
+{
+public:
+    enum class Mode { off, training, monitoring };
+
+    struct Status
+    {
+        Mode mode = Mode::off;
+        double trainedSeconds = 0.0;
+        float score = 0.0f;         // smoothed RMS z-score
+        float threshold = 3.0f;
+        bool alert = false;
+        int worstBand = -1;         // the band deviating most in the last frame
+        bool layoutMatches = true;  // false while the analysis differs from the baseline's, and frames are ignored
+    };
+
+    /** What the levels being learned or scored come from. */
+    struct Layout
+    {
+        int numBands = 0, fftOrder = 0, groupNotes = 0;
+        double sampleRate = 0.0;
+
+        bool operator== (const Layout& other) const noexcept
+        {
+            return numBands == other.numBands && fftOrder == other.fftOrder
+                && groupNotes == other.groupNotes && sampleRate == other.sampleRate;
+        }
+
+        bool operator!= (const Layout& other) const noexcept    { return ! operator== (other); }
+
+        juce::String toString() const
+        {
+            return juce::String (numBands) + " bands, fft order " + juce::String (fftOrder) + ", "
+                 + juce::String (sampleRate) + " Hz, " + juce::String (groupNotes) + " notes per band";
+        }
+    };
+
+    AnomalyDetector() = default;
+
+    /** Called whenever the analysis changes. Starts over if the band count has; otherwise the baseline waits for its layout to come back. */
+    void prepare (const Layout& newLayout)
+    {
+        const juce::ScopedLock sl (lock);
+
+        auto newNumBands = newLayout.numBands;
+        layout = newLayout;
+        status.layoutMatches = status.mode == Mode::off || layout == baselineLayout;
+
+        if (newNumBands == numBands)
+            return;
+
+        numBands = newNumBands;
+        mean.assign ((size_t) numBands, 0.0);
+        m2.assign ((size_t) numBands, 0.0);
+        baselineMean.assign ((size_t) numBands, 0.0f);
+        inverseDeviation.assign ((size_t) numBands, 0.0f);
+        deviations.assign ((size_t) numBands, 0.0f);
+        status.mode = Mode::off;
+        status.layoutMatches = true;
+    }
+
+    void setThreshold (float newThreshold)
+    {
+        const juce::ScopedLock sl (lock);
+        status.threshold = newThreshold;
+    }
+
+    //==============================================================================
+    void startTraining()
+    {
+        const juce::ScopedLock sl (lock);
+
+        std::fill (mean.begin(), mean.end(), 0.0);
+        std::fill (m2.begin(), m2.end(), 0.0);
+        numTrainingFrames = 0;
+        baselineLayout = layout;
+        status.trainedSeconds = 0.0;
+        status.mode = Mode::training;
+        status.layoutMatches = true;
+        resetScore();
+    }
+
+    /** Turns what's been learned into the baseline; returns false (and stops) if there wasn't enough of it. */
+    bool finishTraining()
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (numTrainingFrames < minTrainingFrames)
+        {
+            status.mode = Mode::off;
+            return false;
+        }
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto deviation = std::sqrt (m2[(size_t) b] / (double) (numTrainingFrames - 1));
+            baselineMean[(size_t) b] = (float) mean[(size_t) b];
+            inverseDeviation[(size_t) b] = (float) (1.0 / juce::jmax (deviation, minDeviationDb));
+        }
+
+        status.mode = Mode::monitoring;
+        resetScore();
+        return true;
+    }
+
+    Status getStatus() const
+    {
+        const juce::ScopedLock sl (lock);
+        return status;
+    }
+
+    //==============================================================================
+    /** Called by the analysis worker with each frame's band levels (in dB) and how much time it covers. */
+    void process (const float* levels, double frameSeconds)
+    {
+        bool alertChanged = false;
+        Status now;
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (! status.layoutMatches)
+                return;
+
+            if (status.mode == Mode::training)
+                train (levels, frameSeconds);
+            else if (status.mode == Mode::monitoring)
+                alertChanged = score (levels, frameSeconds);
+
+            now = status;
+        }
+
+        if (alertChanged)
+            std::cout << (now.alert ? "anomaly: score " : "anomaly cleared: score ")
+                      << juce::String (now.score, 2) << " (threshold " << juce::String (now.threshold, 2)
+                      << ", worst band " << now.worstBand << ")" << std::endl;
+    }
+
+    //==============================================================================
+    bool save (const juce::File& file) const
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (status.mode != Mode::monitoring)
+            return false;
+
+        file.deleteFile();
+        juce::FileOutputStream out (file);
+
+        if (out.failedToOpen())
+            return false;
+
+        out.writeInt ((int) magic);
+        out.writeInt (version);
+        out.writeInt (baselineLayout.numBands);
+        out.writeInt (baselineLayout.fftOrder);
+        out.writeDouble (baselineLayout.sampleRate);
+        out.writeInt (baselineLayout.groupNotes);
+        out.writeInt64 (numTrainingFrames);
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            out.writeFloat (baselineMean[(size_t) b]);
+            out.writeFloat (1.0f / inverseDeviation[(size_t) b]);
+        }
+
+        out.flush();
+        return out.getStatus().wasOk();
+    }
+
+    bool load (const juce::File& file, juce::String& error)
+    {
+        juce::FileInputStream in (file);
+
+        if (in.failedToOpen())
+        {
+            error = "can't open " + file.getFullPathName();
+            return false;
+        }
+
+        if ((juce::uint32) in.readInt() != magic)
+        {
+            error = file.getFullPathName() + " isn't a baseline";
+            return false;
+        }
+
+        if (in.readInt() != version)
+        {
+            error = file.getFullPathName() + " is from another version; learn the baseline again";
+            return false;
+        }
+
+        Layout saved;
+        saved.numBands = in.readInt();
+        saved.fftOrder = in.readInt();
+        saved.sampleRate = in.readDouble();
+        saved.groupNotes = in.readInt();
+
+        const juce::ScopedLock sl (lock);
+
+        if (saved != layout)
+        {
+            error = file.getFullPathName() + " was learned with " + saved.toString() + ", not " + layout.toString();
+            return false;
+        }
+
+        if (in.getNumBytesRemaining() < 8 + 8 * (juce::int64) numBands)
+        {
+            error = file.getFullPathName() + " is truncated";
+            return false;
+        }
+
+        numTrainingFrames = in.readInt64();
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            baselineMean[(size_t) b] = in.readFloat();
+            inverseDeviation[(size_t) b] = 1.0f / juce::jmax (in.readFloat(), (float) minDeviationDb);
+        }
+
+        baselineLayout = saved;
+        status.mode = Mode::monitoring;
+        status.layoutMatches = true;
+        resetScore();
+        return true;
+    }
+
+private:
+    //==============================================================================
+    void train (const float* levels, double frameSeconds) noexcept
+    {
+        ++numTrainingFrames;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto delta = levels[b] - mean[(size_t) b];
+            mean[(size_t) b] += delta / (double) numTrainingFrames;
+            m2[(size_t) b] += delta * (levels[b] - mean[(size_t) b]);
+        }
+
+        status.trainedSeconds += frameSeconds;
+    }
+
+    /** Returns true if the alert was raised or cleared. */
+    bool score (const float* levels, double frameSeconds) noexcept
+    {
+        auto* z = deviations.data();
+        juce::FloatVectorOperations::subtract (z, levels, baselineMean.data(), numBands);
+        juce::FloatVectorOperations::multiply (z, inverseDeviation.data(), numBands);
+
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int b = 0;
+
+        for (; b + 4 <= numBands; b += 4)
+        {
+            s0 += z[b] * z[b];
+            s1 += z[b + 1] * z[b + 1];
+            s2 += z[b + 2] * z[b + 2];
+            s3 += z[b + 3] * z[b + 3];
+        }
+
+        for (; b < numBands; ++b)
+            s0 += z[b] * z[b];
+
+        auto frameScore = std::sqrt (((s0 + s1) + (s2 + s3)) / (float) juce::jmax (1, numBands));
+
+        auto range = juce::FloatVectorOperations::findMinAndMax (z, numBands);
+        auto worst = std::abs (range.getStart()) > std::abs (range.getEnd()) ? range.getStart() : range.getEnd();
+        status.worstBand = (int) (std::find (z, z + numBands, worst) - z);
+
+        // a one-pole average over roughly windowSeconds, whatever the frame rate
+        auto alpha = (float) (1.0 - std::exp (-frameSeconds / windowSeconds));
+        status.score += alpha * (frameScore - status.score);
+
+        auto wasAlert = status.alert;
+
+        if (status.score > status.threshold)
+            status.alert = true;
+        else if (status.score < status.threshold * 0.8f)
+            status.alert = false;
+
+        return status.alert != wasAlert;
+    }
+
+    void resetScore() noexcept
+    {
+        status.score = 0.0f;
+        status.alert = false;
+        status.worstBand = -1;
+    }
+
+    //==============================================================================
+    static constexpr double minDeviationDb = 1.0;     // so perfectly steady bands don't make every wobble an alert
+    static constexpr double windowSeconds = 2.0;
+    static constexpr juce::uint32 magic = 0x4c424e41; // "ANBL"
+
+    enum { version = 2, minTrainingFrames = 100 };
+
+    juce::CriticalSection lock;
+    int numBands = 0;
+    Layout layout, baselineLayout;
+    Status status;
+
+    juce::int64 numTrainingFrames = 0;
+    std::vector<double> mean, m2;
+    std::vector<float> baselineMean, inverseDeviation, deviations;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnomalyDetector)
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+
+//==============================================================================
+/**
+    Opens an AudioDeviceManager's default device on a thread of its own, as
+    some drivers (ALSA, JACK) take seconds to scan and negotiate, and then
+    calls onOpened on the message thread with the error, if there was one.
+
+    Nothing else may use the manager until onOpened has been called. Deleting
+    the opener waits for a negotiation in progress to finish, as a driver
+    can't be interrupted part way through; onOpened is still called after
+    that, so it mustn't refer to anything that might have gone.
+*/
+class AudioDeviceOpener  : private juce::Thread
+{
+public:
+    AudioDeviceOpener (juce::AudioDeviceManager& managerToOpen, int numInputChannelsToOpen, int numOutputChannelsToOpen)
+        : juce::Thread ("Audio device opener"),
+          manager (managerToOpen),
+          numInputChannels (numInputChannelsToOpen),
+          numOutputChannels (numOutputChannelsToOpen)
+    {
+    }
+
+    ~AudioDeviceOpener() override
+    {
+        stopThread (-1);
+    }
+
+    /** Starts opening the device; call this once, after setting onOpened. */
+    void open()     { startThread(); }
+
+    /** Called on the message thread once the device is open, or has failed to open. */
+    std::function<void (const juce::String& error)> onOpened;
+
+private:
+    //==============================================================================
+    void run() override
+    {
+        auto error = manager.initialise (numInputChannels, numOutputChannels, nullptr, true);
+        auto callback = onOpened;
+
+        if (callback != nullptr)
+            juce::MessageManager::callAsync ([callback, error] { callback (error); });
+    }
+
+    juce::AudioDeviceManager& manager;
+    const int numInputChannels, numOutputChannels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioDeviceOpener)
+};
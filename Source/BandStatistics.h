@@ -0,0 +1,175 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+//==============================================================================
+/**
+    Long-term average spectrum and level percentiles for each band.
+
+    Every frame costs O(bands): one compensated addition to the band's power sum
+    and one increment in its level histogram. The histograms have fixed 0.25 dB
+    bins over the analysed range, so memory stays constant however long this
+    runs, and percentiles are read off the cumulative counts only when asked
+    for. The counters are 64-bit, so they won't wrap in any realistic run.
+
+    Only frames with signal in them are added: while the silence gate is
+    closed nothing is analysed, so silence doesn't drag the mean and the
+    low percentiles down to the floor. How much was left out that way is
+    counted with addSilence() and reported alongside.
+
+    Thread-safe: the analysis worker adds frames while the display reads.
+*/
+class BandStatistics
+{
+public:
+    BandStatistics (float mindBToUse, float maxdBToUse)
+        : mindB (mindBToUse), maxdB (maxdBToUse),
+          numBins ((int) std::ceil ((maxdBToUse - mindBToUse) / binWidthDb) + 1)
+    {
+    }
+
+    /** Starts collecting for a band count; keeps what's collected if the count hasn't changed. */
+    void prepare (int newNumBands)
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (newNumBands != numBands)
+        {
+            numBands = newNumBands;
+            resetLocked();
+        }
+    }
+
+    void reset()
+    {
+        const juce::ScopedLock sl (lock);
+        resetLocked();
+    }
+
+    /** Adds one frame of band levels in dB. */
+    void addFrame (const float* levels) noexcept
+    {
+        const juce::ScopedLock sl (lock);
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto db = juce::jlimit (mindB, maxdB, levels[b]);
+
+            // Kahan summation keeps days of small additions from drowning in the total
+            auto power = std::pow (10.0, db / 10.0) - powerCompensation[(size_t) b];
+            auto total = powerSum[(size_t) b] + power;
+            powerCompensation[(size_t) b] = (total - powerSum[(size_t) b]) - power;
+            powerSum[(size_t) b] = total;
+
+            auto bin = (int) ((db - mindB) / binWidthDb + 0.5f);
+            ++histograms[(size_t) (b * numBins + bin)];
+        }
+
+        ++numFrames;
+    }
+
+    /** Counts a stretch of input that was left out for being silent. */
+    void addSilence (double seconds) noexcept
+    {
+        const juce::ScopedLock sl (lock);
+        silentSeconds += seconds;
+    }
+
+    //==============================================================================
+    struct Summary
+    {
+        juce::uint64 numFrames = 0;
+        double silentSeconds = 0.0;     // of input left out
+        std::vector<float> meanDb, p10, p50, p90, p99;
+    };
+
+    /** Computes the mean power and percentiles of every band, in dB. */
+    Summary getSummary() const
+    {
+        const juce::ScopedLock sl (lock);
+
+        Summary summary;
+        summary.numFrames = numFrames;
+        summary.silentSeconds = silentSeconds;
+
+        for (auto* v : { &summary.meanDb, &summary.p10, &summary.p50, &summary.p90, &summary.p99 })
+            v->assign ((size_t) numBands, mindB);
+
+        if (numFrames == 0)
+            return summary;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            summary.meanDb[(size_t) b] = (float) (10.0 * std::log10 (juce::jmax (powerSum[(size_t) b] / (double) numFrames, 1.0e-30)));
+
+            auto* counts = histograms.data() + b * numBins;
+            summary.p10[(size_t) b] = percentile (counts, 0.10);
+            summary.p50[(size_t) b] = percentile (counts, 0.50);
+            summary.p90[(size_t) b] = percentile (counts, 0.90);
+            summary.p99[(size_t) b] = percentile (counts, 0.99);
+        }
+
+        return summary;
+    }
+
+    /** Writes the summary as CSV, one row per band. */
+    static bool writeCsv (const Summary& summary, const std::vector<float>& frequencies, const juce::File& file)
+    {
+        juce::String csv ("frequency_hz,mean_db,p10_db,p50_db,p90_db,p99_db\n");
+
+        for (size_t b = 0; b < summary.meanDb.size() && b < frequencies.size(); ++b)
+            csv << juce::String (frequencies[b], 2) << "," << juce::String (summary.meanDb[b], 2) << ","
+                << juce::String (summary.p10[b], 2) << "," << juce::String (summary.p50[b], 2) << ","
+                << juce::String (summary.p90[b], 2) << "," << juce::String (summary.p99[b], 2) << "\n";
+
+        return file.replaceWithText (csv);
+    }
+
+private:
+    void resetLocked()
+    {
+        numFrames = 0;
+        silentSeconds = 0.0;
+        powerSum.assign ((size_t) numBands, 0.0);
+        powerCompensation.assign ((size_t) numBands, 0.0);
+        histograms.assign ((size_t) (numBands * numBins), 0);
+    }
+
+    /** Interpolates within the bin where the cumulative count crosses the fraction. */
+    float percentile (const juce::uint64* counts, double fraction) const noexcept
+    {
+        auto target = fraction * (double) numFrames;
+        double cumulative = 0.0;
+
+        for (int i = 0; i < numBins; ++i)
+        {
+            auto next = cumulative + (double) counts[i];
+
+            if (next >= target && counts[i] > 0)
+            {
+                auto within = (target - cumulative) / (double) counts[i];
+                return mindB + binWidthDb * ((float) i - 0.5f + (float) within);
+            }
+
+            cumulative = next;
+        }
+
+        return maxdB;
+    }
+
+    static constexpr float binWidthDb = 0.25f;
+
+    const float mindB, maxdB;
+    const int numBins;
+
+    juce::CriticalSection lock;
+    int numBands = 0;
+    juce::uint64 numFrames = 0;
+    double silentSeconds = 0.0;
+    std::vector<double> powerSum, powerCompensation;
+    std::vector<juce::uint64> histograms;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BandStatistics)
+};
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstring>
+#include <vector>
+#include "TemperedScale.h"
+
+//==============================================================================
+/**
+    Analyses many channels that share the same FFT size and banding.
+
+    Channels are grouped numLanes at a time and stored interleaved, so that
+    sample i of every channel in a group sits in one contiguous run:
+
+        data[i * numLanes + lane]
+
+    Every stage (windowing, the FFT butterflies, power, dB conversion, banding
+    and ballistics) loops over a whole group with a fixed-width innermost lane
+    loop, which the compiler turns into one vector instruction per step. The
+    FFT is a radix-2 complex transform batched over the lanes, so a group of
+    channels costs roughly the same as a single one.
+
+    Use 4 lanes for SSE/NEON, 8 for AVX and 16 for AVX-512 builds.
+*/
+template <int numLanes>
+class BatchedAnalyser
+{
+public:
+    BatchedAnalyser (int fftOrder, int numChannelsToUse, double sampleRate, int groupNotes = 2)
+        : fftSize (1 << fftOrder),
+          numChannels (numChannelsToUse),
+          numGroups ((numChannelsToUse + numLanes - 1) / numLanes),
+          // same reference as the single channel display: gainToDecibels (fftSize)
+          normalisationDb (10.0f * std::log10 ((float) fftSize * (float) fftSize))
+    {
+        scale.build (groupNotes, fftSize, sampleRate);
+        numBands = scale.getNumBands();
+
+        window.resize ((size_t) fftSize);
+        // normalised, as the single channel display's WindowingFunction is by default
+        juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), (size_t) fftSize,
+                                                                  juce::dsp::WindowingFunction<float>::hann, true);
+
+        twiddleRe.resize ((size_t) fftSize / 2);
+        twiddleIm.resize ((size_t) fftSize / 2);
+
+        for (int k = 0; k < fftSize / 2; ++k)
+        {
+            auto angle = -juce::MathConstants<double>::twoPi * k / fftSize;
+            twiddleRe[(size_t) k] = (float) std::cos (angle);
+            twiddleIm[(size_t) k] = (float) std::sin (angle);
+        }
+
+        bitReversed.resize ((size_t) fftSize);
+
+        for (int i = 0; i < fftSize; ++i)
+        {
+            int r = 0;
+
+            for (int b = 0; b < fftOrder; ++b)
+                r |= ((i >> b) & 1) << (fftOrder - 1 - b);
+
+            bitReversed[(size_t) i] = r;
+        }
+
+        groups.resize ((size_t) numGroups);
+
+        for (auto& group : groups)
+        {
+            group.re.resize ((size_t) (fftSize * numLanes));
+            group.im.resize ((size_t) (fftSize * numLanes));
+            group.levels.resize ((size_t) (fftSize / 2 * numLanes));
+            group.bands.resize ((size_t) (numBands * numLanes));
+            group.smoothed.assign ((size_t) (numBands * numLanes), (float) mindB);
+        }
+    }
+
+    //==============================================================================
+    /** Sets the ballistics as per-frame smoothing coefficients (1 = no smoothing). */
+    void setBallistics (float attackCoefficient, float releaseCoefficient) noexcept
+    {
+        attack = attackCoefficient;
+        release = releaseCoefficient;
+    }
+
+    /** Analyses one frame per channel. Each pointer must reference fftSize samples. */
+    void process (const float* const* channelFrames) noexcept
+    {
+        for (int g = 0; g < numGroups; ++g)
+        {
+            auto& group = groups[(size_t) g];
+
+            interleaveAndWindow (group, channelFrames + g * numLanes, juce::jmin (numLanes, numChannels - g * numLanes));
+            performFFT (group);
+            computeLevels (group);
+            applyBanding (group);
+            applyBallistics (group);
+        }
+    }
+
+    /** Returns the smoothed level in dB (-100 to 0) of one band of one channel. */
+    float getBandLevel (int channel, int band) const noexcept
+    {
+        auto& group = groups[(size_t) (channel / numLanes)];
+        return group.smoothed[(size_t) (band * numLanes + channel % numLanes)];
+    }
+
+    /** Copies the smoothed band levels of one channel into dest, which must hold getNumBands() values. */
+    void copyBandLevels (int channel, float* dest) const noexcept
+    {
+        auto& group = groups[(size_t) (channel / numLanes)];
+        auto lane = channel % numLanes;
+
+        for (int b = 0; b < numBands; ++b)
+            dest[b] = group.smoothed[(size_t) (b * numLanes + lane)];
+    }
+
+    int getNumBands() const noexcept                 { return numBands; }
+    int getNumChannels() const noexcept              { return numChannels; }
+    int getFFTSize() const noexcept                  { return fftSize; }
+    const TemperedScale& getScale() const noexcept   { return scale; }
+
+private:
+    struct Group
+    {
+        std::vector<float> re, im, levels, bands, smoothed;
+    };
+
+    //==============================================================================
+    void interleaveAndWindow (Group& group, const float* const* frames, int numActive) noexcept
+    {
+        auto* re = group.re.data();
+
+        for (int i = 0; i < fftSize; ++i)
+        {
+            float lanes[numLanes] = {};
+
+            for (int lane = 0; lane < numActive; ++lane)
+                lanes[lane] = frames[lane][i];
+
+            auto w = window[(size_t) i];
+            auto* dest = re + bitReversed[(size_t) i] * numLanes;
+
+            for (int lane = 0; lane < numLanes; ++lane)
+                dest[lane] = lanes[lane] * w;
+        }
+
+        std::fill (group.im.begin(), group.im.end(), 0.0f);
+    }
+
+    /** Iterative radix-2 decimation-in-time; input is already in bit-reversed order. */
+    void performFFT (Group& group) noexcept
+    {
+        auto* re = group.re.data();
+        auto* im = group.im.data();
+
+        for (int half = 1; half < fftSize; half <<= 1)
+        {
+            auto twiddleStep = fftSize / (half * 2);
+
+            for (int start = 0; start < fftSize; start += half * 2)
+            {
+                for (int k = 0; k < half; ++k)
+                {
+                    auto wr = twiddleRe[(size_t) (k * twiddleStep)];
+                    auto wi = twiddleIm[(size_t) (k * twiddleStep)];
+
+                    auto* aRe = re + (start + k) * numLanes;
+                    auto* aIm = im + (start + k) * numLanes;
+                    auto* bRe = re + (start + k + half) * numLanes;
+                    auto* bIm = im + (start + k + half) * numLanes;
+
+                    for (int lane = 0; lane < numLanes; ++lane)
+                    {
+                        auto tRe = bRe[lane] * wr - bIm[lane] * wi;
+                        auto tIm = bRe[lane] * wi + bIm[lane] * wr;
+
+                        bRe[lane] = aRe[lane] - tRe;
+                        bIm[lane] = aIm[lane] - tIm;
+                        aRe[lane] += tRe;
+                        aIm[lane] += tIm;
+                    }
+                }
+            }
+        }
+    }
+
+    /** Power, then dB relative to full scale, clamped to the displayed range. */
+    void computeLevels (Group& group) noexcept
+    {
+        auto* re = group.re.data();
+        auto* im = group.im.data();
+        auto* levels = group.levels.data();
+        auto count = fftSize / 2 * numLanes;
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto power = juce::jmax (re[i] * re[i] + im[i] * im[i], 1.0e-20f);
+            auto db = dbPerOctave * fastLog2 (power) - normalisationDb;
+            levels[i] = juce::jlimit (mindB, maxdB, db);
+        }
+    }
+
+    void applyBanding (Group& group) noexcept
+    {
+        auto& bars = scale.getBars();
+        auto lastBin = fftSize / 2 - 1;
+        auto* levels = group.levels.data();
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto& bar = bars[(size_t) b];
+            auto* dest = group.bands.data() + b * numLanes;
+            auto dataIdx = juce::jmin (bar.dataIdx, lastBin);
+
+            if (bar.endIdx == 0)
+            {
+                auto* current = levels + dataIdx * numLanes;
+
+                if (bar.factor > 0.0f && dataIdx > 0)
+                {
+                    auto* prev = levels + (dataIdx - 1) * numLanes;
+
+                    for (int lane = 0; lane < numLanes; ++lane)
+                        dest[lane] = prev[lane] + (current[lane] - prev[lane]) * bar.factor;
+                }
+                else
+                {
+                    for (int lane = 0; lane < numLanes; ++lane)
+                        dest[lane] = current[lane];
+                }
+            }
+            else
+            {
+                for (int lane = 0; lane < numLanes; ++lane)
+                    dest[lane] = mindB;
+
+                for (int j = dataIdx; j <= juce::jmin (bar.endIdx, lastBin); ++j)
+                {
+                    auto* bin = levels + j * numLanes;
+
+                    for (int lane = 0; lane < numLanes; ++lane)
+                        dest[lane] = juce::jmax (dest[lane], bin[lane]);
+                }
+            }
+        }
+    }
+
+    void applyBallistics (Group& group) noexcept
+    {
+        auto* bands = group.bands.data();
+        auto* smoothed = group.smoothed.data();
+        auto count = numBands * numLanes;
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto coefficient = bands[i] > smoothed[i] ? attack : release;
+            smoothed[i] += coefficient * (bands[i] - smoothed[i]);
+        }
+    }
+
+    /** Polynomial log2 on the mantissa, written so it vectorises (error < 1e-4). */
+    static float fastLog2 (float x) noexcept
+    {
+        juce::int32 bits;
+        std::memcpy (&bits, &x, sizeof (bits));
+
+        auto exponent = (float) (((bits >> 23) & 0xff) - 127);
+        bits = (bits & 0x007fffff) | 0x3f800000;
+
+        float m;
+        std::memcpy (&m, &bits, sizeof (m));
+
+        // the polynomial approximates ln (m) on [1, 2), so it's scaled to octaves
+        auto lnMantissa = -1.7417939f + (2.8212026f + (-1.4699568f + (0.44717955f - 0.056570851f * m) * m) * m) * m;
+        return exponent + lnMantissa * 1.4426950f;
+    }
+
+    //==============================================================================
+    static constexpr float mindB = -100.0f;
+    static constexpr float maxdB = 0.0f;
+    static constexpr float dbPerOctave = 3.0102999566f;  // 10 * log10 (2)
+
+    const int fftSize, numChannels, numGroups;
+    const float normalisationDb;
+    int numBands = 0;
+    float attack = 1.0f, release = 0.2f;
+
+    TemperedScale scale;
+    std::vector<float> window, twiddleRe, twiddleIm;
+    std::vector<int> bitReversed;
+    std::vector<Group> groups;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchedAnalyser)
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+//==============================================================================
+/**
+    A double-precision FFT with the same interface and data layouts as the
+    parts of juce::dsp::FFT the analysers use, which only comes in float.
+
+    It's a plain iterative radix-2 transform with precomputed twiddles, and
+    runs real input through the full complex transform, so it's a few times
+    slower than the float one: meant for measurements, not the display.
+    Like juce::dsp::FFT its methods are const, but they share a work buffer,
+    so one object must not be used from two threads at once.
+*/
+class DoubleFFT
+{
+public:
+    explicit DoubleFFT (int order)
+        : size (1 << order),
+          work ((size_t) size),
+          twiddles ((size_t) juce::jmax (1, size / 2)),
+          reversed ((size_t) size)
+    {
+        for (int k = 0; k < size / 2; ++k)
+            twiddles[(size_t) k] = std::polar (1.0, -juce::MathConstants<double>::twoPi * k / size);
+
+        for (int i = 0, j = 0; i < size; ++i)
+        {
+            reversed[(size_t) i] = j;
+
+            auto bit = size >> 1;
+
+            for (; bit > 0 && (j & bit) != 0; bit >>= 1)
+                j ^= bit;
+
+            j |= bit;
+        }
+    }
+
+    int getSize() const noexcept    { return size; }
+
+    /** Takes getSize() real samples from a buffer of 2 * getSize() and leaves the complex spectrum in it, re and im interleaved. */
+    void performRealOnlyForwardTransform (double* inputOutputData, bool onlyCalculateNonNegativeFrequencies = false) const noexcept
+    {
+        for (int i = 0; i < size; ++i)
+            work[(size_t) reversed[(size_t) i]] = inputOutputData[i];
+
+        transform();
+
+        auto numBins = onlyCalculateNonNegativeFrequencies ? size / 2 + 1 : size;
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            inputOutputData[2 * k] = work[(size_t) k].real();
+            inputOutputData[2 * k + 1] = work[(size_t) k].imag();
+        }
+    }
+
+    /** Takes getSize() / 2 + 1 complex bins and leaves getSize() real samples, scaled by 1 / getSize() like juce::dsp::FFT. */
+    void performRealOnlyInverseTransform (double* inputOutputData) const noexcept
+    {
+        // the spectrum of a real signal is conjugate-symmetric, and conjugating
+        // on the way in and out turns the forward transform into the inverse
+        for (int k = 0; k <= size / 2; ++k)
+        {
+            std::complex<double> bin (inputOutputData[2 * k], inputOutputData[2 * k + 1]);
+            work[(size_t) reversed[(size_t) k]] = std::conj (bin);
+
+            if (k > 0 && k < size / 2)
+                work[(size_t) reversed[(size_t) (size - k)]] = bin;
+        }
+
+        transform();
+
+        for (int i = 0; i < size; ++i)
+            inputOutputData[i] = work[(size_t) i].real() / size;
+    }
+
+    /** Takes getSize() real samples and leaves the magnitude of every bin. */
+    void performFrequencyOnlyForwardTransform (double* inputOutputData) const noexcept
+    {
+        for (int i = 0; i < size; ++i)
+            work[(size_t) reversed[(size_t) i]] = inputOutputData[i];
+
+        transform();
+
+        for (int k = 0; k < size; ++k)
+            inputOutputData[k] = std::abs (work[(size_t) k]);
+    }
+
+private:
+    /** In place on work, which must already be in bit-reversed order. */
+    void transform() const noexcept
+    {
+        for (int half = 1; half < size; half <<= 1)
+        {
+            auto stride = size / (2 * half);
+
+            for (int start = 0; start < size; start += 2 * half)
+            {
+                for (int k = 0; k < half; ++k)
+                {
+                    auto& a = work[(size_t) (start + k)];
+                    auto& b = work[(size_t) (start + k + half)];
+                    auto t = b * twiddles[(size_t) (k * stride)];
+
+                    b = a - t;
+                    a += t;
+                }
+            }
+        }
+    }
+
+    const int size;
+    mutable std::vector<std::complex<double>> work;
+    std::vector<std::complex<double>> twiddles;
+    std::vector<int> reversed;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DoubleFFT)
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    Band levels from a bank of band-pass filters instead of an FFT, for when
+    the bars have to react within milliseconds: there's no frame to fill, so
+    a level is up to date as soon as the samples it's made from have been
+    processed.
+
+    Each tempered-scale band gets a 4th-order band-pass (two identical
+    biquads), as wide as the gap to its neighbours, followed by an envelope
+    follower on its output power that attacks within a couple of periods of
+    the band's centre and releases more slowly. Bands are packed several to a
+    SIMDRegister, so every biquad stage and follower runs on a whole group of
+    bands at once; each group runs through a block of samples with its state
+    held in registers.
+
+    Levels are calibrated to read the same as SpectrumAnalyser's for a steady
+    sine at a band's centre. Like SpectrumAnalyser it has no threads or locks
+    of its own.
+*/
+class FilterbankAnalyser
+{
+public:
+    FilterbankAnalyser() = default;
+
+    /** Designs one band per centre frequency and clears all the filters. */
+    void prepare (const std::vector<float>& centreFrequencies, double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        numBands = (int) centreFrequencies.size();
+        numGroups = (numBands + (int) lanes - 1) / (int) lanes;
+
+        stages.assign ((size_t) (numGroups * numStages), {});
+        followers.assign ((size_t) numGroups, {});
+        levels.assign ((size_t) numBands, (float) SpectrumAnalyser::mindB);
+
+        for (int b = 0; b < numBands; ++b)
+            designBand (b, centreFrequencies);
+
+        reset();
+    }
+
+    /** Clears the filters and envelopes, e.g. after a gap in the input. */
+    void reset() noexcept
+    {
+        for (auto& stage : stages)
+            stage.z1 = stage.z2 = Vec::expand (0.0f);
+
+        for (auto& follower : followers)
+            follower.envelope = Vec::expand (0.0f);
+    }
+
+    /** Runs a block of samples through every band, then updates getLevels(). */
+    void process (const float* samples, int numSamples) noexcept
+    {
+        juce::ScopedNoDenormals noDenormals;
+
+        for (int g = 0; g < numGroups; ++g)
+        {
+            auto* groupStages = stages.data() + g * numStages;
+            auto& follower = followers[(size_t) g];
+
+            Vec z1[numStages], z2[numStages];
+
+            for (int s = 0; s < numStages; ++s)
+            {
+                z1[s] = groupStages[s].z1;
+                z2[s] = groupStages[s].z2;
+            }
+
+            auto envelope = follower.envelope;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                auto x = Vec::expand (samples[i]);
+
+                // transposed direct form II; a band-pass has b1 = 0 and b2 = -b0
+                for (int s = 0; s < numStages; ++s)
+                {
+                    auto& c = groupStages[s];
+                    auto y = c.b0 * x + z1[s];
+                    z1[s] = z2[s] - c.a1 * y;
+                    z2[s] = c.minusB0 * x - c.a2 * y;
+                    x = y;
+                }
+
+                // whichever moves less towards the new power is the right one:
+                // the attack when rising, the release when falling
+                auto difference = x * x - envelope;
+                envelope = Vec::max (envelope + follower.attack * difference, envelope + follower.release * difference);
+            }
+
+            for (int s = 0; s < numStages; ++s)
+            {
+                groupStages[s].z1 = z1[s];
+                groupStages[s].z2 = z2[s];
+            }
+
+            follower.envelope = envelope;
+        }
+
+        updateLevels();
+    }
+
+    //==============================================================================
+    int getNumBands() const noexcept                        { return numBands; }
+
+    /** Band levels in dB, between SpectrumAnalyser::mindB and maxdB. */
+    const std::vector<float>& getLevels() const noexcept    { return levels; }
+
+private:
+    //==============================================================================
+    using Vec = juce::dsp::SIMDRegister<float>;
+    static constexpr size_t lanes = Vec::SIMDNumElements;
+    static constexpr int numStages = 2;
+
+    struct Stage
+    {
+        Vec b0, minusB0, a1, a2, z1, z2;
+    };
+
+    struct Follower
+    {
+        Vec attack, release, envelope;
+    };
+
+    void designBand (int band, const std::vector<float>& frequencies)
+    {
+        auto f = (double) frequencies[(size_t) band];
+        auto group = band / (int) lanes;
+        auto lane = (size_t) (band % (int) lanes);
+
+        // reaching halfway (geometrically) to the neighbouring bands; each stage is
+        // wider than that so the two together are 3 dB down at the edges
+        auto below = band > 0 ? (double) frequencies[(size_t) (band - 1)] : f * f / (double) frequencies[(size_t) juce::jmin (1, numBands - 1)];
+        auto above = band + 1 < numBands ? (double) frequencies[(size_t) (band + 1)] : f * f / below;
+        auto octaves = juce::jmax (0.01, std::log2 (above / below) / 2.0);
+        auto q = std::sqrt (std::pow (2.0, octaves)) / (std::pow (2.0, octaves) - 1.0) * 0.6436;
+
+        double b0 = 0.0, a1 = 0.0, a2 = 0.0;
+
+        // bands too close to Nyquist to design stay silent
+        if (f < sampleRate * 0.49)
+        {
+            auto w0 = juce::MathConstants<double>::twoPi * f / sampleRate;
+            auto alpha = std::sin (w0) / (2.0 * q);
+            auto a0 = 1.0 + alpha;
+
+            b0 = alpha / a0;
+            a1 = -2.0 * std::cos (w0) / a0;
+            a2 = (1.0 - alpha) / a0;
+        }
+
+        for (int s = 0; s < numStages; ++s)
+        {
+            auto& stage = stages[(size_t) (group * numStages + s)];
+            stage.b0.set (lane, (float) b0);
+            stage.minusB0.set (lane, (float) -b0);
+            stage.a1.set (lane, (float) a1);
+            stage.a2.set (lane, (float) a2);
+        }
+
+        // a couple of periods to rise, longer to fall, but never slower than the display needs
+        auto attackSeconds = juce::jmax ((double) minAttackSeconds, 1.5 / f);
+        auto releaseSeconds = juce::jmax ((double) minReleaseSeconds, 4.0 / f);
+
+        auto& follower = followers[(size_t) group];
+        follower.attack.set (lane, (float) (1.0 - std::exp (-1.0 / (attackSeconds * sampleRate))));
+        follower.release.set (lane, (float) (1.0 - std::exp (-1.0 / (releaseSeconds * sampleRate))));
+    }
+
+    void updateLevels() noexcept
+    {
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto power = followers[(size_t) (b / (int) lanes)].envelope.get ((size_t) (b % (int) lanes));
+
+            levels[(size_t) b] = juce::jlimit (SpectrumAnalyser::mindB, SpectrumAnalyser::maxdB,
+                                               10.0f * std::log10 (juce::jmax (power * calibration, 1.0e-12f)));
+        }
+    }
+
+    //==============================================================================
+    static constexpr double minAttackSeconds = 0.001;
+    static constexpr double minReleaseSeconds = 0.03;
+
+    // a full-scale sine's mean power is 1/2 and SpectrumAnalyser (with its normalised Hann) reads
+    // it as 1/4 (-6 dB); the fast attack rides the ripple at twice the centre frequency, reading about 1.7 dB high
+    static constexpr float calibration = 0.5f * 0.68f;
+
+    double sampleRate = 44100.0;
+    int numBands = 0, numGroups = 0;
+    std::vector<Stage> stages;
+    std::vector<Follower> followers;
+    std::vector<float> levels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FilterbankAnalyser)
+};
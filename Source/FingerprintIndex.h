@@ -0,0 +1,266 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Fingerprinter.h"
+
+//==============================================================================
+/**
+    A hash index of reference landmarks, for recognising known content.
+
+    The entries are kept sorted by hash, with a directory of where each run of
+    hashes sharing their top directoryBits bits starts, so a lookup is one
+    directory read plus a binary search over a few hundred entries. Matching a
+    query counts, for every reference, how many of its landmarks agree on the
+    same time offset; the reference with the most agreeing landmarks wins.
+
+    An index is either built in memory (addReference(), then finalise()) or
+    loaded from a file written by save(). A loaded index can be memory-mapped,
+    so opening one with tens of thousands of references costs next to nothing
+    and only the pages a lookup touches are ever read.
+
+    Lookups are const and safe from any number of threads.
+*/
+class FingerprintIndex
+{
+public:
+    struct Entry
+    {
+        juce::uint32 hash, reference, time;
+    };
+
+    struct Match
+    {
+        int reference = -1;
+        juce::String name;
+        int votes = 0;
+        double offsetSeconds = 0.0;     // position in the reference minus position in the query
+    };
+
+    FingerprintIndex() = default;
+
+    //==============================================================================
+    /** Adds a reference's landmarks; returns its index. Call finalise() once they're all added. */
+    int addReference (const juce::String& name, const std::vector<Landmark>& landmarks)
+    {
+        jassert (mappedFile == nullptr && loadedData.getSize() == 0);
+
+        auto reference = (juce::uint32) names.size();
+        names.add (name);
+
+        for (auto& l : landmarks)
+            ownedEntries.push_back ({ l.hash, reference, l.time });
+
+        return (int) reference;
+    }
+
+    /** Sorts the entries and builds the directory, after which the index can be searched or saved. */
+    void finalise()
+    {
+        std::sort (ownedEntries.begin(), ownedEntries.end(), [] (const Entry& a, const Entry& b)
+        {
+            return a.hash != b.hash ? a.hash < b.hash
+                 : a.reference != b.reference ? a.reference < b.reference
+                 : a.time < b.time;
+        });
+
+        ownedDirectory.assign ((size_t) directorySize + 1, 0);
+
+        for (auto& e : ownedEntries)
+            ++ownedDirectory[(size_t) bucketOf (e.hash) + 1];
+
+        for (size_t i = 1; i < ownedDirectory.size(); ++i)
+            ownedDirectory[i] += ownedDirectory[i - 1];
+
+        entries = ownedEntries.data();
+        directory = ownedDirectory.data();
+        numEntries = ownedEntries.size();
+    }
+
+    int getNumReferences() const noexcept                       { return names.size(); }
+    size_t getNumEntries() const noexcept                       { return numEntries; }
+    const juce::String& getReferenceName (int i) const noexcept { return names[i]; }
+
+    //==============================================================================
+    /** Finds the reference that best explains a query; the match's reference is -1 if none got minVotes. */
+    Match find (const std::vector<Landmark>& query, int minVotes = defaultMinVotes) const
+    {
+        if (directory == nullptr)
+            return {};
+
+        std::unordered_map<juce::uint64, int> votes;
+        votes.reserve (query.size() * 4);
+
+        juce::uint64 bestKey = 0;
+        int bestVotes = 0;
+
+        for (auto& q : query)
+        {
+            auto bucket = bucketOf (q.hash);
+            auto* first = entries + directory[bucket];
+            auto* last  = entries + directory[bucket + 1];
+
+            auto range = std::equal_range (first, last, Entry { q.hash, 0, 0 },
+                                           [] (const Entry& a, const Entry& b) { return a.hash < b.hash; });
+
+            // hashes that half the references share say nothing about which one this is
+            if (range.second - range.first > maxPostingsPerHash)
+                continue;
+
+            for (auto* e = range.first; e != range.second; ++e)
+            {
+                auto offset = (juce::int32) (e->time - q.time);
+                auto key = ((juce::uint64) e->reference << 32) | (juce::uint32) offset;
+                auto count = ++votes[key];
+
+                if (count > bestVotes)
+                {
+                    bestVotes = count;
+                    bestKey = key;
+                }
+            }
+        }
+
+        Match match;
+
+        if (bestVotes >= minVotes)
+        {
+            match.reference = (int) (bestKey >> 32);
+            match.name = names[match.reference];
+            match.votes = bestVotes;
+            match.offsetSeconds = Fingerprinter::framesToSeconds ((double) (juce::int32) (juce::uint32) bestKey);
+        }
+
+        return match;
+    }
+
+    //==============================================================================
+    /** Writes the index in native (little-endian) byte order. */
+    bool save (const juce::File& file) const
+    {
+        file.deleteFile();
+        juce::FileOutputStream out (file);
+
+        if (out.failedToOpen())
+            return false;
+
+        out.writeInt ((int) magic);
+        out.writeInt (version);
+        out.writeInt (names.size());
+        out.writeInt (0);
+        out.writeInt64 ((juce::int64) numEntries);
+        out.write (directory, ((size_t) directorySize + 1) * sizeof (juce::uint32));
+        out.write (entries, numEntries * sizeof (Entry));
+
+        for (auto& name : names)
+            out.writeString (name);
+
+        out.flush();
+        return out.getStatus().wasOk();
+    }
+
+    /** Opens an index written by save(), either memory-mapped or read into memory. */
+    static std::unique_ptr<FingerprintIndex> load (const juce::File& file, bool memoryMap, juce::String& error)
+    {
+        if (juce::ByteOrder::isBigEndian())
+        {
+            error = "fingerprint indexes can only be read on little-endian machines";
+            return {};
+        }
+
+        std::unique_ptr<FingerprintIndex> index (new FingerprintIndex());
+        const char* data = nullptr;
+        size_t size = 0;
+
+        if (memoryMap)
+        {
+            index->mappedFile.reset (new juce::MemoryMappedFile (file, juce::MemoryMappedFile::readOnly));
+            data = static_cast<const char*> (index->mappedFile->getData());
+            size = index->mappedFile->getSize();
+        }
+        else if (file.loadFileAsData (index->loadedData))
+        {
+            data = static_cast<const char*> (index->loadedData.getData());
+            size = index->loadedData.getSize();
+        }
+
+        if (data == nullptr || ! index->parse (data, size))
+        {
+            error = "can't read a fingerprint index from " + file.getFullPathName();
+            return {};
+        }
+
+        return index;
+    }
+
+private:
+    //==============================================================================
+    bool parse (const char* data, size_t size)
+    {
+        const size_t headerSize = 24;
+        const size_t directoryBytes = ((size_t) directorySize + 1) * sizeof (juce::uint32);
+
+        if (size < headerSize + directoryBytes)
+            return false;
+
+        auto readUint32 = [data] (size_t offset) { return juce::ByteOrder::littleEndianInt (data + offset); };
+
+        if (readUint32 (0) != magic || (int) readUint32 (4) != version)
+            return false;
+
+        auto numNames = (int) readUint32 (8);
+        numEntries = (size_t) juce::ByteOrder::littleEndianInt64 (data + 16);
+
+        auto entriesEnd = headerSize + directoryBytes + numEntries * sizeof (Entry);
+
+        if (entriesEnd > size || (numNames > 0 && data[size - 1] != 0))
+            return false;
+
+        directory = reinterpret_cast<const juce::uint32*> (data + headerSize);
+        entries = reinterpret_cast<const Entry*> (data + headerSize + directoryBytes);
+
+        if (directory[directorySize] != numEntries)
+            return false;
+
+        for (auto* name = data + entriesEnd; names.size() < numNames; name += strlen (name) + 1)
+        {
+            if (name >= data + size)
+                return false;
+
+            names.add (juce::String::fromUTF8 (name));
+        }
+
+        return true;
+    }
+
+    static juce::uint32 bucketOf (juce::uint32 hash) noexcept
+    {
+        return hash >> (Fingerprinter::hashBits - directoryBits);
+    }
+
+    enum
+    {
+        directoryBits       = 16,
+        directorySize       = 1 << directoryBits,
+        maxPostingsPerHash  = 5000,
+        defaultMinVotes     = 8,
+        version             = 1
+    };
+
+    static constexpr juce::uint32 magic = 0x58495046;   // "FPIX"
+
+    juce::StringArray names;
+    std::vector<Entry> ownedEntries;
+    std::vector<juce::uint32> ownedDirectory;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    juce::MemoryBlock loadedData;
+
+    const Entry* entries = nullptr;
+    const juce::uint32* directory = nullptr;
+    size_t numEntries = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FingerprintIndex)
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "FingerprintIndex.h"
+#include "SampleHistory.h"
+
+//==============================================================================
+/**
+    Recognises indexed content in the live input.
+
+    Runs on its own thread and reads the same SampleHistory the analysis does,
+    so it costs the audio thread nothing and carries on while the display is
+    hidden or frozen. It keeps the landmarks of the last few seconds and looks
+    them up about once a second; each new match (a different reference, or the
+    same one starting over) is logged and can be picked up with popMatch().
+*/
+class FingerprintMatcher  : private juce::Thread
+{
+public:
+    FingerprintMatcher (const SampleHistory& historyToRead, const FingerprintIndex& indexToUse)
+        : juce::Thread ("Fingerprint matcher"),
+          history (historyToRead),
+          index (indexToUse)
+    {
+    }
+
+    ~FingerprintMatcher() override
+    {
+        stopMatching();
+    }
+
+    /** Restarts from the current input position at a new sample rate. */
+    void prepare (double sampleRate)
+    {
+        const juce::ScopedLock sl (lock);
+
+        fingerprinter.prepare (sampleRate);
+        readPosition = history.getWritePosition();
+        window.clear();
+        framesAtLastQuery = 0;
+    }
+
+    void startMatching()    { startThread(); }
+    void stopMatching()     { stopThread (2000); }
+
+    /** Returns true with the most recent match if there has been one since the last call. */
+    bool popMatch (FingerprintIndex::Match& match)
+    {
+        const juce::SpinLock::ScopedLockType sl (matchLock);
+
+        if (! newMatch)
+            return false;
+
+        match = lastMatch;
+        newMatch = false;
+        return true;
+    }
+
+private:
+    //==============================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (pollIntervalMs);
+            consumeNewSamples();
+        }
+    }
+
+    void consumeNewSamples()
+    {
+        const juce::ScopedLock sl (lock);
+
+        auto writePosition = history.getWritePosition();
+
+        // fell so far behind that the ring has been overwritten: start afresh from now
+        if (writePosition - readPosition > SampleHistory::capacity / 2)
+        {
+            fingerprinter.reset();
+            window.clear();
+            framesAtLastQuery = 0;
+            readPosition = writePosition;
+        }
+
+        while (readPosition < writePosition)
+        {
+            auto numSamples = (int) juce::jmin ((juce::int64) blockSize, writePosition - readPosition);
+            block.resize ((size_t) numSamples);
+            history.read (0, readPosition + numSamples, block.data(), numSamples);
+            readPosition += numSamples;
+
+            fingerprinter.process (block.data(), numSamples, window);
+        }
+
+        auto frames = fingerprinter.getNumFrames();
+        auto windowFrames = (juce::uint32) (windowSeconds / Fingerprinter::framesToSeconds (1.0));
+
+        if (frames > windowFrames)
+        {
+            auto oldest = frames - windowFrames;
+            window.erase (window.begin(), std::find_if (window.begin(), window.end(),
+                                                        [oldest] (const Landmark& l) { return l.time >= oldest; }));
+        }
+
+        if (Fingerprinter::framesToSeconds (frames - framesAtLastQuery) >= queryIntervalSeconds)
+        {
+            framesAtLastQuery = frames;
+            query();
+        }
+    }
+
+    void query()
+    {
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        auto match = index.find (window);
+
+        if (match.reference < 0)
+            return;
+
+        // the same reference at the same offset is the same airing still playing
+        if (match.reference == lastMatch.reference && std::abs (match.offsetSeconds - lastMatch.offsetSeconds) < 1.0)
+            return;
+
+        std::cout << "recognised \"" << match.name << "\" (" << match.votes << " landmarks, lookup "
+                  << juce::String (juce::Time::getMillisecondCounterHiRes() - start, 1) << " ms)" << std::endl;
+
+        const juce::SpinLock::ScopedLockType sl (matchLock);
+        lastMatch = match;
+        newMatch = true;
+    }
+
+    //==============================================================================
+    enum { blockSize = 8192, pollIntervalMs = 250 };
+
+    static constexpr double windowSeconds = 8.0;
+    static constexpr double queryIntervalSeconds = 1.0;
+
+    const SampleHistory& history;
+    const FingerprintIndex& index;
+
+    juce::CriticalSection lock;
+    Fingerprinter fingerprinter;
+    juce::int64 readPosition = 0;
+    std::vector<float> block;
+    std::vector<Landmark> window;
+    juce::uint32 framesAtLastQuery = 0;
+
+    juce::SpinLock matchLock;
+    FingerprintIndex::Match lastMatch;
+    bool newMatch = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FingerprintMatcher)
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/** A hashed pair of spectral peaks, and the frame its anchor peak was found in. */
+struct Landmark
+{
+    juce::uint32 hash;
+    juce::uint32 time;
+};
+
+//==============================================================================
+/**
+    Turns a stream of samples into landmark hashes.
+
+    The input is low-passed and resampled to 8 kHz, so references and live
+    feeds hash the same whatever rate they were captured at. Each STFT frame's
+    log magnitudes are searched for constellation peaks: bins that are the
+    loudest within +/- peakBinRadius bins and +/- peakFrameRadius frames, and
+    stand out from the frame's mean. Every peak is then paired with the first
+    few peaks in a target zone just after it, and each pair is hashed from
+    both frequencies and the time between them.
+
+    Works incrementally, so the same object fingerprints a whole file in one
+    go or a live feed a block at a time. Not thread-safe.
+*/
+class Fingerprinter
+{
+public:
+    enum
+    {
+        fftOrder        = 10,
+        fftSize         = 1 << fftOrder,
+        hopSize         = 256,              // 32 ms at 8 kHz
+        numBins         = fftSize / 2,
+        minBin          = 2,
+
+        peakBinRadius   = 10,
+        peakFrameRadius = 4,
+        maxPeaksPerFrame = 3,
+
+        minPairFrames   = 1,
+        maxPairFrames   = 32,               // hashes carry dt in 5 bits
+        maxPairBins     = 64,
+        fanOut          = 4,
+
+        hashBits        = 23                // 9 bits per frequency, 5 for the time between them
+    };
+
+    static constexpr double targetSampleRate = 8000.0;
+
+    Fingerprinter()
+    {
+        analyser.prepare (fftOrder, targetSampleRate);
+        reset();
+    }
+
+    /** Sets the rate of the incoming samples; also resets. */
+    void prepare (double newSourceSampleRate)
+    {
+        sourceSampleRate = newSourceSampleRate;
+
+        // fourth-order Butterworth just under the new Nyquist frequency
+        auto cutoff = juce::jmin (3600.0, 0.45 * sourceSampleRate);
+        lowPass[0].setCoefficients (juce::IIRCoefficients::makeLowPass (sourceSampleRate, cutoff, 0.5412));
+        lowPass[1].setCoefficients (juce::IIRCoefficients::makeLowPass (sourceSampleRate, cutoff, 1.3066));
+
+        reset();
+    }
+
+    void reset()
+    {
+        for (auto& f : lowPass)
+            f.reset();
+
+        resampler.reset();
+        filtered.clear();
+        pending.clear();
+        peaks.clear();
+
+        for (auto& slot : ring)
+        {
+            slot.logMagnitudes.assign ((size_t) numBins, (float) quietLog);
+            slot.neighbourhoodMax.assign ((size_t) numBins, (float) quietLog);
+        }
+
+        numFrames = 0;
+    }
+
+    /** Frames analysed since the last reset, at hopSize / targetSampleRate seconds each. */
+    juce::uint32 getNumFrames() const noexcept      { return numFrames; }
+
+    static double framesToSeconds (double frames) noexcept     { return frames * hopSize / targetSampleRate; }
+
+    //==============================================================================
+    /** Fingerprints more samples, appending any landmarks that are now complete. */
+    void process (const float* samples, int numSamples, std::vector<Landmark>& landmarks)
+    {
+        auto offset = filtered.size();
+        filtered.insert (filtered.end(), samples, samples + numSamples);
+
+        for (auto& f : lowPass)
+            f.processSamples (filtered.data() + offset, numSamples);
+
+        // the interpolator keeps its own fractional position, so only ask for what the input surely covers
+        auto ratio = sourceSampleRate / targetSampleRate;
+        auto numOut = (int) ((double) filtered.size() / ratio) - 2;
+
+        if (numOut > 0)
+        {
+            auto start = pending.size();
+            pending.resize (start + (size_t) numOut);
+            auto used = resampler.process (ratio, filtered.data(), pending.data() + start, numOut);
+            filtered.erase (filtered.begin(), filtered.begin() + used);
+        }
+
+        size_t position = 0;
+
+        for (; pending.size() - position >= (size_t) fftSize; position += (size_t) hopSize)
+            analyseFrame (pending.data() + position, landmarks);
+
+        pending.erase (pending.begin(), pending.begin() + (std::ptrdiff_t) position);
+    }
+
+    /** At the end of a stream, pairs up the peaks still waiting for their target zone. */
+    void flush (std::vector<Landmark>& landmarks)
+    {
+        while (! peaks.empty())
+            pairOldestAnchor (landmarks);
+    }
+
+private:
+    //==============================================================================
+    struct Peak
+    {
+        juce::uint32 frame;
+        int bin;
+    };
+
+    struct Frame
+    {
+        std::vector<float> logMagnitudes, neighbourhoodMax;
+        float threshold = 0.0f;
+    };
+
+    void analyseFrame (const float* samples, std::vector<Landmark>& landmarks)
+    {
+        analyser.process (samples);
+        auto* magnitudes = analyser.getMagnitudes();
+
+        auto& slot = ring[numFrames % ringSize];
+        double sum = 0.0;
+
+        for (int b = 0; b < numBins; ++b)
+        {
+            slot.logMagnitudes[(size_t) b] = std::log (magnitudes[b] + 1.0e-6f);
+
+            if (b >= minBin)
+                sum += slot.logMagnitudes[(size_t) b];
+        }
+
+        slot.threshold = juce::jmax ((float) (sum / (numBins - minBin)) + peakMarginLog, absoluteFloorLog);
+
+        for (int b = 0; b < numBins; ++b)
+        {
+            auto lo = juce::jmax (0, b - peakBinRadius), hi = juce::jmin (numBins - 1, b + peakBinRadius);
+            slot.neighbourhoodMax[(size_t) b] = *std::max_element (slot.logMagnitudes.begin() + lo, slot.logMagnitudes.begin() + hi + 1);
+        }
+
+        ++numFrames;
+
+        // the frame in the middle of the ring now has all its neighbours
+        if (numFrames > (juce::uint32) peakFrameRadius)
+            findPeaks (numFrames - 1 - (juce::uint32) peakFrameRadius);
+
+        while (! peaks.empty() && peaks.front().frame + (juce::uint32) (maxPairFrames + peakFrameRadius) < numFrames)
+            pairOldestAnchor (landmarks);
+    }
+
+    void findPeaks (juce::uint32 frame)
+    {
+        auto& centre = ring[frame % ringSize];
+        candidates.clear();
+
+        for (int b = minBin; b < numBins; ++b)
+        {
+            auto value = centre.logMagnitudes[(size_t) b];
+
+            if (value < centre.threshold || value < centre.neighbourhoodMax[(size_t) b])
+                continue;
+
+            bool isMax = true;
+
+            for (auto& other : ring)
+                isMax = isMax && value >= other.neighbourhoodMax[(size_t) b];
+
+            if (isMax)
+                candidates.push_back ({ value, b });
+        }
+
+        auto numKept = juce::jmin ((int) candidates.size(), (int) maxPeaksPerFrame);
+        std::partial_sort (candidates.begin(), candidates.begin() + numKept, candidates.end(),
+                           [] (const Candidate& a, const Candidate& b) { return a.value > b.value; });
+
+        for (int i = 0; i < numKept; ++i)
+            peaks.push_back ({ frame, candidates[(size_t) i].bin });
+    }
+
+    void pairOldestAnchor (std::vector<Landmark>& landmarks)
+    {
+        auto anchor = peaks.front();
+        peaks.pop_front();
+        int paired = 0;
+
+        for (auto& target : peaks)
+        {
+            auto dt = (int) (target.frame - anchor.frame);
+
+            if (dt > maxPairFrames || paired >= fanOut)
+                break;
+
+            if (dt >= minPairFrames && std::abs (target.bin - anchor.bin) <= maxPairBins)
+            {
+                landmarks.push_back ({ makeHash (anchor.bin, target.bin, dt), anchor.frame });
+                ++paired;
+            }
+        }
+    }
+
+    static juce::uint32 makeHash (int anchorBin, int targetBin, int dt) noexcept
+    {
+        return ((juce::uint32) anchorBin << 14) | ((juce::uint32) targetBin << 5) | (juce::uint32) (dt - 1);
+    }
+
+    //==============================================================================
+    struct Candidate
+    {
+        float value;
+        int bin;
+    };
+
+    enum { ringSize = 2 * peakFrameRadius + 1 };
+
+    static constexpr float quietLog = -100.0f;
+    static constexpr float peakMarginLog = 2.3f;        // 20 dB above the frame's mean log magnitude
+    static constexpr float absoluteFloorLog = -2.3f;    // about -80 dBFS for a full-scale sine
+
+    double sourceSampleRate = targetSampleRate;
+    juce::IIRFilter lowPass[2];
+    juce::LagrangeInterpolator resampler;
+    std::vector<float> filtered, pending;
+
+    SpectrumAnalyser analyser;
+    Frame ring[ringSize];
+    juce::uint32 numFrames = 0;
+    std::vector<Candidate> candidates;
+    std::deque<Peak> peaks;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Fingerprinter)
+};
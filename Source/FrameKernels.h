@@ -0,0 +1,126 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+#include "TemperedScale.h"
+
+//==============================================================================
+/**
+    The fixed-size stages of analysing a frame, compiled once for every FFT
+    order from minOrder to maxOrder and picked from a table when an analyser
+    is prepared.
+
+    In each instantiation the frame size is a constant, so the windowing loop
+    has a known trip count the compiler can unroll and vectorise, and the
+    full-scale reference (gainToDecibels (fftSize), i.e. 6.02 dB per order)
+    folds into a constant. Any other order gets a version that takes the
+    size at run time, so an analyser of any size still works.
+
+    Stateless; SampleType is what the frame is windowed and transformed in,
+    InputType what it arrives as.
+*/
+template <typename SampleType>
+struct FrameKernels
+{
+    enum { minOrder = 8, maxOrder = 16 };
+
+    /** Windows a frame into the first half of a buffer of 2 * fftSize and clears the second half. */
+    template <typename InputType>
+    using WindowFunction = void (*) (const InputType* frame, const SampleType* window, SampleType* fftData, int fftSize);
+
+    /** Turns the bin magnitudes of a frame into band levels in dB, clamped to [minDb, maxDb]. */
+    using LevelsFunction = void (*) (const SampleType* magnitudes, const std::vector<Bar>& bars, float* levels,
+                                     int fftSize, float minDb, float maxDb);
+
+    template <typename InputType>
+    static WindowFunction<InputType> getWindowFunction (int order) noexcept
+    {
+        return lookUp (windowTable<InputType> (Orders()), order, &windowFrame<InputType, 0>);
+    }
+
+    static LevelsFunction getLevelsFunction (int order) noexcept
+    {
+        return lookUp (levelsTable (Orders()), order, &bandLevels<0>);
+    }
+
+private:
+    //==============================================================================
+    using Orders = std::make_integer_sequence<int, maxOrder - minOrder + 1>;
+
+    template <typename Function, size_t numOrders>
+    static Function lookUp (const std::array<Function, numOrders>& table, int order, Function fallback) noexcept
+    {
+        return juce::isPositiveAndBelow (order - minOrder, (int) numOrders) ? table[(size_t) (order - minOrder)] : fallback;
+    }
+
+    template <typename InputType, int... offsets>
+    static const std::array<WindowFunction<InputType>, sizeof... (offsets)>& windowTable (std::integer_sequence<int, offsets...>) noexcept
+    {
+        static const std::array<WindowFunction<InputType>, sizeof... (offsets)> table { { &windowFrame<InputType, minOrder + offsets>... } };
+        return table;
+    }
+
+    template <int... offsets>
+    static const std::array<LevelsFunction, sizeof... (offsets)>& levelsTable (std::integer_sequence<int, offsets...>) noexcept
+    {
+        static const std::array<LevelsFunction, sizeof... (offsets)> table { { &bandLevels<minOrder + offsets>... } };
+        return table;
+    }
+
+    //==============================================================================
+    /** order is 0 for the version that takes its size at run time. */
+    template <int order>
+    static int sizeFor (int fftSize) noexcept      { return order > 0 ? 1 << order : fftSize; }
+
+    template <typename InputType, int order>
+    static void windowFrame (const InputType* frame, const SampleType* window, SampleType* fftData, int fftSize)
+    {
+        auto size = sizeFor<order> (fftSize);
+
+        for (int i = 0; i < size; ++i)
+            fftData[i] = window[i] * (SampleType) frame[i];
+
+        std::fill (fftData + size, fftData + 2 * size, SampleType());
+    }
+
+    template <int order>
+    static void bandLevels (const SampleType* magnitudes, const std::vector<Bar>& bars, float* levels,
+                            int fftSize, float minDb, float maxDb)
+    {
+        // a full-scale bin reads 0 dB
+        auto referenceDb = order > 0 ? (float) order * 6.0206f : juce::Decibels::gainToDecibels ((float) fftSize);
+
+        auto toDb = [=] (SampleType magnitude)
+        {
+            return juce::jlimit (minDb, maxDb, (float) juce::Decibels::gainToDecibels (magnitude, (SampleType) -400) - referenceDb);
+        };
+
+        for (size_t i = 0; i < bars.size(); ++i)
+        {
+            auto& bar = bars[i];
+
+            if (bar.endIdx == 0)
+            {
+                auto level = toDb (magnitudes[bar.dataIdx]);
+
+                // several bars share this bin: interpolate with the one below
+                if (bar.factor > 0.0f && bar.dataIdx > 0)
+                {
+                    auto prevLevel = toDb (magnitudes[bar.dataIdx - 1]);
+                    level = prevLevel + (level - prevLevel) * bar.factor;
+                }
+
+                levels[i] = level;
+            }
+            else
+            {
+                // the loudest bin in the band wins; dB is monotonic, so it's converted once
+                auto loudest = *std::max_element (magnitudes + bar.dataIdx, magnitudes + bar.endIdx + 1);
+                levels[i] = toDb (loudest);
+            }
+        }
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+/** One analysed frame, as handed to everything that consumes the analysis. */
+struct AnalysisFrame
+{
+    juce::int64 position = 0;       // the input sample position the frame ends at
+    double seconds = 0.0;           // how much input it accounts for
+    double analysedAt = 0.0;        // Time::getMillisecondCounterHiRes() when it was produced
+    std::vector<float> magnitudes;  // bin magnitudes from the FFT analyser; empty for the others
+    std::vector<float> levels;      // band levels in dB
+    std::vector<float> channelLevels;   // with per-channel analysis, each input channel's band levels in turn; empty otherwise
+
+private:
+    friend class FramePool;
+    friend class FrameView;
+
+    struct Block;
+
+    std::atomic<int> refCount { 0 };
+    Block* block = nullptr;
+};
+
+//==============================================================================
+/** One prepare()'s worth of frames, kept alive by the pool and by every frame that's in use. */
+struct AnalysisFrame::Block
+{
+    Block (int numFrames, int numMagnitudes, int numLevels, int numChannelLevels)
+        : frames ((size_t) numFrames)
+    {
+        for (auto& frame : frames)
+        {
+            frame.magnitudes.assign ((size_t) juce::jmax (0, numMagnitudes), 0.0f);
+            frame.levels.assign ((size_t) juce::jmax (0, numLevels), 0.0f);
+            frame.channelLevels.assign ((size_t) juce::jmax (0, numChannelLevels), 0.0f);
+            frame.block = this;
+        }
+    }
+
+    void retain() noexcept      { users.fetch_add (1, std::memory_order_relaxed); }
+
+    void release() noexcept
+    {
+        if (users.fetch_sub (1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    std::vector<AnalysisFrame> frames;
+    std::atomic<int> users { 1 };   // the pool's own reference
+};
+
+//==============================================================================
+/**
+    A shared, read-only reference to a frame from a FramePool.
+
+    Copying one only bumps the frame's count, so any number of consumers can
+    hold the same frame without copying its data; it goes back to the pool
+    when the last reference is dropped, on whichever thread that happens.
+*/
+class FrameView
+{
+public:
+    FrameView() = default;
+    FrameView (const FrameView& other) noexcept : frame (other.frame)    { retain(); }
+    FrameView (FrameView&& other) noexcept : frame (other.frame)         { other.frame = nullptr; }
+    ~FrameView()                                                        { release(); }
+
+    FrameView& operator= (const FrameView& other) noexcept
+    {
+        FrameView (other).swapWith (*this);
+        return *this;
+    }
+
+    FrameView& operator= (FrameView&& other) noexcept
+    {
+        FrameView (std::move (other)).swapWith (*this);
+        return *this;
+    }
+
+    void swapWith (FrameView& other) noexcept               { std::swap (frame, other.frame); }
+    void reset() noexcept                                   { FrameView().swapWith (*this); }
+
+    explicit operator bool() const noexcept                 { return frame != nullptr; }
+    const AnalysisFrame* get() const noexcept               { return frame; }
+    const AnalysisFrame* operator->() const noexcept        { return frame; }
+    const AnalysisFrame& operator*() const noexcept         { return *frame; }
+
+private:
+    friend class FramePool;
+    friend class FrameSubscription;
+
+    /** Takes over a reference that has already been counted. */
+    explicit FrameView (AnalysisFrame* f) noexcept : frame (f) {}
+
+    /** Gives up the reference without dropping it, for whoever adopts the pointer. */
+    AnalysisFrame* detach() noexcept
+    {
+        auto* f = frame;
+        frame = nullptr;
+        return f;
+    }
+
+    inline void retain() noexcept;
+    inline void release() noexcept;
+
+    AnalysisFrame* frame = nullptr;
+};
+
+//==============================================================================
+/**
+    A fixed set of preallocated AnalysisFrames, so the analysis thread can
+    hand every frame it produces to several consumers without allocating or
+    copying.
+
+    The producer takes a free frame with acquire(), fills it in through
+    getWritableFrame() while it's the only holder, then passes FrameViews
+    around. A frame is free again once its count drops to zero. If every
+    frame is still held when a new one is wanted, acquire() returns nothing
+    and the frame is counted as dropped: a consumer holding on too long loses
+    frames rather than making the producer wait or allocate.
+
+    prepare() replaces the frames for a new size; frames from before it stay
+    valid until their last view is gone, and are freed with it.
+*/
+class FramePool
+{
+public:
+    FramePool() = default;
+
+    ~FramePool()
+    {
+        if (block != nullptr)
+            block->release();
+    }
+
+    /** Allocates numFrames frames of the given sizes; not to be called at the same time as acquire(). */
+    void prepare (int numMagnitudes, int numLevels, int numChannelLevels = 0, int numFrames = defaultNumFrames)
+    {
+        auto* old = block;
+        block = new AnalysisFrame::Block (juce::jmax (1, numFrames), numMagnitudes, numLevels, numChannelLevels);
+
+        if (old != nullptr)
+            old->release();
+    }
+
+    /** Takes a free frame for the caller to fill in, or returns nothing (and counts a drop) if none is free. Producer only. */
+    FrameView acquire() noexcept
+    {
+        jassert (block != nullptr);
+
+        for (auto& frame : block->frames)
+        {
+            int expected = 0;
+
+            if (frame.refCount.compare_exchange_strong (expected, 1, std::memory_order_acquire))
+            {
+                block->retain();
+                return FrameView (&frame);
+            }
+        }
+
+        ++numDropped;
+        return {};
+    }
+
+    /** The frame behind a view that nobody else holds yet, for the producer to fill in. */
+    static AnalysisFrame& getWritableFrame (FrameView& view) noexcept
+    {
+        jassert (view.frame != nullptr && view.frame->refCount.load() == 1);
+        return *view.frame;
+    }
+
+    /** How many frames acquire() couldn't provide since the pool was created. */
+    int getNumDropped() const noexcept      { return numDropped.load(); }
+
+    /** How many of the current frames are held somewhere. */
+    int getNumInUse() const noexcept
+    {
+        if (block == nullptr)
+            return 0;
+
+        return (int) std::count_if (block->frames.begin(), block->frames.end(),
+                                    [] (const AnalysisFrame& frame) { return frame.refCount.load() > 0; });
+    }
+
+    int getNumFrames() const noexcept       { return block != nullptr ? (int) block->frames.size() : 0; }
+
+    enum { defaultNumFrames = 16 };
+
+private:
+    AnalysisFrame::Block* block = nullptr;
+    std::atomic<int> numDropped { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FramePool)
+};
+
+inline void FrameView::retain() noexcept
+{
+    if (frame != nullptr)
+        frame->refCount.fetch_add (1, std::memory_order_relaxed);
+}
+
+inline void FrameView::release() noexcept
+{
+    if (frame == nullptr)
+        return;
+
+    // the block can't go while this frame still counts as one of its users
+    auto* block = frame->block;
+
+    if (frame->refCount.fetch_sub (1, std::memory_order_acq_rel) == 1)
+        block->release();
+
+    frame = nullptr;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include "FramePool.h"
+
+//==============================================================================
+/**
+    One consumer's queue of the frames the analysis publishes, with its own
+    policy for what to do when the consumer is slower than the analysis.
+
+    - latestOnly keeps only the newest frame: a consumer that looks less often
+      than frames arrive (e.g. the display) sees the most recent one, and the
+      ones it missed are counted as dropped.
+    - dropOldest keeps up to queueSize frames in order; when it's full the
+      oldest unread frame makes way for the new one.
+    - decimate passes on only every decimation-th frame, latest-only.
+
+    offer() and pop() are lock-free and never wait, so one slow consumer
+    can't hold up the analysis or the others. There's one producer and one
+    consumer per subscription. Frames are shared FrameViews, so queued frames
+    count against the FramePool: a long queue that's never read will make the
+    pool drop frames for everybody, which is what the counters are for. A
+    consumer that will stop reading for a while (e.g. a hidden display) can
+    pause its subscription instead, which lets go of what's queued and isn't
+    offered anything until it's resumed.
+*/
+class FrameSubscription
+{
+public:
+    enum class Policy { latestOnly, dropOldest, decimate };
+
+    struct Settings
+    {
+        Policy policy = Policy::latestOnly;
+        int queueSize = 1;
+        int decimation = 1;
+
+        static Settings latestOnly() noexcept                   { return {}; }
+        static Settings dropOldest (int queueSize) noexcept     { return { Policy::dropOldest, juce::jmax (1, queueSize), 1 }; }
+        static Settings decimate (int everyNth) noexcept        { return { Policy::decimate, 1, juce::jmax (1, everyNth) }; }
+    };
+
+    struct Counters
+    {
+        juce::int64 offered = 0;        // frames published while subscribed
+        juce::int64 delivered = 0;      // frames the consumer popped
+        juce::int64 dropped = 0;        // replaced before they were read, or overtaken by a newer one
+        juce::int64 decimated = 0;      // skipped by design
+    };
+
+    explicit FrameSubscription (const Settings& settingsToUse)
+        : settings (settingsToUse),
+          capacity (settings.policy == Policy::dropOldest ? juce::jmax (1, settings.queueSize) : 1),
+          slots (new std::atomic<AnalysisFrame*>[(size_t) capacity])
+    {
+        for (int i = 0; i < capacity; ++i)
+            slots[(size_t) i] = nullptr;
+    }
+
+    ~FrameSubscription()
+    {
+        // hand back whatever was never read
+        for (int i = 0; i < capacity; ++i)
+            FrameView unread (slots[(size_t) i].exchange (nullptr));
+    }
+
+    const Settings& getSettings() const noexcept    { return settings; }
+
+    /** Stops or restarts taking frames; called by the consumer. Pausing hands back any frames still queued. */
+    void setPaused (bool shouldBePaused) noexcept
+    {
+        if (paused.exchange (shouldBePaused, std::memory_order_acq_rel) == shouldBePaused || ! shouldBePaused)
+            return;
+
+        for (int i = 0; i < capacity; ++i)
+        {
+            FrameView unread (slots[(size_t) i].exchange (nullptr, std::memory_order_acq_rel));
+
+            if (unread)
+                dropped.fetch_add (1, std::memory_order_relaxed);
+        }
+
+        readIndex = writeIndex.load (std::memory_order_acquire);
+    }
+
+    bool isPaused() const noexcept                  { return paused.load (std::memory_order_relaxed); }
+
+    //==============================================================================
+    /** Queues a frame according to the policy; called by the producer. */
+    void offer (const FrameView& frame) noexcept
+    {
+        if (! frame || paused.load (std::memory_order_acquire))
+            return;
+
+        offered.fetch_add (1, std::memory_order_relaxed);
+
+        if (++sinceLastQueued < settings.decimation)
+        {
+            decimated.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+
+        sinceLastQueued = 0;
+
+        auto index = writeIndex.load (std::memory_order_relaxed);
+        FrameView shared (frame);
+        FrameView replaced (slots[(size_t) (index % capacity)].exchange (shared.detach(), std::memory_order_acq_rel));
+        writeIndex.store (index + 1, std::memory_order_release);
+
+        if (replaced)
+            dropped.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    /** Takes the next frame, oldest first; returns false if there's nothing new. Called by the consumer. */
+    bool pop (FrameView& dest) noexcept
+    {
+        auto written = writeIndex.load (std::memory_order_acquire);
+
+        // the slots before these have been written over since
+        if (written - readIndex > capacity)
+            readIndex = written - capacity;
+
+        while (readIndex < written)
+        {
+            FrameView frame (slots[(size_t) (readIndex % capacity)].exchange (nullptr, std::memory_order_acq_rel));
+            ++readIndex;
+
+            if (! frame)
+                continue;
+
+            // a slot overwritten while it was being caught up with can hand over a newer frame early
+            if (frame->position <= lastPosition)
+            {
+                dropped.fetch_add (1, std::memory_order_relaxed);
+                continue;
+            }
+
+            lastPosition = frame->position;
+            delivered.fetch_add (1, std::memory_order_relaxed);
+            dest = std::move (frame);
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Pops everything queued and keeps only the newest; returns false if there was nothing. */
+    bool popLatest (FrameView& dest) noexcept
+    {
+        bool any = false;
+
+        while (pop (dest))
+            any = true;
+
+        return any;
+    }
+
+    Counters getCounters() const noexcept
+    {
+        Counters c;
+        c.offered = offered.load (std::memory_order_relaxed);
+        c.delivered = delivered.load (std::memory_order_relaxed);
+        c.dropped = dropped.load (std::memory_order_relaxed);
+        c.decimated = decimated.load (std::memory_order_relaxed);
+        return c;
+    }
+
+private:
+    //==============================================================================
+    const Settings settings;
+    const int capacity;
+    std::unique_ptr<std::atomic<AnalysisFrame*>[]> slots;
+
+    std::atomic<juce::int64> writeIndex { 0 };
+    std::atomic<bool> paused { false };
+    int sinceLastQueued = 0;                    // producer only
+    juce::int64 readIndex = 0, lastPosition = -1;   // consumer only
+
+    std::atomic<juce::int64> offered { 0 }, delivered { 0 }, dropped { 0 }, decimated { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FrameSubscription)
+};
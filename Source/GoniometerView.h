@@ -0,0 +1,228 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cmath>
+#include <vector>
+#include "SampleHistory.h"
+#include "StereoCorrelation.h"
+
+//==============================================================================
+/**
+    A goniometer (vectorscope) of the two input channels, next to a meter of
+    their phase correlation in each band.
+
+    Each sample pair is plotted with mid (L + R) up and side (R - L) across,
+    so a mono signal is a vertical line, a wide one a cloud and an
+    out-of-phase one a horizontal line. Rather than drawing thousands of
+    points every frame, the samples that arrived since the last refresh are
+    added into an intensity buffer that decays by a constant factor per
+    second (a single vectorised multiply), and that buffer is drawn as one
+    image.
+
+    The meter uses a StereoCorrelation on the newest frame of both channels,
+    banded like the main display; bands that would cancel in a mono downmix
+    turn red and their frequency ranges are listed.
+
+    Everything runs on the message thread, reading the SampleHistory the
+    analysis fills. The mouse wheel changes the goniometer's gain.
+*/
+class GoniometerView  : public juce::Component
+{
+public:
+    GoniometerView (const SampleHistory& historyToRead, int fftOrderToUse, int groupNotesToUse)
+        : history (historyToRead),
+          fftOrder (fftOrderToUse),
+          groupNotes (groupNotesToUse),
+          intensity ((size_t) (imageSize * imageSize), 0.0f),
+          image (juce::Image::SingleChannel, imageSize, imageSize, true)
+    {
+        setOpaque (true);
+    }
+
+    /** Safe to call from any thread; the correlation is reprepared on the next refresh. */
+    void setSampleRate (double newSampleRate) noexcept      { sampleRate = newSampleRate; }
+
+    /** Plots the input that arrived since the last call, updates the meter and repaints. */
+    void refresh()
+    {
+        auto now = juce::Time::getMillisecondCounterHiRes();
+        auto elapsedSeconds = lastRefreshMs > 0.0 ? juce::jlimit (0.001, 1.0, (now - lastRefreshMs) / 1000.0) : 0.001;
+        lastRefreshMs = now;
+
+        if (sampleRate.load() != preparedSampleRate)
+        {
+            preparedSampleRate = sampleRate.load();
+            correlation.prepare (fftOrder, preparedSampleRate, groupNotes);
+            readPosition = history.getWritePosition();
+        }
+
+        auto writePosition = history.getWritePosition();
+        auto numNew = (int) juce::jlimit ((juce::int64) 0, (juce::int64) maxPointsPerRefresh, writePosition - readPosition);
+        readPosition = writePosition;
+
+        // fade what's there, then add what's new
+        juce::FloatVectorOperations::multiply (intensity.data(), (float) std::pow (0.01, elapsedSeconds / persistenceSeconds),
+                                               (int) intensity.size());
+
+        if (numNew > 0)
+        {
+            plot (writePosition, numNew);
+            updateCorrelation (writePosition, elapsedSeconds);
+        }
+
+        renderImage();
+        repaint();
+    }
+
+    //==============================================================================
+    void paint (juce::Graphics& g) override
+    {
+        g.fillAll (juce::Colours::black);
+
+        auto bounds = getLocalBounds();
+        auto square = bounds.removeFromLeft (juce::jmin (bounds.getWidth() / 2, bounds.getHeight())).reduced (4).toFloat();
+
+        g.setColour (juce::Colours::darkgrey);
+        g.drawLine (square.getX(), square.getY(), square.getRight(), square.getBottom());
+        g.drawLine (square.getX(), square.getBottom(), square.getRight(), square.getY());
+        g.drawVerticalLine (juce::roundToInt (square.getCentreX()), square.getY(), square.getBottom());
+
+        g.setColour (juce::Colours::lightgreen);
+        g.drawImage (image, square, juce::RectanglePlacement::stretchToFit, true);
+
+        g.setColour (juce::Colours::grey);
+        g.drawText ("L", square.reduced (4).toNearestInt(), juce::Justification::topLeft);
+        g.drawText ("R", square.reduced (4).toNearestInt(), juce::Justification::topRight);
+        g.drawText (juce::String (gainDb, 0) + " dB", square.reduced (4).toNearestInt(), juce::Justification::bottomLeft);
+
+        drawCorrelation (g, bounds.reduced (4));
+    }
+
+    void mouseWheelMove (const juce::MouseEvent&, const juce::MouseWheelDetails& wheel) override
+    {
+        gainDb = juce::jlimit (0.0f, (float) maxGainDb, gainDb + (wheel.deltaY > 0.0f ? 6.0f : -6.0f));
+        repaint();
+    }
+
+private:
+    //==============================================================================
+    void plot (juce::int64 endPosition, int numSamples)
+    {
+        left.resize ((size_t) numSamples);
+        right.resize ((size_t) numSamples);
+        history.read (0, endPosition, left.data(), numSamples);
+        history.read (1, endPosition, right.data(), numSamples);
+
+        // full scale on both channels reaches the edge at 0 dB
+        auto centre = (float) (imageSize - 1) * 0.5f;
+        auto scale = centre * juce::Decibels::decibelsToGain (gainDb) * 0.5f;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto l = left[(size_t) i], r = right[(size_t) i];
+            auto x = juce::roundToInt (centre + (r - l) * scale);
+            auto y = juce::roundToInt (centre - (r + l) * scale);
+
+            if (juce::isPositiveAndBelow (x, (int) imageSize) && juce::isPositiveAndBelow (y, (int) imageSize))
+                intensity[(size_t) (y * imageSize + x)] += hitIntensity;
+        }
+    }
+
+    void updateCorrelation (juce::int64 endPosition, double elapsedSeconds)
+    {
+        auto fftSize = correlation.getFFTSize();
+        left.resize ((size_t) fftSize);
+        right.resize ((size_t) fftSize);
+        history.read (0, endPosition, left.data(), fftSize);
+        history.read (1, endPosition, right.data(), fftSize);
+
+        correlation.process (left.data(), right.data(), (float) (1.0 - std::exp (-elapsedSeconds / correlationSeconds)));
+    }
+
+    void renderImage()
+    {
+        juce::Image::BitmapData pixels (image, juce::Image::BitmapData::writeOnly);
+
+        for (int y = 0; y < imageSize; ++y)
+        {
+            auto* row = intensity.data() + y * imageSize;
+            auto* line = pixels.getLinePointer (y);
+
+            for (int x = 0; x < imageSize; ++x)
+                line[x * pixels.pixelStride] = (juce::uint8) (255.0f * juce::jmin (1.0f, row[x]));
+        }
+    }
+
+    /** One bar per band from the centre line: up for correlated, down for out of phase. */
+    void drawCorrelation (juce::Graphics& g, juce::Rectangle<int> area)
+    {
+        auto& correlations = correlation.getCorrelations();
+        auto numBands = (int) correlations.size();
+        auto text = area.removeFromTop (20);
+        auto bars = area.toFloat();
+
+        g.setColour (juce::Colours::darkgrey);
+        g.drawHorizontalLine (juce::roundToInt (bars.getCentreY()), bars.getX(), bars.getRight());
+
+        if (numBands == 0)
+            return;
+
+        auto barWidth = bars.getWidth() / (float) numBands;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto value = correlations[(size_t) b];
+            auto y = juce::jmap (value, -1.0f, 1.0f, bars.getBottom(), bars.getY());
+
+            g.setColour (! correlation.isActive (b)     ? juce::Colours::darkgrey
+                         : value < monoRiskCorrelation   ? juce::Colours::red
+                         : value < 0.5f                  ? juce::Colours::orange
+                                                         : juce::Colours::lightgreen);
+            g.fillRect (bars.getX() + (float) b * barWidth, juce::jmin (y, bars.getCentreY()),
+                        juce::jmax (1.0f, barWidth - 1.0f), juce::jmax (1.0f, std::abs (y - bars.getCentreY())));
+        }
+
+        auto overall = correlation.getOverall();
+        auto summary = "correlation " + juce::String (overall >= 0.0f ? "+" : "") + juce::String (overall, 2);
+        auto regions = correlation.findOutOfPhaseRegions (monoRiskCorrelation);
+
+        if (! regions.empty())
+        {
+            summary << "   mono risk:";
+
+            for (auto& region : regions)
+                summary << " " << formatFrequency (region.getStart()) << "-" << formatFrequency (region.getEnd());
+        }
+
+        g.setColour (regions.empty() ? juce::Colours::grey : juce::Colours::red);
+        g.drawText (summary, text, juce::Justification::topLeft);
+    }
+
+    static juce::String formatFrequency (float hz)
+    {
+        return hz < 1000.0f ? juce::String (juce::roundToInt (hz)) : juce::String (hz / 1000.0f, 1) + "k";
+    }
+
+    //==============================================================================
+    enum { imageSize = 256, maxPointsPerRefresh = 16384 };
+    static constexpr double persistenceSeconds = 0.5;      // to fade to 1%
+    static constexpr double correlationSeconds = 0.5;
+    static constexpr float hitIntensity = 0.25f;
+    static constexpr float maxGainDb = 24.0f;
+    static constexpr float monoRiskCorrelation = -0.3f; // clearly out of phase, not just unrelated
+
+    const SampleHistory& history;
+    const int fftOrder, groupNotes;
+    std::atomic<double> sampleRate { 44100.0 };
+    double preparedSampleRate = 0.0, lastRefreshMs = 0.0;
+    juce::int64 readPosition = 0;
+
+    std::vector<float> intensity, left, right;
+    juce::Image image;
+    float gainDb = 0.0f;
+
+    StereoCorrelation correlation;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GoniometerView)
+};
@@ -0,0 +1,899 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+#include "AnalysisEngine.h"
+#include "AnalysisPipeline.h"
+#include "BatchedAnalyser.h"
+#include "FingerprintIndex.h"
+#include "OfflineAnalyser.h"
+#include "PcmFormat.h"
+#include "RtpSender.h"
+#include "SimilarityIndex.h"
+#include "SpectrumEmbedder.h"
+
+#if JUCE_WINDOWS
+ #include <fcntl.h>
+ #include <io.h>
+#endif
+
+//==============================================================================
+/**
+    Batch jobs that run instead of the GUI when their option is on the command line.
+
+    --build-fingerprint-index=index.fpi files-or-folders...
+        fingerprints every decodable file (folders are searched recursively)
+        and writes them all into one index.
+
+    --match-fingerprints=index.fpi files...
+        looks each file up in an index and prints the best match.
+
+    --build-similarity-index=index.sim files-or-folders...
+        embeds every window of every file and clusters them for similarity search.
+
+    --find-similar=index.sim snippet [--results=10] [--probes=16]
+        lists the time ranges in the archive that sound most like the snippet.
+
+    --analyse-pcm [--format=s16le|s24le|s32le|f32le] [--channels=1] [--rate=48000]
+                  [--input=stdin|path] [--emit=levels|features] [--protocol=lines|binary]
+                  [--precision=float|double] [--stages=weighting=a,calibration=0,average=1,ballistics=1:1]
+        analyses raw interleaved PCM from stdin or a named pipe and writes a
+        record per frame to stdout, e.g. ffmpeg -i x -f s16le -ac 2 - | juce-spectrum
+        --analyse-pcm --channels=2 --rate=44100. Honours --fft-order and --overlap.
+        In float it runs an AnalysisPipeline, compiled for just what's emitted;
+        --stages adds A-weighting, a calibration gain in dB, averaging over
+        frames and attack:release ballistics (the fraction of each new frame
+        taken), and the plan is printed to stderr. In double precision the
+        window and FFT run in double and levels go down to -200 dB rather than
+        -100, for measuring deep dynamic range; it has no optional stages, so
+        --stages is refused with it.
+
+        lines:  "# bands" or "# features" header, then "time value value..." per frame
+        binary: "SPEC", version, record kind (0 levels, 1 features), values per record
+                (all uint32), then for levels the band frequencies (float32); then per
+                frame a float64 time and the values as float32, all in native
+                (little-endian) byte order.
+                Features are level (dB), loudest band (Hz) and spectral centroid (Hz).
+
+    --benchmark-analysers [--rate=48000] [--seconds=10] [--channels=32]
+        runs the same noisy input through the FFT with tempered-scale banding
+        (in float and in double), the wavelet transform (--analyser=cwt) and
+        the filterbank, and prints for each the time per hop, the worst level
+        error for a sine at a band centre and the worst leakage three or more
+        bands away from it. Then times that many channels analysed one by one
+        against the BatchedAnalyser that --per-channel uses, and prints how
+        far apart their levels are. Honours --fft-order and --overlap.
+
+    --send-rtp=file --rtp-port=5004 [--host=127.0.0.1] [--packet-ms=1]
+               [--loss=0] [--jitter-ms=0] [--drift-ppm=0]
+        streams a file as RTP in real time, optionally dropping, delaying and
+        reordering packets and running the clock off, to test a receiver.
+
+    --receive-rtp --rtp-port=5004 [--seconds=0]
+        receives a stream and prints its level and the jitter buffer counters
+        once a second, for that many seconds or until interrupted.
+
+    Both take --rtp-format=l16|l24, --rtp-channels and --rtp-rate (L24, 2 and
+    48000 by default); the receiver also takes --rtp-group to join a multicast
+    group. The GUI takes the same options to analyse a stream instead of the
+    audio device.
+*/
+class HeadlessCommands
+{
+public:
+    HeadlessCommands()
+    {
+        app.addCommand ({ "--build-fingerprint-index",
+                          "--build-fingerprint-index=index.fpi files-or-folders...",
+                          "Fingerprints audio files into an index for recognising them later.",
+                          {},
+                          [] (const juce::ArgumentList& args) { buildFingerprintIndex (args); } });
+
+        app.addCommand ({ "--match-fingerprints",
+                          "--match-fingerprints=index.fpi files...",
+                          "Looks audio files up in a fingerprint index.",
+                          {},
+                          [] (const juce::ArgumentList& args) { matchFingerprints (args); } });
+
+        app.addCommand ({ "--build-similarity-index",
+                          "--build-similarity-index=index.sim files-or-folders...",
+                          "Indexes an audio archive for finding passages that sound alike.",
+                          {},
+                          [] (const juce::ArgumentList& args) { buildSimilarityIndex (args); } });
+
+        app.addCommand ({ "--find-similar",
+                          "--find-similar=index.sim snippet [--results=10] [--probes=16]",
+                          "Finds the passages in an archive that sound most like a snippet.",
+                          {},
+                          [] (const juce::ArgumentList& args) { findSimilar (args); } });
+
+        app.addCommand ({ "--analyse-pcm",
+                          "--analyse-pcm [--format=s16le] [--channels=1] [--rate=48000] [--input=stdin] [--emit=levels] [--protocol=lines] [--precision=float]",
+                          "Analyses raw PCM from stdin or a pipe and writes band levels or features to stdout.",
+                          {},
+                          [] (const juce::ArgumentList& args) { analysePcm (args); } });
+
+        app.addCommand ({ "--benchmark-analysers",
+                          "--benchmark-analysers [--rate=48000] [--seconds=10] [--channels=32]",
+                          "Compares the cost and accuracy of the float and double FFT, wavelet and filterbank analysers.",
+                          {},
+                          [] (const juce::ArgumentList& args) { benchmarkAnalysers (args); } });
+
+        app.addCommand ({ "--send-rtp",
+                          "--send-rtp=file --rtp-port=5004 [--host=127.0.0.1] [--packet-ms=1] [--loss=0] [--jitter-ms=0] [--drift-ppm=0]",
+                          "Streams an audio file as RTP, optionally impaired, for testing.",
+                          {},
+                          [] (const juce::ArgumentList& args) { sendRtp (args); } });
+
+        app.addCommand ({ "--receive-rtp",
+                          "--receive-rtp --rtp-port=5004 [--seconds=0]",
+                          "Receives an RTP stream and prints its level and jitter buffer counters.",
+                          {},
+                          [] (const juce::ArgumentList& args) { receiveRtp (args); } });
+    }
+
+    bool canRun (const juce::ArgumentList& args) const      { return app.findCommand (args, false) != nullptr; }
+
+    /** Runs the command and returns the process exit code. */
+    int run (const juce::ArgumentList& args) const          { return app.findAndRunCommand (args, false); }
+
+private:
+    //==============================================================================
+    static void buildFingerprintIndex (const juce::ArgumentList& args)
+    {
+        auto indexFile = args.getFileForOption ("--build-fingerprint-index");
+        auto files = findInputFiles (args);
+
+        if (files.empty())
+            juce::ConsoleApplication::fail ("no input files given");
+
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        auto landmarks = fingerprintFiles (files);
+
+        FingerprintIndex index;
+
+        for (size_t i = 0; i < files.size(); ++i)
+            if (! landmarks[i].empty())
+                index.addReference (files[i].getFileNameWithoutExtension(), landmarks[i]);
+
+        index.finalise();
+
+        if (! index.save (indexFile))
+            juce::ConsoleApplication::fail ("couldn't write " + indexFile.getFullPathName());
+
+        std::cout << "indexed " << index.getNumReferences() << " of " << files.size() << " files, "
+                  << index.getNumEntries() << " landmarks, "
+                  << juce::String ((double) indexFile.getSize() / 1.0e6, 1) << " MB, in "
+                  << juce::String ((juce::Time::getMillisecondCounterHiRes() - start) / 1000.0, 1) << " s" << std::endl;
+    }
+
+    static void matchFingerprints (const juce::ArgumentList& args)
+    {
+        juce::String error;
+        auto index = FingerprintIndex::load (args.getExistingFileForOption ("--match-fingerprints"), true, error);
+
+        if (index == nullptr)
+            juce::ConsoleApplication::fail (error);
+
+        auto files = findInputFiles (args);
+        auto landmarks = fingerprintFiles (files);
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            auto start = juce::Time::getMillisecondCounterHiRes();
+            auto match = index->find (landmarks[i]);
+            auto lookupMs = juce::Time::getMillisecondCounterHiRes() - start;
+
+            std::cout << files[i].getFileName() << ": ";
+
+            if (match.reference < 0)
+                std::cout << "no match";
+            else
+                std::cout << "\"" << match.name << "\" at " << juce::String (match.offsetSeconds, 2)
+                          << " s (" << match.votes << " landmarks)";
+
+            std::cout << ", lookup " << juce::String (lookupMs, 1) << " ms" << std::endl;
+        }
+    }
+
+    //==============================================================================
+    static void buildSimilarityIndex (const juce::ArgumentList& args)
+    {
+        auto indexFile = args.getFileForOption ("--build-similarity-index");
+        auto files = findInputFiles (args);
+
+        if (files.empty())
+            juce::ConsoleApplication::fail ("no input files given");
+
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        auto embeddings = embedFiles (files);
+
+        SimilarityIndex index (embeddingDimensions());
+
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            if (embeddings[i].empty())
+                continue;
+
+            auto source = index.addSource (files[i].getFullPathName());
+
+            for (auto& e : embeddings[i])
+                index.add (source, e.window, e.values.data());
+        }
+
+        index.build();
+
+        if (! index.save (indexFile))
+            juce::ConsoleApplication::fail ("couldn't write " + indexFile.getFullPathName());
+
+        std::cout << "indexed " << index.getNumVectors() << " windows of " << index.getNumSources() << " files into "
+                  << index.getNumLists() << " lists, "
+                  << juce::String ((double) indexFile.getSize() / 1.0e6, 1) << " MB, in "
+                  << juce::String ((juce::Time::getMillisecondCounterHiRes() - start) / 1000.0, 1) << " s" << std::endl;
+    }
+
+    static void findSimilar (const juce::ArgumentList& args)
+    {
+        juce::String error;
+        auto index = SimilarityIndex::load (args.getExistingFileForOption ("--find-similar"), true, error);
+
+        if (index == nullptr)
+            juce::ConsoleApplication::fail (error);
+
+        if (index->getDimensions() != embeddingDimensions())
+            juce::ConsoleApplication::fail ("the index was built with a different band layout");
+
+        auto files = findInputFiles (args);
+
+        if (files.size() != 1)
+            juce::ConsoleApplication::fail ("give exactly one snippet to search for");
+
+        auto snippet = embedFiles (files).front();
+
+        if (snippet.empty())
+            juce::ConsoleApplication::fail ("the snippet is too short or silent to search for");
+
+        auto numResults = args.containsOption ("--results") ? juce::jmax (1, args.getValueForOption ("--results").getIntValue()) : 10;
+        auto numProbes = args.containsOption ("--probes") ? juce::jmax (1, args.getValueForOption ("--probes").getIntValue()) : 16;
+
+        auto start = juce::Time::getMillisecondCounterHiRes();
+
+        // every neighbour of every snippet window votes for where the snippet would start in its source
+        std::map<std::pair<juce::uint32, juce::int64>, float> votes;
+        auto firstWindow = (juce::int64) snippet.front().window;
+
+        for (auto& e : snippet)
+            for (auto& hit : index->search (e.values.data(), neighboursPerWindow, numProbes))
+                votes[{ hit.source, (juce::int64) hit.window - ((juce::int64) e.window - firstWindow) }] += hit.score;
+
+        std::vector<std::pair<float, std::pair<juce::uint32, juce::int64>>> ranked;
+
+        for (auto& v : votes)
+            ranked.push_back ({ v.second / (float) snippet.size(), v.first });
+
+        std::sort (ranked.begin(), ranked.end(), [] (const decltype (ranked)::value_type& a, const decltype (ranked)::value_type& b)
+                   { return a.first > b.first; });
+
+        // keep the best start in each neighbourhood rather than its overlapping neighbours too
+        auto length = (juce::int64) (snippet.back().window - snippet.front().window) + SpectrumEmbedder::blocksPerWindow;
+        std::vector<std::pair<juce::uint32, juce::int64>> shown;
+
+        for (auto& r : ranked)
+        {
+            if ((int) shown.size() >= numResults)
+                break;
+
+            auto overlaps = std::any_of (shown.begin(), shown.end(), [&] (const std::pair<juce::uint32, juce::int64>& s)
+                                         { return s.first == r.second.first && std::abs (s.second - r.second.second) < length; });
+
+            if (overlaps)
+                continue;
+
+            shown.push_back (r.second);
+
+            auto from = (double) r.second.second * SpectrumEmbedder::blockSeconds;
+            std::cout << juce::String (r.first, 3) << "  " << index->getSourceName ((int) r.second.first)
+                      << "  " << formatSeconds (from) << " - " << formatSeconds (from + (double) length * SpectrumEmbedder::blockSeconds) << std::endl;
+        }
+
+        std::cout << "searched " << snippet.size() << " windows against " << index->getNumVectors() << " in "
+                  << juce::String (juce::Time::getMillisecondCounterHiRes() - start, 1) << " ms" << std::endl;
+    }
+
+    static juce::String formatSeconds (double seconds)
+    {
+        auto whole = (int) seconds;
+        return juce::String (whole / 3600) + ":" + juce::String ((whole / 60) % 60).paddedLeft ('0', 2)
+                 + ":" + juce::String (whole % 60).paddedLeft ('0', 2);
+    }
+
+    //==============================================================================
+    static void analysePcm (const juce::ArgumentList& args)
+    {
+        PcmFormat format;
+
+        if (args.containsOption ("--format") && ! PcmFormat::parseEncoding (args.getValueForOption ("--format"), format.encoding))
+            juce::ConsoleApplication::fail ("--format must be s16le, s24le, s32le or f32le");
+
+        if (args.containsOption ("--channels"))
+            format.numChannels = juce::jlimit (1, 64, args.getValueForOption ("--channels").getIntValue());
+
+        if (args.containsOption ("--rate"))
+            format.sampleRate = juce::jlimit (1000.0, 768000.0, args.getValueForOption ("--rate").getDoubleValue());
+
+        auto inputPath = args.containsOption ("--input") ? args.getValueForOption ("--input") : juce::String ("stdin");
+        auto emitFeatures = args.getValueForOption ("--emit") == "features";
+        auto binary = args.getValueForOption ("--protocol") == "binary";
+
+        auto* input = stdin;
+
+        if (inputPath != "stdin" && inputPath != "-")
+            input = std::fopen (args.getFileForOption ("--input").getFullPathName().toRawUTF8(), "rb");
+
+        if (input == nullptr)
+            juce::ConsoleApplication::fail ("can't open " + inputPath);
+
+       #if JUCE_WINDOWS
+        _setmode (_fileno (stdin), _O_BINARY);
+        _setmode (_fileno (stdout), _O_BINARY);
+       #endif
+
+        auto settings = AnalysisSettings::fromArguments (args);
+        auto precise = args.getValueForOption ("--precision") == "double";
+
+        if (precise && args.containsOption ("--stages"))
+            juce::ConsoleApplication::fail ("--stages only applies to --precision=float");
+
+        // only one of these is prepared and run
+        AnalysisPipeline pipeline;
+        PreciseSpectrumAnalyser preciseAnalyser;
+
+        if (precise)
+        {
+            preciseAnalyser.prepare (settings.fftOrder, format.sampleRate, settings.groupNotes);
+        }
+        else
+        {
+            auto graph = AnalysisPipeline::Graph::standard (settings.stages);
+            juce::String error;
+
+            if (! pipeline.prepare (graph, { emitFeatures ? "features" : "levels" }, settings.fftOrder, format.sampleRate, settings.groupNotes, error))
+                juce::ConsoleApplication::fail (error);
+
+            std::cerr << "pipeline: " << pipeline.describePlan() << std::endl;
+        }
+
+        auto fftSize = 1 << settings.fftOrder;
+        auto hopSize = juce::jmax (1, fftSize / settings.overlap);
+        auto& frequencies = precise ? preciseAnalyser.getScale().getFrequencies() : pipeline.getScale().getFrequencies();
+        auto numValues = emitFeatures ? (int) AnalysisPipeline::numFeatures : (int) frequencies.size();
+
+        // headers
+        if (binary)
+        {
+            // records are written as they're held in memory, which the protocol says is little-endian
+            jassert (! juce::ByteOrder::isBigEndian());
+
+            juce::uint32 header[] = { 0x43455053, 1, emitFeatures ? 1u : 0u, (juce::uint32) numValues };   // "SPEC"
+            std::fwrite (header, sizeof (header), 1, stdout);
+
+            if (! emitFeatures)
+                std::fwrite (frequencies.data(), sizeof (float), frequencies.size(), stdout);
+        }
+        else if (emitFeatures)
+        {
+            std::fputs ("# features: time level_db peak_hz centroid_hz\n", stdout);
+        }
+        else
+        {
+            juce::String line ("# bands:");
+
+            for (auto f : frequencies)
+                line << " " << juce::String (f, 1);
+
+            std::fputs ((line + "\n").toRawUTF8(), stdout);
+        }
+
+        const int blockFrames = 4096;
+        std::vector<char> raw ((size_t) (blockFrames * format.getBytesPerFrame()));
+        juce::AudioBuffer<float> channels (format.numChannels, blockFrames);
+        std::vector<float> pending, values ((size_t) numValues);
+        size_t bytesHeld = 0;
+        juce::int64 framesAnalysed = 0;
+
+        for (;;)
+        {
+            auto bytesRead = std::fread (raw.data() + bytesHeld, 1, raw.size() - bytesHeld, input);
+
+            if (bytesRead == 0)
+                break;
+
+            bytesHeld += bytesRead;
+            auto numFrames = (int) (bytesHeld / (size_t) format.getBytesPerFrame());
+
+            format.convert (raw.data(), numFrames, channels.getArrayOfWritePointers());
+
+            // keep any partial frame for the next read
+            auto bytesUsed = (size_t) (numFrames * format.getBytesPerFrame());
+            memmove (raw.data(), raw.data() + bytesUsed, bytesHeld - bytesUsed);
+            bytesHeld -= bytesUsed;
+
+            auto* mono = channels.getWritePointer (0);
+
+            for (int ch = 1; ch < format.numChannels; ++ch)
+                juce::FloatVectorOperations::add (mono, channels.getReadPointer (ch), numFrames);
+
+            if (format.numChannels > 1)
+                juce::FloatVectorOperations::multiply (mono, 1.0f / (float) format.numChannels, numFrames);
+
+            pending.insert (pending.end(), mono, mono + numFrames);
+            size_t start = 0;
+
+            for (; pending.size() - start >= (size_t) fftSize; start += (size_t) hopSize)
+            {
+                if (precise)
+                {
+                    preciseAnalyser.process (pending.data() + start);
+                    auto& levels = preciseAnalyser.getLevels();
+
+                    if (emitFeatures)
+                        AnalysisPipeline::computeFeatures (levels.data(), (int) levels.size(), frequencies, values.data());
+                    else
+                        std::copy (levels.begin(), levels.end(), values.begin());
+                }
+                else
+                {
+                    pipeline.process (pending.data() + start);
+                    std::copy (pipeline.getOutput (0), pipeline.getOutput (0) + numValues, values.begin());
+                }
+
+                auto time = ((double) framesAnalysed * hopSize + fftSize / 2) / format.sampleRate;
+                ++framesAnalysed;
+
+                if (binary)
+                {
+                    std::fwrite (&time, sizeof (time), 1, stdout);
+                    std::fwrite (values.data(), sizeof (float), values.size(), stdout);
+                }
+                else
+                {
+                    juce::String line (time, 3);
+
+                    for (auto v : values)
+                        line << " " << juce::String (v, 1);
+
+                    std::fputs ((line + "\n").toRawUTF8(), stdout);
+                }
+            }
+
+            pending.erase (pending.begin(), pending.begin() + (std::ptrdiff_t) start);
+
+            // the consumer went away
+            if (std::fflush (stdout) != 0 || std::ferror (stdout))
+                break;
+        }
+
+        if (input != stdin)
+            std::fclose (input);
+
+        std::cerr << "analysed " << framesAnalysed << " frames" << std::endl;
+    }
+
+    //==============================================================================
+    static void benchmarkAnalysers (const juce::ArgumentList& args)
+    {
+        auto settings = AnalysisSettings::fromArguments (args);
+        auto sampleRate = args.containsOption ("--rate") ? juce::jlimit (8000.0, 384000.0, args.getValueForOption ("--rate").getDoubleValue()) : 48000.0;
+        auto seconds = args.containsOption ("--seconds") ? juce::jlimit (1.0, 600.0, args.getValueForOption ("--seconds").getDoubleValue()) : 10.0;
+
+        SpectrumAnalyser fft;
+        fft.prepare (settings.fftOrder, sampleRate, settings.groupNotes);
+
+        PreciseSpectrumAnalyser preciseFft;
+        preciseFft.prepare (settings.fftOrder, sampleRate, settings.groupNotes);
+
+        auto& frequencies = fft.getScale().getFrequencies();
+        auto fftSize = fft.getFFTSize();
+        auto hopSize = juce::jmax (1, fftSize / settings.overlap);
+
+        FilterbankAnalyser filterbank;
+        filterbank.prepare (frequencies, sampleRate);
+
+        WaveletAnalyser wavelets;
+        wavelets.prepare (frequencies, settings.fftOrder, sampleRate);
+
+        // each is handed the newest hop, with a whole frame of input behind it
+        struct Candidate
+        {
+            const char* name;
+            std::function<void()> reset;
+            std::function<const std::vector<float>& (const float* end)> analyse;
+        };
+
+        Candidate candidates[] =
+        {
+            { "fft+banding", [] {},
+              [&] (const float* end) -> const std::vector<float>& { fft.process (end - fftSize); return fft.getLevels(); } },
+            { "fft (double)", [] {},
+              [&] (const float* end) -> const std::vector<float>& { preciseFft.process (end - fftSize); return preciseFft.getLevels(); } },
+            { "cwt", [&] { wavelets.reset(); },
+              [&] (const float* end) -> const std::vector<float>& { wavelets.push (end - hopSize, hopSize); wavelets.update(); return wavelets.getLevels(); } },
+            { "filterbank", [&] { filterbank.reset(); },
+              [&] (const float* end) -> const std::vector<float>& { filterbank.process (end - hopSize, hopSize); return filterbank.getLevels(); } }
+        };
+
+        // noise with a few tones in it, so nothing gets an easy ride
+        juce::Random random (1);
+        std::vector<float> input ((size_t) juce::jmax ((double) (2 * fftSize), seconds * sampleRate));
+
+        for (size_t i = 0; i < input.size(); ++i)
+        {
+            auto t = (double) i / sampleRate;
+            input[i] = 0.05f * (random.nextFloat() * 2.0f - 1.0f)
+                         + (float) (0.2 * std::sin (juce::MathConstants<double>::twoPi * 110.0 * t)
+                                     + 0.1 * std::sin (juce::MathConstants<double>::twoPi * 1234.0 * t)
+                                     + 0.05 * std::sin (juce::MathConstants<double>::twoPi * 9000.0 * t));
+        }
+
+        // long enough for the slowest wavelet and filter to settle, in whole hops
+        auto toneLength = (size_t) ((wavelets.getHistoryLength() + 2 * fftSize) / hopSize * hopSize);
+        std::vector<float> tone (toneLength);
+        auto numBands = (int) frequencies.size();
+        auto bandStep = juce::jmax (1, numBands / 16);
+
+        std::cout << "fft order " << settings.fftOrder << ", hop " << hopSize << " samples at " << sampleRate << " Hz, "
+                  << numBands << " bands; the wavelets use " << wavelets.getNumLevels() << " levels, delayed "
+                  << juce::String (wavelets.getDelaySeconds (numBands - 1) * 1000.0, 1) << " to "
+                  << juce::String (wavelets.getDelaySeconds (0) * 1000.0, 1) << " ms" << std::endl;
+
+        for (auto& candidate : candidates)
+        {
+            candidate.reset();
+            int numHops = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+
+            for (auto end = (size_t) fftSize; end <= input.size(); end += (size_t) hopSize, ++numHops)
+                candidate.analyse (input.data() + end);
+
+            auto msPerHop = std::chrono::duration<double, std::milli> (std::chrono::high_resolution_clock::now() - start).count() / juce::jmax (1, numHops);
+
+            // a full-scale sine at a band's centre should read -6 dB there and nothing well away from it
+            float worstError = 0.0f, worstLeakage = AnalysisEngine::mindB;
+
+            for (int b = 0; b < numBands; b += bandStep)
+            {
+                for (size_t i = 0; i < tone.size(); ++i)
+                    tone[i] = (float) std::sin (juce::MathConstants<double>::twoPi * frequencies[(size_t) b] * (double) i / sampleRate);
+
+                candidate.reset();
+                const std::vector<float>* levels = nullptr;
+
+                for (auto end = (size_t) fftSize; end <= tone.size(); end += (size_t) hopSize)
+                    levels = &candidate.analyse (tone.data() + end);
+
+                worstError = juce::jmax (worstError, std::abs ((*levels)[(size_t) b] + 6.0f));
+
+                for (int other = 0; other < numBands; ++other)
+                    if (std::abs (other - b) >= 3)
+                        worstLeakage = juce::jmax (worstLeakage, (*levels)[(size_t) other] + 6.0f);
+            }
+
+            std::cout << juce::String (candidate.name).paddedRight (' ', 14)
+                      << juce::String (msPerHop, 3) << " ms per hop (" << juce::String (100.0 * msPerHop * sampleRate / (1000.0 * hopSize), 2) << "% of real time), "
+                      << "level error up to " << juce::String (worstError, 1) << " dB, "
+                      << "leakage up to " << juce::String (worstLeakage, 0) << " dB" << std::endl;
+        }
+
+        auto numChannels = args.containsOption ("--channels") ? juce::jlimit (1, 256, args.getValueForOption ("--channels").getIntValue()) : 32;
+        benchmarkChannels (input, numChannels, settings, sampleRate);
+    }
+
+    /** Times many channels through one SpectrumAnalyser each, and through BatchedAnalysers, on staggered copies of the input. */
+    static void benchmarkChannels (const std::vector<float>& input, int numChannels, const AnalysisSettings& settings, double sampleRate)
+    {
+        SpectrumAnalyser single;
+        single.prepare (settings.fftOrder, sampleRate, settings.groupNotes);
+
+        BatchedAnalyser<4> batched4 (settings.fftOrder, numChannels, sampleRate, settings.groupNotes);
+        BatchedAnalyser<8> batched8 (settings.fftOrder, numChannels, sampleRate, settings.groupNotes);
+        batched4.setBallistics (1.0f, 1.0f);
+        batched8.setBallistics (1.0f, 1.0f);
+
+        auto fftSize = single.getFFTSize();
+        auto hopSize = juce::jmax (1, fftSize / settings.overlap);
+        auto numBands = single.getNumBands();
+        auto stagger = [] (int channel) { return (size_t) (channel * 37); };
+
+        if (input.size() < (size_t) fftSize + stagger (numChannels))
+            return;
+
+        std::vector<const float*> frames ((size_t) numChannels);
+        std::vector<float> expected ((size_t) (numChannels * numBands)), actual ((size_t) numBands);
+
+        struct Candidate
+        {
+            const char* name;
+            std::function<void (const float* const*)> analyse;
+            std::function<void (int, float*)> copyLevels;     // none for the reference
+        };
+
+        Candidate candidates[] =
+        {
+            { "per channel", [&] (const float* const* channelFrames)
+                {
+                    for (int ch = 0; ch < numChannels; ++ch)
+                    {
+                        single.process (channelFrames[ch]);
+                        std::copy (single.getLevels().begin(), single.getLevels().end(), expected.begin() + ch * numBands);
+                    }
+                }, nullptr },
+            { "batched x4", [&] (const float* const* channelFrames) { batched4.process (channelFrames); },
+              [&] (int ch, float* dest) { batched4.copyBandLevels (ch, dest); } },
+            { "batched x8", [&] (const float* const* channelFrames) { batched8.process (channelFrames); },
+              [&] (int ch, float* dest) { batched8.copyBandLevels (ch, dest); } }
+        };
+
+        std::cout << numChannels << " channels:" << std::endl;
+        double perChannelMs = 0.0;
+
+        for (auto& candidate : candidates)
+        {
+            int numHops = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+
+            for (auto end = (size_t) fftSize + stagger (numChannels); end <= input.size(); end += (size_t) hopSize, ++numHops)
+            {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    frames[(size_t) ch] = input.data() + end - stagger (ch) - (size_t) fftSize;
+
+                candidate.analyse (frames.data());
+            }
+
+            auto msPerHop = std::chrono::duration<double, std::milli> (std::chrono::high_resolution_clock::now() - start).count() / juce::jmax (1, numHops);
+
+            if (perChannelMs == 0.0)
+                perChannelMs = msPerHop;
+
+            std::cout << juce::String (candidate.name).paddedRight (' ', 14)
+                      << juce::String (msPerHop, 3) << " ms per hop (" << juce::String (100.0 * msPerHop * sampleRate / (1000.0 * hopSize), 2) << "% of real time), "
+                      << juce::String (perChannelMs / juce::jmax (1.0e-9, msPerHop), 1) << "x";
+
+            if (candidate.copyLevels != nullptr)
+            {
+                // the last hop's levels, against what each channel's own analyser made of it
+                float worstDifference = 0.0f;
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                {
+                    candidate.copyLevels (ch, actual.data());
+
+                    for (int b = 0; b < numBands; ++b)
+                        worstDifference = juce::jmax (worstDifference, std::abs (actual[(size_t) b] - expected[(size_t) (ch * numBands + b)]));
+                }
+
+                std::cout << ", levels within " << juce::String (worstDifference, 2) << " dB";
+            }
+
+            std::cout << std::endl;
+        }
+    }
+
+    //==============================================================================
+    static void sendRtp (const juce::ArgumentList& args)
+    {
+        auto format = RtpReceiver::Format::fromArguments (args);
+
+        if (! format.isEnabled())
+            juce::ConsoleApplication::fail ("--send-rtp needs --rtp-port");
+
+        RtpSender::Impairments impairments;
+        impairments.lossProbability = juce::jlimit (0.0f, 1.0f, args.getValueForOption ("--loss").getFloatValue());
+        impairments.maxJitterMs = juce::jmax (0.0, args.getValueForOption ("--jitter-ms").getDoubleValue());
+        impairments.driftPpm = args.getValueForOption ("--drift-ppm").getDoubleValue();
+
+        auto host = args.containsOption ("--host") ? args.getValueForOption ("--host") : juce::String ("127.0.0.1");
+        auto packetMs = args.containsOption ("--packet-ms") ? juce::jlimit (0.125, 20.0, args.getValueForOption ("--packet-ms").getDoubleValue()) : 1.0;
+
+        juce::String error;
+
+        if (! RtpSender::sendFile (args.getExistingFileForOption ("--send-rtp"), host, format, packetMs, impairments, error))
+            juce::ConsoleApplication::fail (error);
+    }
+
+    static void receiveRtp (const juce::ArgumentList& args)
+    {
+        auto format = RtpReceiver::Format::fromArguments (args);
+
+        if (! format.isEnabled())
+            juce::ConsoleApplication::fail ("--receive-rtp needs --rtp-port");
+
+        auto seconds = args.getValueForOption ("--seconds").getIntValue();
+
+        juce::SpinLock levelLock;
+        double sumOfSquares = 0.0;
+        juce::int64 numSamples = 0;
+
+        RtpReceiver receiver (format);
+        receiver.onBlock = [&] (const float* const* channelData, int, int n)
+        {
+            double sum = 0.0;
+
+            for (int i = 0; i < n; ++i)
+                sum += (double) channelData[0][i] * channelData[0][i];
+
+            const juce::SpinLock::ScopedLockType sl (levelLock);
+            sumOfSquares += sum;
+            numSamples += n;
+        };
+
+        juce::String error;
+
+        if (! receiver.startReceiving (error))
+            juce::ConsoleApplication::fail (error);
+
+        for (int elapsed = 1; seconds <= 0 || elapsed <= seconds; ++elapsed)
+        {
+            juce::Thread::sleep (1000);
+
+            double meanSquare = 0.0;
+
+            {
+                const juce::SpinLock::ScopedLockType sl (levelLock);
+                meanSquare = numSamples > 0 ? sumOfSquares / (double) numSamples : 0.0;
+                sumOfSquares = 0.0;
+                numSamples = 0;
+            }
+
+            auto c = receiver.getCounters();
+
+            std::cout << elapsed << " s: " << juce::String (juce::Decibels::gainToDecibels ((float) std::sqrt (meanSquare)), 1) << " dBFS"
+                      << ", received " << (juce::int64) c.packetsReceived << ", lost " << (juce::int64) c.packetsLost
+                      << ", late " << (juce::int64) c.packetsLate << ", invalid " << (juce::int64) c.packetsInvalid
+                      << ", concealed " << juce::String ((double) c.samplesConcealed / format.sampleRate * 1000.0, 1) << " ms"
+                      << ", jitter " << juce::String (c.jitterMs, 2) << " ms, buffer " << juce::String (c.bufferMs, 1)
+                      << "/" << juce::String (c.targetMs, 1) << " ms, drift " << juce::String (c.driftPpm, 0) << " ppm"
+                      << ", resyncs " << c.resyncs << std::endl;
+        }
+
+        receiver.stopReceiving();
+    }
+
+    //==============================================================================
+    struct Embedding
+    {
+        juce::uint32 window;
+        std::vector<float> values;
+    };
+
+    static int embeddingDimensions()
+    {
+        SpectrumAnalyser analyser;
+        analyser.prepare (embeddingFftOrder, 44100.0);
+        return 2 * analyser.getNumBands();
+    }
+
+    /** Embeds every window of every file on all cores; files that can't be decoded come back empty. */
+    static std::vector<std::vector<Embedding>> embedFiles (const std::vector<juce::File>& files)
+    {
+        std::vector<std::vector<Embedding>> results (files.size());
+        std::atomic<size_t> next { 0 };
+
+        auto worker = [&]
+        {
+            OfflineAnalyser reader;
+            SpectrumAnalyser analyser;
+            SpectrumEmbedder embedder;
+
+            for (size_t i; (i = next++) < files.size();)
+            {
+                if (! reader.open (files[i]))
+                {
+                    std::cerr << reader.getError() << std::endl;
+                    continue;
+                }
+
+                auto& embeddings = results[i];
+                SpectrumEmbedder::Callback keep = [&] (juce::uint32 window, const float* values)
+                {
+                    embeddings.push_back ({ window, std::vector<float> (values, values + embedder.getDimensions()) });
+                };
+
+                analyser.prepare (embeddingFftOrder, reader.getSampleRate());
+                embedder.prepare (analyser.getNumBands(), reader.getSampleRate());
+
+                reader.analyseFrames (analyser, analyser.getFFTSize() / 2, [&] (const SpectrumAnalyser& a, juce::int64 frameEnd)
+                {
+                    embedder.addFrame (a.getLevels().data(), frameEnd - a.getFFTSize() / 2, keep);
+                });
+
+                embedder.flush (keep);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (int t = juce::jmin (juce::SystemStats::getNumCpus(), (int) files.size()); --t >= 0;)
+            threads.emplace_back (worker);
+
+        for (auto& t : threads)
+            t.join();
+
+        return results;
+    }
+
+    //==============================================================================
+    /** The plain (non-option) arguments, with folders expanded into the files inside them. */
+    static std::vector<juce::File> findInputFiles (const juce::ArgumentList& args)
+    {
+        std::vector<juce::File> files;
+
+        for (auto& arg : args.arguments)
+        {
+            if (arg.isOption())
+                continue;
+
+            auto file = arg.resolveAsFile();
+
+            if (file.isDirectory())
+            {
+                for (auto& child : file.findChildFiles (juce::File::findFiles, true))
+                    files.push_back (child);
+            }
+            else
+            {
+                files.push_back (file);
+            }
+        }
+
+        std::sort (files.begin(), files.end());
+        return files;
+    }
+
+    /** Fingerprints the files on all cores; files that can't be decoded come back empty. */
+    static std::vector<std::vector<Landmark>> fingerprintFiles (const std::vector<juce::File>& files)
+    {
+        std::vector<std::vector<Landmark>> results (files.size());
+        std::atomic<size_t> next { 0 };
+
+        auto worker = [&]
+        {
+            OfflineAnalyser reader;
+            Fingerprinter fingerprinter;
+
+            for (size_t i; (i = next++) < files.size();)
+            {
+                if (! reader.open (files[i]))
+                {
+                    std::cerr << reader.getError() << std::endl;
+                    continue;
+                }
+
+                fingerprinter.prepare (reader.getSampleRate());
+                reader.readBlocks ([&] (const float* samples, int numSamples) { fingerprinter.process (samples, numSamples, results[i]); });
+                fingerprinter.flush (results[i]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (int t = juce::jmin (juce::SystemStats::getNumCpus(), (int) files.size()); --t >= 0;)
+            threads.emplace_back (worker);
+
+        for (auto& t : threads)
+            t.join();
+
+        return results;
+    }
+
+    enum { embeddingFftOrder = 11, neighboursPerWindow = 200 };
+
+    juce::ConsoleApplication app;
+};
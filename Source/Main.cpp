@@ -8,13 +8,15 @@
 
 #include <JuceHeader.h>
 #include "MainComponent.h"
+#include "HeadlessCommands.h"
+#include "StartupTiming.h"
 
 //==============================================================================
 class jucespectrumApplication  : public juce::JUCEApplication
 {
 public:
     //==============================================================================
-    jucespectrumApplication() {}
+    jucespectrumApplication()   { StartupTiming::start(); }
 
     const juce::String getApplicationName() override       { return ProjectInfo::projectName; }
     const juce::String getApplicationVersion() override    { return ProjectInfo::versionString; }
@@ -25,7 +27,19 @@ public:
     {
         // This method is where you should put your application's initialisation code..
 
-        mainWindow.reset (new MainWindow (getApplicationName()));
+        juce::ArgumentList args (getApplicationName(), getCommandLineParameterArray());
+
+        HeadlessCommands commands;
+
+        if (commands.canRun (args))
+        {
+            setApplicationReturnValue (commands.run (args));
+            quit();
+            return;
+        }
+
+        mainWindow.reset (new MainWindow (getApplicationName(),
+                                          AnalysisSettings::fromArguments (args)));
     }
 
     void shutdown() override
@@ -58,14 +72,14 @@ public:
     class MainWindow    : public juce::DocumentWindow
     {
     public:
-        MainWindow (juce::String name)
+        MainWindow (juce::String name, const AnalysisSettings& analysisSettings)
             : DocumentWindow (name,
                               juce::Desktop::getInstance().getDefaultLookAndFeel()
                                                           .findColour (juce::ResizableWindow::backgroundColourId),
                               DocumentWindow::allButtons)
         {
             setUsingNativeTitleBar (true);
-            setContentOwned (new MainComponent(), true);
+            setContentOwned (new MainComponent (analysisSettings), true);
 
            #if JUCE_IOS || JUCE_ANDROID
             setFullScreen (true);
@@ -49,280 +49,930 @@
 
 #include <JuceHeader.h>
 #include <chrono>
+#include <limits>
+#include "AnalysisEngine.h"
+#include "AudioDeviceOpener.h"
+#include "FingerprintMatcher.h"
+#include "GoniometerView.h"
+#include "QualityGovernor.h"
+#include "ScopeView.h"
+#include "StartupTiming.h"
+#include "WavTailFollower.h"
+#include "WaterfallView.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
-class Bar {
-public:
-    int posX;
-    int dataIdx;
-    int endIdx;
-    float factor;
-};
-
 //==============================================================================
+/**
+    The window's content: the bars, their overlays and the lower views.
+
+    The audio device isn't opened until the window has painted once, as some
+    drivers take seconds to negotiate: the window appears at once with a
+    status line, then an AudioDeviceOpener scans for and opens the device on
+    a worker thread while the window stays responsive. Once it's open the
+    component is attached to it back on the message thread, and the analysis
+    picks the input up in prepareToPlay(). How long startup took, from
+    process start to the first analysed frame on screen, is printed once that
+    frame has been painted, or once the input has been silent for a few
+    seconds.
+*/
 class MainComponent   : public juce::AudioAppComponent,
-private juce::Timer
+private juce::Timer,
+private juce::AsyncUpdater
 {
 public:
-    MainComponent()
-    : forwardFFT (fftOrder),
-    window (fftSize, juce::dsp::WindowingFunction<float>::hann)
+    explicit MainComponent (const AnalysisSettings& settings = {})
+    : engine (settings),
+    governor (requestedQuality (settings)),
+    baselineFile (settings.baseline),
+    scope (engine.getSampleHistory()),
+    goniometer (engine.getSampleHistory(), settings.fftOrder, settings.groupNotes),
+    waterfall (engine.getSpectrogram())
     {
+        governor.onTransition = [this] (const QualityGovernor::Transition& t) { applyQuality (t); };
+        engine.onSignalResumed = [this] { triggerAsyncUpdate(); };
+        loadFingerprintIndex (settings.fingerprintIndex);
+        startTriggeredAveraging (settings);
+
         setOpaque (true);
-        setAudioChannels (2, 0);  // we want a couple of input channels but no outputs
-        startTimerHz (60);
-        setSize (700, 500);
+        setWantsKeyboardFocus (true);
+        addChildComponent (scope);
+        addChildComponent (goniometer);
+        addChildComponent (waterfall);
+
+        if (settings.rtp.isEnabled())
+            startNetworkInput (settings.rtp);
+        else if (settings.followFile != juce::File())
+            startFollowing (settings.followFile, settings.followLatencySeconds);
+        else
+            startAudioDevice();
+
+        if (! deviceOpenPending)
+            inputReady();
 
-        // How many notes to group
-        // TODO: make that configuragle
-        buildTemperedScale(2);
+        engine.startAnalysis();
+        startTimerHz (governor.getLevel().frameRate);
+        setSize (700, 500);
     }
     
     ~MainComponent() override
     {
+        deviceOpener = nullptr;
+        inputPlayer.setSource (nullptr);
+        deviceManager.removeAudioCallback (&inputPlayer);
         shutdownAudio();
+        network = nullptr;
+        follower = nullptr;
+        matcher = nullptr;
+        averager = nullptr;
+        engine.stopAnalysis();
+        cancelPendingUpdate();
     }
     
     //==============================================================================
     void prepareToPlay (int, double sampleRate) override {
-        _sampleRate = sampleRate;
+        prepareAnalysis (sampleRate);
     }
     
     void releaseResources() override          {}
     
     void getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill) override
     {
-        if (bufferToFill.buffer->getNumChannels() > 0)
-        {
-            auto* channelData = bufferToFill.buffer->getReadPointer (0, bufferToFill.startSample);
-            
-            for (auto i = 0; i < bufferToFill.numSamples; ++i) {
-                pushNextSampleIntoFifo (channelData[i]);
-            }
-        }
+        auto numChannels = juce::jmin (bufferToFill.buffer->getNumChannels(), engine.getNumInputChannels());
+        const float* channelData[AnalysisSettings::maxInputChannels] = {};
+
+        for (int ch = 0; ch < numChannels; ++ch)
+            channelData[ch] = bufferToFill.buffer->getReadPointer (ch, bufferToFill.startSample);
+
+        if (numChannels > 0)
+            engine.pushSamples (channelData, numChannels, bufferToFill.numSamples);
     }
     
     //==============================================================================
     void paint (juce::Graphics& g) override
     {
+        auto start = Clock::now();
+
+        // the OS repaints us when we're restored after being minimised
+        wakeUp();
+
         g.fillAll (juce::Colours::black);
         g.setOpacity (1.0f);
         g.setColour (juce::Colours::white);
-        drawFrame (g);
+        drawFrame (g, frozen ? frozenLevels
+                    : triggeredView == TriggeredView::coherent ? triggered.coherent
+                    : triggeredView == TriggeredView::power ? triggered.power
+                    : levels);
+        drawStatistics (g);
+        drawEnvelope (g);
+        drawAnomalyStatus (g);
+        drawInputStatus (g);
+        drawTriggerStatus (g);
+        drawStatus (g);
+        drawFreezeOverlay (g);
+        noteStartupPaint();
+
+        governor.addPaintTime (std::chrono::duration<double, std::milli> (Clock::now() - start).count());
     }
     
     void timerCallback() override
     {
-        if (nextFFTBlockReady)
+        // nobody can see us: stop taking frames and painting until we're shown again; the analysis carries on
+        if (! isVisibleOnScreen())
+        {
+            engine.setSuspended (true);
+            stopTimer();
+            return;
+        }
+
+        engine.setSuspended (false);
+
+        if (scope.isVisible())
+            scope.refresh();
+
+        if (goniometer.isVisible())
+            goniometer.refresh();
+
+        if (waterfall.isVisible())
+            waterfall.refresh();
+
+        auto timing = engine.popTiming();
+        governor.addAnalysisFrames (timing.totalMs, timing.numFrames, timing.numSkipped, timing.hopMs);
+        governor.update (juce::Time::getMillisecondCounterHiRes());
+
+        refreshStatistics();
+        showRecognisedContent();
+
+        if (averager != nullptr && triggeredView != TriggeredView::live && averager->pullResult (triggered))
+            repaint();
+
+        if (showEnvelope && engine.pullLatestCepstrum (cepstrum))
+            repaint();
+
+        if (engine.isSignalPresent())
+        {
+            if (engine.pullLatestLevels (levels))
+                repaint();
+        }
+        else if (decayTowardsRest())
         {
-            drawNextFrameOfSpectrum();
-            nextFFTBlockReady = false;
             repaint();
         }
+        else if (! isLowerViewVisible())
+        {
+            // the bars are at rest: nothing will change until the signal comes back
+            stopTimer();
+        }
     }
     
-    void pushNextSampleIntoFifo (float sample) noexcept
+    void handleAsyncUpdate() override
     {
-        // if the fifo contains enough data, set a flag to say
-        // that the next frame should now be rendered..
-        if (fifoIndex == fftSize)               // [11]
+        wakeUp();
+    }
+    
+    void visibilityChanged() override
+    {
+        wakeUp();
+    }
+    
+    void wakeUp()
+    {
+        if (! frozen && ! isTimerRunning() && isVisibleOnScreen())
+            startTimerHz (governor.getLevel().frameRate);
+    }
+    
+    bool isVisibleOnScreen() const
+    {
+        auto* peer = getPeer();
+        return isShowing() && peer != nullptr && ! peer->isMinimised();
+    }
+    
+    /** Lets the bars fall after the input went silent; returns false once they're all at rest. */
+    bool decayTowardsRest()
+    {
+        auto step = restDecayDbPerSecond / (float) governor.getLevel().frameRate;
+        bool moving = false;
+
+        for (auto& level : levels)
         {
-            if (!nextFFTBlockReady)            // [12]
+            if (level > AnalysisEngine::mindB)
             {
-                juce::zeromem (fftData, sizeof (fftData));
-                memcpy (fftData, fifo, sizeof (fifo));
-                nextFFTBlockReady = true;
+                level = juce::jmax (AnalysisEngine::mindB, level - step);
+                moving = true;
             }
-            
-            fifoIndex = 0;
         }
-        
-        fifo[fifoIndex++] = sample;             // [12]
-    }
-    
-    /**
-         * Precalculate the actual X-coordinate on screen for each analyzer bar
-         *
-         * Since the frequency scale is logarithmic, each position in the X-axis actually represents a power of 10.
-         * To improve performace, the position of each frequency is calculated in advance and stored in an array.
-         * Canvas space usage is optimized to accommodate exactly the frequency range the user needs.
-         * Positions need to be recalculated whenever the frequency range, FFT size or canvas size change.
-         *
-         *                                 +------------------------ canvas --------------------------+
-         *                                   |                                                                         |
-         *    |-------------------|-----|-------------|-------------------!-------------------|-------|------------|
-         *    1                  10       |            100                  1K                 10K         |           100K (Hz)
-         * (10^0)           (10^1)   |          (10^2)               (10^3)              (10^4)   |          (10^5)
-         *                              |-------------|<--- logWidth ---->|--------------------------|
-         *                  minFreq--> 20                   (pixels)                                22K <--maxFreq
-         *                          (10^1.3)                                                     (10^4.34)
-         *                           minLog
-         */
-    void buildTemperedScale(int groupNotes) {
-        std::cout << "build tempered scale" << std::endl;
-        float root24 = pow(2.0f, 1.0f / 24.0f);
-        float c0 = 440.0f * pow(root24, -114.0f); // ~16.35 Hz
-        float freq = 0.0f;
-        
-        int i = 0;
-        
-        // generate a table of frequencies based on the equal tempered scale
-        // https://en.wikipedia.org/wiki/Equal_temperament
-        while ((freq = c0 * pow(root24, i)) <= maxFreq) {
-            if (freq >= minFreq && i % groupNotes == 0) {
-                temperedScale.push_back(freq);
-            }
-            i++;
+
+        return moving;
+    }
+    
+    void drawFrame (juce::Graphics& g, const std::vector<float>& bandLevels)
+    {
+        // at a coarser level of detail, neighbouring bars are merged and the loudest one drawn
+        int lod = governor.getLevel().barLod;
+        int nBars = ((int) bandLevels.size() + lod - 1) / lod;
+
+        float windowWidth  = getSpectrumArea().getWidth();
+        float windowHeight = getSpectrumArea().getHeight();
+        float barWidth = (windowWidth / nBars);
+        float barSpace = 0.1f;
+        float barSpacePx = std::min(barWidth - 1, (barSpace > 0.0f && barSpace < 1.0f) ? barWidth * barSpace : barSpace);
+        float width = barWidth - barSpacePx;
+
+        for (int i = 0; i < nBars; i++)
+        {
+            float level = AnalysisEngine::mindB;
+
+            for (int j = i * lod; j < std::min ((i + 1) * lod, (int) bandLevels.size()); j++)
+                level = std::max (level, bandLevels[j]);
+
+            float barHeight = juce::jmap (level, AnalysisEngine::mindB, AnalysisEngine::maxdB, windowHeight, 0.0f);
+
+            float posX = ((float) i * barWidth) + barSpacePx / 2.0f;
+            float adjWidth = width;
+
+            g.fillRect(posX, barHeight, adjWidth, windowHeight - barHeight);
         }
-        
-        int prevBin = 0;
-        int prevIdx = 0;
-        int nBars = 0;
-        
-        for (int index = 0; index < temperedScale.size(); index++) {
-            float freq = temperedScale[index];
-            // which FFT bin best represents this frequency?
-            float bin = freqToBin(freq);
-            int idx = 0;
-            int nextBin = 0;
-            
-            // start from the last used FFT bin
-            if (prevBin > 0 && prevBin + 1 <= bin) {
-                idx = prevBin + 1;
-            } else {
-                idx = bin;
-            }
-            
-            // FFT does not provide many coefficients for low frequencies, so several bars may end up using the same data
-            if (idx == prevIdx) {
-                nBars++;
-            } else {
-                // update previous bars using the same index with an interpolation factor
-                if (nBars > 1) {
-                    for (int iFactor = 0; iFactor < nBars; iFactor++) {
-                        float factor = ((float)iFactor + 1) / (float)nBars;
-                        allBars[allBars.size() - nBars + iFactor].factor = factor;
-                    }
-                }
-                prevIdx = idx;
-                nBars = 1;
-            }
-            
-            prevBin = nextBin = bin;
-            
-            // check if there's another band after this one
-            if (index + 1 < temperedScale.size()) {
-                nextBin = freqToBin(temperedScale[index + 1]);
-                // and use half the bins in between for this band
-                if (nextBin - bin > 1) {
-                    prevBin += round((nextBin - bin) / 2);
-                }
+    }
+    
+    /** Draws the P10-P90 range as a shaded band, with the median, P99 and mean power as lines. */
+    void drawStatistics (juce::Graphics& g)
+    {
+        auto numBands = (int) statistics.meanDb.size();
+
+        if (! showStatistics || statistics.numFrames == 0 || numBands == 0)
+            return;
+
+        auto bounds = getSpectrumArea().toFloat();
+        auto bandWidth = bounds.getWidth() / (float) numBands;
+
+        auto toPath = [&] (const std::vector<float>& values)
+        {
+            juce::Path path;
+
+            for (int b = 0; b < numBands; ++b)
+            {
+                auto x = ((float) b + 0.5f) * bandWidth;
+                auto y = juce::jmap (values[(size_t) b], AnalysisEngine::mindB, AnalysisEngine::maxdB, bounds.getHeight(), 0.0f);
+
+                if (b == 0)
+                    path.startNewSubPath (x, y);
+                else
+                    path.lineTo (x, y);
             }
-            
-            int endIdx = prevBin - idx > 0 ? prevBin : 0;
-            
-            Bar bar;
-            bar.posX = index;
-            bar.dataIdx = idx;
-            bar.endIdx = endIdx;
-            bar.factor = 0;
-            
-            allBars.push_back(bar);
+
+            return path;
+        };
+
+        juce::Path range (toPath (statistics.p90));
+
+        for (int b = numBands; --b >= 0;)
+            range.lineTo (((float) b + 0.5f) * bandWidth,
+                          juce::jmap (statistics.p10[(size_t) b], AnalysisEngine::mindB, AnalysisEngine::maxdB, bounds.getHeight(), 0.0f));
+
+        range.closeSubPath();
+
+        g.setColour (juce::Colours::green.withAlpha (0.25f));
+        g.fillPath (range);
+        g.setColour (juce::Colours::green);
+        g.strokePath (toPath (statistics.p50), juce::PathStrokeType (1.5f));
+        g.setColour (juce::Colours::red.withAlpha (0.7f));
+        g.strokePath (toPath (statistics.p99), juce::PathStrokeType (1.0f));
+        g.setColour (juce::Colours::yellow);
+        g.strokePath (toPath (statistics.meanDb), juce::PathStrokeType (1.5f));
+
+        g.drawText ("LTAS of " + juce::String ((juce::int64) statistics.numFrames) + " frames, "
+                      + juce::String ((juce::int64) statistics.silentSeconds) + " s of silence left out   yellow: mean  green: P10/P50/P90  red: P99   r: reset  e: export",
+                    getLocalBounds().reduced (8).removeFromTop (40).removeFromBottom (20), juce::Justification::topLeft);
+    }
+    
+    /** Overlays the cepstral envelope on the bars, with the strongest echo or periodicity. */
+    void drawEnvelope (juce::Graphics& g)
+    {
+        auto numBands = (int) cepstrum.envelope.size();
+
+        if (! showEnvelope || frozen || numBands == 0)
+            return;
+
+        auto bounds = getSpectrumArea().toFloat();
+        auto bandWidth = bounds.getWidth() / (float) numBands;
+        juce::Path path;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            auto x = ((float) b + 0.5f) * bandWidth;
+            auto y = juce::jmap (cepstrum.envelope[(size_t) b], AnalysisEngine::mindB, AnalysisEngine::maxdB, bounds.getHeight(), 0.0f);
+
+            if (b == 0)
+                path.startNewSubPath (x, y);
+            else
+                path.lineTo (x, y);
         }
+
+        g.setColour (juce::Colours::deepskyblue);
+        g.strokePath (path, juce::PathStrokeType (2.0f));
+
+        auto& peak = cepstrum.peak;
+        auto text = "envelope   cepstral peak "
+                  + (peak.strength > 0.0f ? juce::String (peak.quefrencySeconds * 1000.0, 1) + " ms ("
+                                              + juce::String (juce::roundToInt (1.0 / peak.quefrencySeconds)) + " Hz)  "
+                                              + juce::String (peak.strength, 2)
+                                          : juce::String ("none"))
+                  + "   l: hide";
+
+        g.drawText (text, getSpectrumArea().reduced (8).removeFromTop (40).removeFromBottom (20), juce::Justification::topRight);
+    }
+
+    void toggleEnvelope()
+    {
+        showEnvelope = ! showEnvelope;
+        engine.setCepstrumEnabled (showEnvelope);
+        cepstrum = {};
+        repaint();
+    }
+
+    /** Takes a fresh copy of the statistics every half second while they're shown. */
+    void refreshStatistics()
+    {
+        auto now = juce::Time::getMillisecondCounter();
+
+        if (! showStatistics || now < nextStatisticsRefresh)
+            return;
+
+        statistics = engine.getBandStatistics().getSummary();
+        nextStatisticsRefresh = now + 500;
+    }
+    
+    void exportStatistics()
+    {
+        auto file = juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                        .getNonexistentChildFile ("ltas-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S"), ".csv");
+
+        auto summary = engine.getBandStatistics().getSummary();
+        auto ok = BandStatistics::writeCsv (summary, engine.getBandFrequencies(), file);
+
+        statusText = ok ? "statistics exported to " + file.getFullPathName() : "couldn't write " + file.getFullPathName();
+        statusExpiry = juce::Time::getMillisecondCounter() + 3000;
+        std::cout << statusText << std::endl;
+        repaint();
     }
     
-    float freqToBin(double freq) {
-        float bin = round((freq * fftSize) / _sampleRate);
-        
-        return bin < (fftSize / 2) ? bin : fftSize - 1;
+    void loadFingerprintIndex (const juce::File& file)
+    {
+        if (file == juce::File())
+            return;
+
+        juce::String error;
+        fingerprintIndex = FingerprintIndex::load (file, true, error);
+
+        if (fingerprintIndex == nullptr)
+        {
+            std::cout << error << std::endl;
+            return;
+        }
+
+        std::cout << "recognising " << fingerprintIndex->getNumReferences() << " references from " << file.getFullPathName() << std::endl;
+        matcher.reset (new FingerprintMatcher (engine.getSampleHistory(), *fingerprintIndex));
+        matcher->startMatching();
     }
     
+    void showRecognisedContent()
+    {
+        FingerprintIndex::Match match;
+
+        if (matcher == nullptr || ! matcher->popMatch (match))
+            return;
+
+        statusText = "recognised: " + match.name;
+        statusExpiry = juce::Time::getMillisecondCounter() + 5000;
+        repaint();
+    }
     
-    void drawNextFrameOfSpectrum()
+    void drawAnomalyStatus (juce::Graphics& g)
     {
-        // first apply a windowing function to our data
-        window.multiplyWithWindowingTable (fftData, fftSize);       // [1]
-        
-        
-        // then render our FFT data..
-        forwardFFT.performFrequencyOnlyForwardTransform (fftData);  // [2]
+        auto status = engine.getAnomalyDetector().getStatus();
+        juce::String text;
+
+        if (status.mode != AnomalyDetector::Mode::off && ! status.layoutMatches)
+            text = "baseline paused: the analysis has changed since it was learned";
+        else if (status.mode == AnomalyDetector::Mode::training)
+            text = "learning baseline: " + formatTime (status.trainedSeconds) + "   b: finish";
+        else if (status.mode == AnomalyDetector::Mode::monitoring)
+            text = juce::String (status.alert ? "ANOMALY" : "normal") + "  score " + juce::String (status.score, 2)
+                 + " / " + juce::String (status.threshold, 1);
+        else
+            return;
+
+        g.setColour (status.alert ? juce::Colours::red : status.layoutMatches ? juce::Colours::lightgreen : juce::Colours::grey);
+        g.drawText (text, getLocalBounds().reduced (8).removeFromTop (20), juce::Justification::topRight);
     }
     
-    float getLevel(int i, float height) {
-        auto mindB = -100.0f;
-        auto maxdB =    0.0f;
-        
-        float newGain = fftData[i];
-                
-        auto db = juce::jlimit (mindB, maxdB, juce::Decibels::gainToDecibels (newGain) - juce::Decibels::gainToDecibels ((float) fftSize));
-        auto level = juce::jmap (db, mindB, maxdB, height, 0.0f);
-        
-        return level;
+    /** Starts learning a baseline, or finishes and saves the one being learned. */
+    void toggleTraining()
+    {
+        auto& anomaly = engine.getAnomalyDetector();
+
+        if (anomaly.getStatus().mode != AnomalyDetector::Mode::training)
+        {
+            anomaly.startTraining();
+            wakeUp();
+            return;
+        }
+
+        if (! anomaly.finishTraining())
+        {
+            statusText = "not enough input to learn a baseline from";
+        }
+        else
+        {
+            auto file = baselineFile != juce::File() ? baselineFile
+                                                     : juce::File::getSpecialLocation (juce::File::userDocumentsDirectory).getChildFile ("baseline.anbl");
+
+            statusText = anomaly.save (file) ? "saved baseline to " + file.getFullPathName() : "couldn't write " + file.getFullPathName();
+        }
+
+        statusExpiry = juce::Time::getMillisecondCounter() + 3000;
+        std::cout << statusText << std::endl;
+        repaint();
     }
     
-    void drawFrame (juce::Graphics& g)
+    /** Called whenever the input's sample rate is known or changes, from whichever thread learns it. */
+    void prepareAnalysis (double sampleRate)
     {
-        float windowWidth  = getLocalBounds().getWidth();
-        float windowHeight = getLocalBounds().getHeight();
-        float nBars = allBars.size();
-        float barWidth = (windowWidth / temperedScale.size());
-        float barSpace = 0.1f;
-        float barSpacePx = std::min(barWidth - 1, (barSpace > 0.0f && barSpace < 1.0f) ? barWidth * barSpace : barSpace);
-        float width = barWidth - barSpacePx;
+        engine.prepare (sampleRate);
+        scope.setSampleRate (sampleRate);
+        goniometer.setSampleRate (sampleRate);
 
-        for (int i = 0; i < nBars; i++)
+        if (matcher != nullptr)
+            matcher->prepare (sampleRate);
+
+        if (averager != nullptr)
+            averager->prepare (triggerFftOrder, sampleRate, triggerGroupNotes);
+    }
+
+    void startTriggeredAveraging (const AnalysisSettings& settings)
+    {
+        if (! settings.trigger.isEnabled())
+            return;
+
+        triggerFftOrder = settings.fftOrder;
+        triggerGroupNotes = settings.groupNotes;
+        averager.reset (new TriggeredAverager (engine.getSampleHistory(), settings.trigger));
+        averager->prepare (triggerFftOrder, 44100.0, triggerGroupNotes);
+        averager->startAveraging();
+        triggeredView = TriggeredView::coherent;
+    }
+
+    /** Cycles the display between the live spectrum and the coherent and power averages. */
+    void cycleTriggeredView()
+    {
+        if (averager == nullptr)
+            return;
+
+        triggeredView = triggeredView == TriggeredView::live     ? TriggeredView::coherent
+                      : triggeredView == TriggeredView::coherent ? TriggeredView::power
+                                                                 : TriggeredView::live;
+        averager->pullResult (triggered);
+        repaint();
+    }
+
+    void drawTriggerStatus (juce::Graphics& g)
+    {
+        if (averager == nullptr || triggeredView == TriggeredView::live || frozen)
+            return;
+
+        auto text = juce::String (triggeredView == TriggeredView::coherent ? "coherent" : "power")
+                  + " average of " + juce::String (triggered.numAverages) + " triggers ("
+                  + juce::String (triggered.triggerRateHz, 2) + " Hz"
+                  + (triggered.missedTriggers > 0 ? ", " + juce::String (triggered.missedTriggers) + " missed" : juce::String())
+                  + ")   t: view  c: clear";
+
+        g.setColour (juce::Colours::magenta);
+        g.drawText (text, getLocalBounds().reduced (8).removeFromTop (40).removeFromBottom (20), juce::Justification::topLeft);
+    }
+
+    /** Analyses an RTP stream instead of the audio device; the receiver paces it like a device would. */
+    void startNetworkInput (const RtpReceiver::Format& format)
+    {
+        network.reset (new RtpReceiver (format));
+        prepareAnalysis (format.sampleRate);
+
+        network->onBlock = [this] (const float* const* channelData, int numChannels, int numSamples)
+        {
+            engine.pushSamples (channelData, numChannels, numSamples);
+        };
+
+        juce::String error;
+
+        if (network->startReceiving (error))
+            statusText = "listening for RTP on port " + juce::String (format.port);
+        else
+            statusText = error;
+
+        statusExpiry = juce::Time::getMillisecondCounter() + 5000;
+        std::cout << statusText << std::endl;
+    }
+
+    /** Analyses a WAV file as another program records it, instead of the audio device. */
+    void startFollowing (const juce::File& file, double maxLatencySeconds)
+    {
+        follower.reset (new WavTailFollower (file, maxLatencySeconds));
+
+        juce::Component::SafePointer<MainComponent> safeThis (this);
+
+        // the engine and views are prepared on the message thread, as they are for the device
+        follower->onFormatChanged = [safeThis] (double sampleRate, int)
+        {
+            juce::MessageManager::callAsync ([safeThis, sampleRate]
+            {
+                if (safeThis != nullptr)
+                    safeThis->prepareAnalysis (sampleRate);
+            });
+        };
+
+        follower->onBlock = [this] (const float* const* channelData, int numChannels, int numSamples)
+        {
+            engine.pushSamples (channelData, numChannels, numSamples);
+        };
+
+        follower->startFollowing();
+    }
+
+    /** Asks for the audio device to be opened once the window has painted; see noteStartupPaint(). */
+    void startAudioDevice()
+    {
+        statusText = "opening audio device...";
+        statusExpiry = std::numeric_limits<juce::uint32>::max();
+        deviceOpenPending = true;
+    }
+
+    /** Opens the device on a worker thread; the message thread carries on painting meanwhile. */
+    void openAudioDevice()
+    {
+        juce::Component::SafePointer<MainComponent> safeThis (this);
+
+        // we want the analysed input channels but no outputs
+        deviceOpener.reset (new AudioDeviceOpener (deviceManager, engine.getNumInputChannels(), 0));
+
+        deviceOpener->onOpened = [safeThis] (const juce::String& error)
+        {
+            if (safeThis != nullptr)
+                safeThis->audioDeviceOpened (error);
+        };
+
+        deviceOpener->open();
+    }
+
+    /** Attaches to the device once it's open, which calls prepareToPlay() here on the message thread. */
+    void audioDeviceOpened (const juce::String& error)
+    {
+        inputPlayer.setSource (this);
+        deviceManager.addAudioCallback (&inputPlayer);
+        inputReady();
+
+        if (auto* device = deviceManager.getCurrentAudioDevice())
+            statusText = "audio input: " + device->getName() + " at " + juce::String (device->getCurrentSampleRate(), 0)
+                       + " Hz, ready after " + juce::String (inputReadyMs, 0) + " ms";
+        else
+            statusText = "couldn't open an audio input device" + (error.isNotEmpty() ? ": " + error : juce::String());
+
+        statusExpiry = juce::Time::getMillisecondCounter() + 3000;
+        std::cout << statusText << std::endl;
+        repaint();
+    }
+
+    /** Notes when the input can be analysed, and gives it a few seconds to produce a frame before reporting startup without one. */
+    void inputReady()
+    {
+        inputReadyMs = StartupTiming::getElapsedMs();
+
+        juce::Component::SafePointer<MainComponent> safeThis (this);
+
+        juce::Timer::callAfterDelay (startupReportTimeoutMs, [safeThis]
         {
-            Bar bar = allBars[i];
-            float barHeight = 0.0f;
-
-            if (bar.endIdx == 0) {
-                barHeight = getLevel(bar.dataIdx, windowHeight);
-
-                if (bar.factor > 0.0f) {
-                    float prevBar = bar.dataIdx > 0 ? getLevel(bar.dataIdx - 1, windowHeight) : barHeight;
-
-                    barHeight = prevBar + (barHeight - prevBar) * bar.factor;
-                }
-            } else {
-                for (int j = bar.dataIdx; j <= bar.endIdx; j++) {
-                    if (fftData[j] > barHeight) {
-                        barHeight = getLevel(j, windowHeight);
-                    }
-                }
+            // a frame that's arrived will be reported as it's painted
+            if (safeThis != nullptr && safeThis->levels.empty())
+                safeThis->reportStartup();
+        });
+    }
+
+    /** Records the first paint and then opens the device, and reports startup once the first analysed frame has been painted. */
+    void noteStartupPaint()
+    {
+        if (startupReported)
+            return;
+
+        if (firstPaintMs < 0.0)
+        {
+            firstPaintMs = StartupTiming::getElapsedMs();
+
+            if (deviceOpenPending)
+            {
+                // after this paint has reached the screen
+                deviceOpenPending = false;
+                juce::Component::SafePointer<MainComponent> safeThis (this);
+
+                juce::MessageManager::callAsync ([safeThis]
+                {
+                    if (safeThis != nullptr)
+                        safeThis->openAudioDevice();
+                });
             }
+        }
 
+        if (! levels.empty() && inputReadyMs >= 0.0)
+            reportStartup();
+    }
 
-            float posX = ((float) bar.posX * barWidth) + barSpacePx / 2.0f;
-            float adjWidth = width;
+    /** Prints the startup times once: with the first analysed frame, or without if the input stayed silent. */
+    void reportStartup()
+    {
+        if (startupReported || firstPaintMs < 0.0)
+            return;
 
-            g.fillRect(posX, barHeight, adjWidth, windowHeight - barHeight);
+        startupReported = true;
+        std::cout << "startup: first paint after " << juce::String (firstPaintMs, 0)
+                  << " ms, input ready after " << juce::String (inputReadyMs, 0) << " ms, ";
+
+        if (levels.empty())
+            std::cout << "no signal to analyse in the " << (int) startupReportTimeoutMs << " ms since" << std::endl;
+        else
+            std::cout << "first frame painted after " << juce::String (StartupTiming::getElapsedMs(), 0) << " ms" << std::endl;
+    }
+
+    /** Counters for network or file input; nothing for the audio device. */
+    void drawInputStatus (juce::Graphics& g)
+    {
+        juce::String text;
+        bool healthy = true;
+
+        if (network != nullptr)
+        {
+            auto c = network->getCounters();
+            text = "rtp  lost " + juce::String ((juce::int64) c.packetsLost) + "  late " + juce::String ((juce::int64) c.packetsLate)
+                 + "  jitter " + juce::String (c.jitterMs, 1) + " ms  buffer " + juce::String (c.bufferMs, 0)
+                 + "/" + juce::String (c.targetMs, 0) + " ms  drift " + juce::String (c.driftPpm, 0) + " ppm";
+            healthy = c.packetsReceived > 0;
         }
+        else if (follower != nullptr)
+        {
+            auto s = follower->getStatus();
+            text = s.following ? "following " + follower->getFile().getFileName() + "  " + juce::String (s.latencyMs, 0)
+                                   + " ms behind  skipped " + juce::String (s.skippedSeconds, 1) + " s"
+                               : "waiting for " + follower->getFile().getFileName() + (s.error.isNotEmpty() ? ": " + s.error : juce::String());
+            healthy = s.following;
+        }
+        else
+        {
+            return;
+        }
+
+        g.setColour (healthy ? juce::Colours::skyblue : juce::Colours::grey);
+        g.drawText (text, getSpectrumArea().reduced (8).removeFromBottom (20), juce::Justification::bottomRight);
+    }
+
+    //==============================================================================
+    /** The scope, goniometer and waterfall share a strip along the bottom, side by side if more than one is shown. */
+    void resized() override
+    {
+        auto strip = getLocalBounds().removeFromBottom (juce::roundToInt ((float) getHeight() * lowerViewProportion));
+        juce::Component* views[] = { &scope, &goniometer, &waterfall };
+        int numVisible = 0;
+
+        for (auto* view : views)
+            numVisible += view->isVisible() ? 1 : 0;
+
+        auto width = strip.getWidth() / juce::jmax (1, numVisible);
+
+        for (auto* view : views)
+            view->setBounds (view->isVisible() ? strip.removeFromLeft (width) : strip);
+    }
+
+    bool isLowerViewVisible() const
+    {
+        return scope.isVisible() || goniometer.isVisible() || waterfall.isVisible();
+    }
+
+    /** Where the bars go: the whole window, or what the lower views leave of it. */
+    juce::Rectangle<int> getSpectrumArea() const
+    {
+        auto area = getLocalBounds();
+
+        if (isLowerViewVisible())
+            area.removeFromBottom (juce::roundToInt ((float) getHeight() * lowerViewProportion));
+
+        return area;
+    }
+
+    void toggleLowerView (juce::Component& view)
+    {
+        view.setVisible (! view.isVisible());
+        resized();
+        wakeUp();
+        repaint();
+    }
+
+    /** The spectrogram costs two more transforms a frame when reassigning, so it only runs while shown. */
+    void toggleWaterfall()
+    {
+        engine.setSpectrogramEnabled (! waterfall.isVisible());
+        toggleLowerView (waterfall);
+    }
+
+    void drawStatus (juce::Graphics& g)
+    {
+        if (juce::Time::getMillisecondCounter() > statusExpiry)
+            return;
+
+        g.setColour (juce::Colours::orange);
+        g.drawText (statusText, getLocalBounds().reduced (8).removeFromTop (20), juce::Justification::topLeft);
+    }
+    
+    void drawFreezeOverlay (juce::Graphics& g)
+    {
+        if (! frozen)
+            return;
+
+        auto& history = engine.getSpectrumHistory();
+        auto stored = history.getStoredFrames();
+        auto fps = history.getFramesPerSecond();
+
+        auto text = "FROZEN  " + formatTime (-(double) (stored.getEnd() - 1 - frozenFrame) / fps)
+                  + " of " + formatTime ((double) stored.getLength() / fps)
+                  + "  (" + juce::String ((double) history.getMemoryUsed() / 1.0e6, 1) + " of "
+                  + juce::String ((double) history.getMemoryLimit() / 1.0e6, 1) + " MB)"
+                  + "   space: live  left/right: step  drag/wheel: scrub";
+
+        g.setColour (juce::Colours::cyan);
+        g.drawText (text, getSpectrumArea().reduced (8).removeFromBottom (20), juce::Justification::bottomLeft);
+    }
+    
+    static juce::String formatTime (double seconds)
+    {
+        auto sign = seconds < 0.0 ? "-" : "";
+        seconds = std::abs (seconds);
+        auto minutes = (int) (seconds / 60.0);
+
+        return sign + juce::String (minutes) + ":" + juce::String (seconds - minutes * 60.0, 1).paddedLeft ('0', 4);
+    }
+    
+    //==============================================================================
+    bool keyPressed (const juce::KeyPress& key) override
+    {
+        auto fps = engine.getSpectrumHistory().getFramesPerSecond();
+        auto stride = key.getModifiers().isShiftDown() ? (juce::int64) fps : 1;
+
+        if (key == juce::KeyPress::spaceKey)                        setFrozen (! frozen);
+        else if (key.getTextCharacter() == 's')                     toggleStatistics();
+        else if (key.getTextCharacter() == 'l')                     toggleEnvelope();
+        else if (key.getTextCharacter() == 'r')                     resetStatistics();
+        else if (key.getTextCharacter() == 'e')                     exportStatistics();
+        else if (key.getTextCharacter() == 'b')                     toggleTraining();
+        else if (key.getTextCharacter() == 't')                     cycleTriggeredView();
+        else if (key.getTextCharacter() == 'c' && averager != nullptr)  averager->reset();
+        else if (key.getTextCharacter() == 'o')                     toggleLowerView (scope);
+        else if (key.getTextCharacter() == 'g')                     toggleLowerView (goniometer);
+        else if (key.getTextCharacter() == 'w')                     toggleWaterfall();
+        else if (! frozen)                                          return false;
+        else if (key == juce::KeyPress::escapeKey)                  setFrozen (false);
+        else if (key == juce::KeyPress::leftKey)                    scrubTo (frozenFrame - stride);
+        else if (key == juce::KeyPress::rightKey)                   scrubTo (frozenFrame + stride);
+        else if (key == juce::KeyPress::homeKey)                    scrubTo (0);
+        else if (key == juce::KeyPress::endKey)                     scrubTo (std::numeric_limits<juce::int64>::max());
+        else                                                        return false;
+
+        return true;
+    }
+    
+    void mouseDown (const juce::MouseEvent&) override
+    {
+        grabKeyboardFocus();
+        dragStartFrame = frozenFrame;
+    }
+    
+    void mouseDrag (const juce::MouseEvent& e) override
+    {
+        // a pixel of drag is a tenth of a second of history
+        if (frozen)
+            scrubTo (dragStartFrame - (juce::int64) (e.getDistanceFromDragStartX() * engine.getSpectrumHistory().getFramesPerSecond() / 10.0));
+    }
+    
+    void mouseWheelMove (const juce::MouseEvent&, const juce::MouseWheelDetails& wheel) override
+    {
+        if (frozen)
+            scrubTo (frozenFrame + (juce::int64) (wheel.deltaY * 10.0f * engine.getSpectrumHistory().getFramesPerSecond()));
     }
     
-    enum
+    void setFrozen (bool shouldBeFrozen)
     {
-        // NOTE: Try increasing the FFT size and see how FPS' massively drops. Even with an fftOrder of 12.
-        // JUCE_USE_VDSP_FRAMEWORK preprocessor flag is set
-        // JUCE_COREGRAPHICS_DRAW_ASYNC preprosessor flag is set too
-        fftOrder  = 11,
-        fftSize   = 1 << fftOrder,  // 2^fftOrder | 11 = 2048 / 12 = 4096 / 13 = 8192 / 14 = 16384 / ...
-    };
+        if (shouldBeFrozen && ! engine.getSpectrumHistory().isEnabled())
+            return;
+
+        frozen = shouldBeFrozen;
+
+        if (frozen)
+        {
+            stopTimer();
+            scrubTo (std::numeric_limits<juce::int64>::max());
+        }
+        else
+        {
+            wakeUp();
+            repaint();
+        }
+    }
     
-    juce::dsp::FFT forwardFFT;                      // [4]
-    juce::dsp::WindowingFunction<float> window;     // [5]
+    void toggleStatistics()
+    {
+        showStatistics = ! showStatistics;
+        nextStatisticsRefresh = 0;
+        refreshStatistics();
+        repaint();
+    }
     
-    float fifo [fftSize];                           // [6]
-    float fftData [2 * fftSize];                    // [7]
-    int fifoIndex = 0;                              // [8]
-    bool nextFFTBlockReady = false;                 // [9]
-    std::vector<float> temperedScale;
-    std::vector<Bar> allBars;
-    float minLog;
-    double _sampleRate;
-    float minFreq = 20.0f;
-    float maxFreq = 22000.0f;
+    void resetStatistics()
+    {
+        engine.getBandStatistics().reset();
+        nextStatisticsRefresh = 0;
+        refreshStatistics();
+        repaint();
+    }
+    
+    void scrubTo (juce::int64 frame)
+    {
+        auto stored = engine.getSpectrumHistory().getStoredFrames();
+
+        if (stored.isEmpty())
+            return;
+
+        frozenFrame = juce::jlimit (stored.getStart(), stored.getEnd() - 1, frame);
+        engine.getSpectrumHistory().read (frozenFrame, frozenLevels);
+        repaint();
+    }
+    
+    //==============================================================================
+    static QualityGovernor::Level requestedQuality (const AnalysisSettings& settings)
+    {
+        QualityGovernor::Level level;
+        level.overlap = settings.overlap;
+        level.fftOrder = settings.fftOrder;
+        return level;
+    }
+    
+    void applyQuality (const QualityGovernor::Transition& transition)
+    {
+        auto& level = transition.to;
+
+        engine.setResolution (level.fftOrder, level.overlap);
+
+        if (level.frameRate != transition.from.frameRate)
+            startTimerHz (level.frameRate);
+
+        statusText = "quality " + juce::String (transition.degraded ? "reduced: " : "restored: ") + transition.describe();
+        statusExpiry = juce::Time::getMillisecondCounter() + 3000;
+        std::cout << statusText << std::endl;
+        repaint();
+    }
+    
+    static constexpr float restDecayDbPerSecond = 120.0f;
+    enum { startupReportTimeoutMs = 3000 };
+    static constexpr float lowerViewProportion = 0.35f;
+
+    AnalysisEngine engine;
+    QualityGovernor governor;
+    std::vector<float> levels;
+    juce::String statusText;
+    juce::uint32 statusExpiry = 0;
+
+    bool frozen = false;
+    juce::int64 frozenFrame = 0, dragStartFrame = 0;
+    std::vector<float> frozenLevels;
+
+    bool showStatistics = false;
+    bool showEnvelope = false;
+    AnalysisEngine::Cepstrum cepstrum;
+    BandStatistics::Summary statistics;
+    juce::uint32 nextStatisticsRefresh = 0;
+
+    juce::File baselineFile;
+    std::unique_ptr<FingerprintIndex> fingerprintIndex;
+    std::unique_ptr<FingerprintMatcher> matcher;
+    std::unique_ptr<RtpReceiver> network;
+    std::unique_ptr<WavTailFollower> follower;
+    std::unique_ptr<AudioDeviceOpener> deviceOpener;
+    juce::AudioSourcePlayer inputPlayer;    // AudioAppComponent's own is only attached by setAudioChannels()
+
+    enum class TriggeredView { live, coherent, power };
+    std::unique_ptr<TriggeredAverager> averager;
+    TriggeredView triggeredView = TriggeredView::live;
+    TriggeredAverager::Result triggered;
+    int triggerFftOrder = 11, triggerGroupNotes = 2;
+
+    ScopeView scope;
+    GoniometerView goniometer;
+    WaterfallView waterfall;
+
+    double firstPaintMs = -1.0, inputReadyMs = -1.0;
+    bool deviceOpenPending = false, startupReported = false;
     
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MainComponent)
 };
-
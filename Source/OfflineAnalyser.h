@@ -0,0 +1,107 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    Decodes an audio file for the offline tools.
+
+    Anything that works on files rather than on the live input (indexers,
+    batch reports) reads through here, so every stage sees the same mono
+    downmix in the same block sizes. readBlocks() hands out the raw samples;
+    analyseFrames() drives a SpectrumAnalyser over them the same way the
+    AnalysisEngine does live.
+*/
+class OfflineAnalyser
+{
+public:
+    OfflineAnalyser()
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    /** Opens a file; returns false and sets getError() if it can't be decoded. */
+    bool open (const juce::File& file)
+    {
+        reader.reset (formatManager.createReaderFor (file));
+
+        if (reader == nullptr)
+        {
+            error = "can't decode " + file.getFullPathName();
+            return false;
+        }
+
+        error = {};
+        return true;
+    }
+
+    const juce::String& getError() const noexcept       { return error; }
+    double getSampleRate() const noexcept               { return reader != nullptr ? reader->sampleRate : 0.0; }
+    juce::int64 getLengthInSamples() const noexcept     { return reader != nullptr ? reader->lengthInSamples : 0; }
+
+    //==============================================================================
+    /** Calls back with consecutive blocks of the whole file, downmixed to mono. */
+    void readBlocks (const std::function<void (const float* samples, int numSamples)>& callback)
+    {
+        if (reader == nullptr)
+            return;
+
+        auto numChannels = (int) reader->numChannels;
+        juce::AudioBuffer<float> buffer (numChannels, blockSize);
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples; position += blockSize)
+        {
+            auto numSamples = (int) juce::jmin ((juce::int64) blockSize, reader->lengthInSamples - position);
+            reader->read (&buffer, 0, numSamples, position, true, true);
+
+            auto* mono = buffer.getWritePointer (0);
+
+            for (int ch = 1; ch < numChannels; ++ch)
+                juce::FloatVectorOperations::add (mono, buffer.getReadPointer (ch), numSamples);
+
+            if (numChannels > 1)
+                juce::FloatVectorOperations::multiply (mono, 1.0f / (float) numChannels, numSamples);
+
+            callback (mono, numSamples);
+        }
+    }
+
+    /** Analyses a frame every hopSize samples; the callback gets the absolute sample position each frame ends at. */
+    void analyseFrames (SpectrumAnalyser& analyser, int hopSize,
+                        const std::function<void (const SpectrumAnalyser&, juce::int64 frameEnd)>& callback)
+    {
+        auto fftSize = analyser.getFFTSize();
+        std::vector<float> pending;
+        juce::int64 consumed = 0;
+
+        readBlocks ([&] (const float* samples, int numSamples)
+        {
+            pending.insert (pending.end(), samples, samples + numSamples);
+            size_t start = 0;
+
+            while (pending.size() - start >= (size_t) fftSize)
+            {
+                analyser.process (pending.data() + start);
+                callback (analyser, consumed + fftSize);
+
+                start += (size_t) hopSize;
+                consumed += hopSize;
+            }
+
+            pending.erase (pending.begin(), pending.begin() + (std::ptrdiff_t) start);
+        });
+    }
+
+private:
+    enum { blockSize = 65536 };
+
+    juce::AudioFormatManager formatManager;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::String error;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OfflineAnalyser)
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+//==============================================================================
+/**
+    Describes raw interleaved little-endian PCM and converts it to float channels.
+
+    Conversion happens in two passes over the whole block: the samples are
+    first widened to contiguous 32-bit integers (or taken as they are for
+    f32le) and scaled to floats with FloatVectorOperations, then split into
+    channels. Both passes are straight loops over contiguous memory, which
+    is what keeps them fast for long pipelines.
+*/
+struct PcmFormat
+{
+    enum class Encoding { s16le, s24le, s32le, f32le };
+
+    Encoding encoding = Encoding::s16le;
+    int numChannels = 1;
+    double sampleRate = 48000.0;
+
+    int getBytesPerSample() const noexcept      { return encoding == Encoding::s16le ? 2 : encoding == Encoding::s24le ? 3 : 4; }
+    int getBytesPerFrame() const noexcept       { return getBytesPerSample() * numChannels; }
+
+    /** Accepts the names ffmpeg uses: s16le, s24le, s32le or f32le. */
+    static bool parseEncoding (const juce::String& name, Encoding& result)
+    {
+        if (name == "s16le")        result = Encoding::s16le;
+        else if (name == "s24le")   result = Encoding::s24le;
+        else if (name == "s32le")   result = Encoding::s32le;
+        else if (name == "f32le")   result = Encoding::f32le;
+        else                        return false;
+
+        return true;
+    }
+
+    //==============================================================================
+    /** Converts numFrames interleaved frames into numChannels float channels. */
+    void convert (const char* raw, int numFrames, float* const* channels)
+    {
+        auto numSamples = numFrames * numChannels;
+        floats.resize ((size_t) numSamples);
+
+        // with one channel there's nothing to split, so convert straight into it
+        auto* dest = numChannels == 1 ? channels[0] : floats.data();
+
+        if (encoding == Encoding::f32le)
+        {
+            jassert (! juce::ByteOrder::isBigEndian());
+            memcpy (dest, raw, (size_t) numSamples * sizeof (float));
+        }
+        else
+        {
+            integers.resize ((size_t) numSamples);
+            auto* ints = integers.data();
+            auto* bytes = reinterpret_cast<const juce::uint8*> (raw);
+
+            if (encoding == Encoding::s16le)
+            {
+                for (int i = 0; i < numSamples; ++i)
+                    ints[i] = (juce::int16) (bytes[2 * i] | (bytes[2 * i + 1] << 8));
+            }
+            else if (encoding == Encoding::s32le)
+            {
+                for (int i = 0; i < numSamples; ++i)
+                    ints[i] = (int) ((juce::uint32) bytes[4 * i] | (juce::uint32) bytes[4 * i + 1] << 8 | (juce::uint32) bytes[4 * i + 2] << 16 | (juce::uint32) bytes[4 * i + 3] << 24);
+            }
+            else
+            {
+                // shifted up into the top 24 bits so the sign comes along
+                for (int i = 0; i < numSamples; ++i)
+                    ints[i] = (int) ((juce::uint32) bytes[3 * i] << 8 | (juce::uint32) bytes[3 * i + 1] << 16 | (juce::uint32) bytes[3 * i + 2] << 24) >> 8;
+            }
+
+            auto scale = encoding == Encoding::s16le ? 1.0f / 32768.0f
+                       : encoding == Encoding::s24le ? 1.0f / 8388608.0f
+                                                     : 1.0f / 2147483648.0f;
+            juce::FloatVectorOperations::convertFixedToFloat (dest, ints, scale, numSamples);
+        }
+
+        if (numChannels == 1)
+            return;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* out = channels[ch];
+            auto* in = floats.data() + ch;
+
+            for (int i = 0; i < numFrames; ++i)
+                out[i] = in[i * numChannels];
+        }
+    }
+
+private:
+    std::vector<int> integers;
+    std::vector<float> floats;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+
+//==============================================================================
+/**
+    Trades analysis and display quality for CPU time when the machine is loaded.
+
+    Analysis frames are measured against a share of the hop duration, and
+    paints against a share of the frame interval. When either stays over
+    budget, quality is stepped down one notch at a time in this order:
+
+        overlap -> FFT order -> bar level of detail -> frame rate
+
+    The analysis stages are skipped when only painting is over budget. Quality
+    is restored in the reverse order, never above what the user asked for, and
+    only after a sustained quiet period. That period doubles each time a
+    recovery has to be undone, so a borderline machine doesn't oscillate.
+
+    Every change is reported through onTransition.
+*/
+class QualityGovernor
+{
+public:
+    struct Level
+    {
+        int overlap   = 2;
+        int fftOrder  = 11;
+        int barLod    = 1;      // adjacent bars merged into one when drawing
+        int frameRate = 60;
+
+        bool operator== (const Level& other) const noexcept
+        {
+            return overlap == other.overlap && fftOrder == other.fftOrder
+                && barLod == other.barLod && frameRate == other.frameRate;
+        }
+
+        bool operator!= (const Level& other) const noexcept    { return ! operator== (other); }
+    };
+
+    enum class Stage { overlap, fftOrder, barLod, frameRate };
+
+    struct Transition
+    {
+        Stage stage;
+        bool degraded;
+        Level from, to;
+        float analysisLoad, paintLoad;
+
+        juce::String describe() const
+        {
+            static const char* const names[] = { "overlap", "fft order", "bar lod", "frame rate" };
+
+            auto value = [this] (const Level& l)
+            {
+                switch (stage)
+                {
+                    case Stage::overlap:    return l.overlap;
+                    case Stage::fftOrder:   return l.fftOrder;
+                    case Stage::barLod:     return l.barLod;
+                    case Stage::frameRate:  return l.frameRate;
+                }
+
+                return 0;
+            };
+
+            return juce::String (names[(int) stage]) + " " + juce::String (value (from)) + " -> " + juce::String (value (to))
+                     + " (analysis " + juce::String (juce::roundToInt (analysisLoad * 100.0f)) + "%, paint "
+                     + juce::String (juce::roundToInt (paintLoad * 100.0f)) + "% of budget)";
+        }
+    };
+
+    explicit QualityGovernor (Level requestedLevel)
+        : requested (requestedLevel), current (requestedLevel)
+    {
+    }
+
+    //==============================================================================
+    /** Reports the frames analysed since the last call, and the hop they ran at. */
+    void addAnalysisFrames (double totalMs, int numFrames, int numSkipped, double hopMs) noexcept
+    {
+        if (numFrames <= 0 || hopMs <= 0.0)
+            return;
+
+        auto load = (float) ((totalMs / numFrames) / (hopMs * analysisBudget));
+
+        // the worker falling behind the hop is overload whatever the timings say
+        if (numSkipped > 0)
+            load = juce::jmax (load, 2.0f);
+
+        analysisLoad += smoothing * (load - analysisLoad);
+    }
+
+    void addPaintTime (double ms) noexcept
+    {
+        auto load = (float) (ms / ((1000.0 / current.frameRate) * paintBudget));
+        paintLoad += smoothing * (load - paintLoad);
+    }
+
+    /** Call once per display frame; steps quality up or down when it is time to. */
+    void update (double nowMs)
+    {
+        // long gaps (the display was idle) don't count towards either decision
+        auto elapsed = lastUpdateMs > 0.0 ? juce::jmin ((nowMs - lastUpdateMs) / 1000.0, 0.25) : 0.0;
+        lastUpdateMs = nowMs;
+
+        if ((cooldown -= elapsed) > 0.0)
+            return;
+
+        auto overloaded = analysisLoad > 1.0f || paintLoad > 1.0f;
+        auto relaxed    = analysisLoad < recoverThreshold && paintLoad < recoverThreshold;
+
+        overloadedFor = overloaded ? overloadedFor + elapsed : 0.0;
+        relaxedFor    = relaxed    ? relaxedFor + elapsed    : 0.0;
+
+        if (overloadedFor >= degradeAfterSeconds)
+        {
+            // degrading soon after a recovery means that recovery was premature
+            if (nowMs - lastRecoveryMs < 10000.0)
+                recoverAfterSeconds = juce::jmin (recoverAfterSeconds * 2.0, maxRecoverSeconds);
+
+            step (true);
+        }
+        else if (relaxedFor >= recoverAfterSeconds)
+        {
+            if (step (false))
+                lastRecoveryMs = nowMs;
+            else
+                recoverAfterSeconds = minRecoverSeconds;    // back at full quality and stable
+        }
+    }
+
+    const Level& getLevel() const noexcept      { return current; }
+    float getAnalysisLoad() const noexcept      { return analysisLoad; }
+    float getPaintLoad() const noexcept         { return paintLoad; }
+
+    std::function<void (const Transition&)> onTransition;
+
+    static constexpr int minFftOrder   = 9;
+    static constexpr int maxBarLod     = 4;
+    static constexpr int minFrameRate  = 15;
+
+private:
+    bool step (bool degrade)
+    {
+        auto next = current;
+        Stage stage;
+
+        if (degrade)
+        {
+            auto analysisBound = analysisLoad > 1.0f;
+
+            if (analysisBound && next.overlap > 1)                      { next.overlap = juce::jmax (1, next.overlap / 2); stage = Stage::overlap; }
+            else if (analysisBound && next.fftOrder > minFftOrder)      { --next.fftOrder;     stage = Stage::fftOrder; }
+            else if (next.barLod < maxBarLod)                           { next.barLod *= 2;    stage = Stage::barLod; }
+            else if (next.frameRate > minFrameRate)                     { next.frameRate /= 2; stage = Stage::frameRate; }
+            else                                                        return false;
+        }
+        else
+        {
+            if (next.frameRate < requested.frameRate)   { next.frameRate = juce::jmin (next.frameRate * 2, requested.frameRate); stage = Stage::frameRate; }
+            else if (next.barLod > requested.barLod)    { next.barLod = juce::jmax (requested.barLod, next.barLod / 2); stage = Stage::barLod; }
+            else if (next.fftOrder < requested.fftOrder){ ++next.fftOrder;     stage = Stage::fftOrder; }
+            else if (next.overlap < requested.overlap)  { next.overlap = juce::jmin (next.overlap * 2, requested.overlap); stage = Stage::overlap; }
+            else                                        return false;
+        }
+
+        Transition transition { stage, degrade, current, next, analysisLoad, paintLoad };
+        current = next;
+
+        // measure the new configuration from scratch
+        overloadedFor = relaxedFor = 0.0;
+        cooldown = cooldownSeconds;
+        analysisLoad = paintLoad = 0.0f;
+
+        if (onTransition != nullptr)
+            onTransition (transition);
+
+        return true;
+    }
+
+    //==============================================================================
+    static constexpr float analysisBudget      = 0.5f;     // of the hop duration
+    static constexpr float paintBudget         = 0.5f;     // of the frame interval
+    static constexpr float recoverThreshold    = 0.4f;
+    static constexpr float smoothing           = 0.1f;
+    static constexpr double degradeAfterSeconds = 0.5;
+    static constexpr double cooldownSeconds     = 1.0;
+    static constexpr double minRecoverSeconds   = 5.0;
+    static constexpr double maxRecoverSeconds   = 80.0;
+
+    const Level requested;
+    Level current;
+
+    float analysisLoad = 0.0f, paintLoad = 0.0f;
+    double lastUpdateMs = 0.0, lastRecoveryMs = -1.0e9;
+    double overloadedFor = 0.0, relaxedFor = 0.0, cooldown = 0.0;
+    double recoverAfterSeconds = minRecoverSeconds;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (QualityGovernor)
+};
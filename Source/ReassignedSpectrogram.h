@@ -0,0 +1,255 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    A scrolling spectrogram on the tempered-scale bands, optionally reassigned.
+
+    A plain spectrogram smears each bin's energy over the whole frame and the
+    whole bin. Reassignment moves it to where it came from: alongside the usual
+    Hann-windowed FFT, the frame is also transformed with the window's time
+    derivative and with a time-ramped window, and from the three spectra every
+    bin gets an instantaneous frequency and a group delay. Its energy is added
+    to the display cell at those coordinates instead, so tones collapse to
+    lines and transients to edges far sharper than a longer FFT would give.
+
+    The grid is a ring of columns, one per columnSamples of input, with a row
+    per band. A column is finished once no later frame can still add to it;
+    readers copy finished columns out. The three windowed copies are made with
+    FloatVectorOperations and the transforms run back to back; the time this
+    takes is measured so the display can report it.
+
+    Runs on the analysis thread; only the finished columns and the timing are
+    shared, under a lock held for a copy.
+*/
+class ReassignedSpectrogram
+{
+public:
+    ReassignedSpectrogram() = default;
+
+    /** Clears the grid and sets everything up for a new frame size, hop or banding. */
+    void prepare (int fftOrder, double newSampleRate, const std::vector<float>& bandFrequencies, int newColumnSamples)
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+
+        fftSize = 1 << fftOrder;
+        sampleRate = newSampleRate;
+        columnSamples = juce::jmax (1, newColumnSamples);
+        numBands = (int) bandFrequencies.size();
+        normalisationDb = juce::Decibels::gainToDecibels ((float) fftSize);
+
+        fft.reset (new juce::dsp::FFT (fftOrder));
+        plain.assign ((size_t) (2 * fftSize), 0.0f);
+        derivative.assign ((size_t) (2 * fftSize), 0.0f);
+        ramped.assign ((size_t) (2 * fftSize), 0.0f);
+        buildWindows();
+
+        // tempered-scale bands are evenly spaced in log frequency
+        lowestBand = numBands > 0 ? std::log ((double) bandFrequencies.front()) : 0.0;
+        bandsPerLogUnit = numBands > 1 ? (numBands - 1) / (std::log ((double) bandFrequencies.back()) - lowestBand) : 1.0;
+
+        grid.assign ((size_t) (numColumns * numBands), 0.0f);
+        started = false;
+        finishedColumns = 0;
+        averageMs = 0.0;
+    }
+
+    /** Moves energy to its reassigned coordinates, or leaves it at the bin and frame centres. Safe from any thread. */
+    void setReassigning (bool shouldReassign) noexcept          { reassigning = shouldReassign; }
+    bool isReassigning() const noexcept                         { return reassigning; }
+
+    /** Adds one frame of fftSize samples that ends at the absolute position frameEnd. */
+    void process (const float* frame, juce::int64 frameEnd)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        auto reassign = reassigning.load();
+
+        juce::FloatVectorOperations::multiply (plain.data(), frame, window.data(), fftSize);
+        fft->performRealOnlyForwardTransform (plain.data(), true);
+
+        if (reassign)
+        {
+            juce::FloatVectorOperations::multiply (derivative.data(), frame, windowDerivative.data(), fftSize);
+            juce::FloatVectorOperations::multiply (ramped.data(), frame, rampedWindow.data(), fftSize);
+            fft->performRealOnlyForwardTransform (derivative.data(), true);
+            fft->performRealOnlyForwardTransform (ramped.data(), true);
+        }
+
+        const juce::SpinLock::ScopedLockType sl (lock);
+
+        // the ramp is centred on the middle of the window, between two samples for an even size
+        auto frameCentre = (double) (frameEnd - fftSize) + (fftSize - 1) * 0.5;
+        auto firstColumn = (juce::int64) std::floor ((double) (frameEnd - fftSize) / columnSamples);
+
+        // the first frame, a restarted input, or a gap too long to step over: start a fresh grid
+        if (! started || firstColumn < finishedColumns || firstColumn - finishedColumns > numColumns / 2)
+        {
+            std::fill (grid.begin(), grid.end(), 0.0f);
+            finishedColumns = juce::jmax ((juce::int64) 0, firstColumn);
+            started = true;
+        }
+
+        // everything before this frame's start can't get any more energy
+        finishColumns (firstColumn);
+        accumulate (frameCentre, reassign);
+
+        auto elapsedMs = std::chrono::duration<double, std::milli> (std::chrono::high_resolution_clock::now() - start).count();
+        averageMs += 0.05 * (elapsedMs - averageMs);
+    }
+
+    //==============================================================================
+    /** The grid's layout; a reader should start again when any of these change. */
+    int getNumBands() const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+        return numBands;
+    }
+
+    int getColumnSamples() const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+        return columnSamples;
+    }
+
+    double getSampleRate() const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+        return sampleRate;
+    }
+
+    /** How many columns have been finished since prepare(). */
+    juce::int64 getNumFinishedColumns() const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+        return finishedColumns;
+    }
+
+    /** Copies one finished column's band levels in dB; false if it's no longer (or not yet) held. */
+    bool readColumn (juce::int64 column, float* dest) const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+
+        if (column >= finishedColumns || column < finishedColumns - numColumns / 2)
+            return false;
+
+        auto* cell = grid.data() + (size_t) (column % numColumns) * (size_t) numBands;
+
+        for (int b = 0; b < numBands; ++b)
+            dest[b] = juce::jlimit (SpectrumAnalyser::mindB, SpectrumAnalyser::maxdB,
+                                    juce::Decibels::gainToDecibels (cell[b], -200.0f) * 0.5f - normalisationDb);
+
+        return true;
+    }
+
+    /** How long a frame takes, smoothed; compare with the hop to see what it costs. */
+    double getAverageMs() const
+    {
+        const juce::SpinLock::ScopedLockType sl (lock);
+        return averageMs;
+    }
+
+private:
+    //==============================================================================
+    void buildWindows()
+    {
+        window.resize ((size_t) fftSize);
+        windowDerivative.resize ((size_t) fftSize);
+        rampedWindow.resize ((size_t) fftSize);
+
+        // Hann normalised to a mean of 1, as SpectrumAnalyser's WindowingFunction is, with its
+        // derivative per sample and its time-weighted copy
+        auto span = (double) (fftSize - 1);
+        auto w = juce::MathConstants<double>::twoPi / span;
+        auto gain = 2.0 * fftSize / span;   // the sum of the raw Hann is span / 2
+
+        for (int n = 0; n < fftSize; ++n)
+        {
+            window[(size_t) n] = (float) (gain * (0.5 - 0.5 * std::cos (w * n)));
+            windowDerivative[(size_t) n] = (float) (gain * 0.5 * w * std::sin (w * n));
+            rampedWindow[(size_t) n] = (float) ((n - span * 0.5) * window[(size_t) n]);
+        }
+    }
+
+    /** Adds each bin's power at its (reassigned) time and band. */
+    void accumulate (double frameCentre, bool reassign) noexcept
+    {
+        auto numBins = fftSize / 2;
+        auto binsToRadians = juce::MathConstants<double>::twoPi / fftSize;
+        auto hzPerBin = sampleRate / fftSize;
+
+        // well below the quietest level drawn: not worth placing, and unstable to reassign
+        auto floor = std::pow ((double) fftSize, 2.0) * 1.0e-11;
+
+        for (int k = 1; k < numBins; ++k)
+        {
+            auto re = (double) plain[(size_t) (2 * k)], im = (double) plain[(size_t) (2 * k + 1)];
+            auto power = re * re + im * im;
+
+            if (power < floor)
+                continue;
+
+            auto bin = (double) k;
+            auto time = frameCentre;
+
+            if (reassign)
+            {
+                auto dre = (double) derivative[(size_t) (2 * k)], dim = (double) derivative[(size_t) (2 * k + 1)];
+                auto tre = (double) ramped[(size_t) (2 * k)], tim = (double) ramped[(size_t) (2 * k + 1)];
+
+                // omega - Im{X_dh X*} / |X|^2 and t + Re{X_th X*} / |X|^2
+                bin -= (dim * re - dre * im) / power / binsToRadians;
+                time += (tre * re + tim * im) / power;
+
+                if (bin <= 0.0 || bin >= numBins || std::abs (time - frameCentre) > fftSize * 0.5)
+                    continue;
+            }
+
+            auto band = juce::roundToInt ((std::log (bin * hzPerBin) - lowestBand) * bandsPerLogUnit);
+            auto column = (juce::int64) std::floor (time / columnSamples);
+
+            if (! juce::isPositiveAndBelow (band, numBands) || column < finishedColumns)
+                continue;
+
+            grid[(size_t) (column % numColumns) * (size_t) numBands + (size_t) band] += (float) power;
+        }
+    }
+
+    /** Makes columns before upTo readable and clears their slots' successors for reuse. */
+    void finishColumns (juce::int64 upTo) noexcept
+    {
+        for (; finishedColumns < upTo; ++finishedColumns)
+        {
+            // the slot half a ring ahead is the next to be written; readers never go back that far
+            auto reuse = (size_t) ((finishedColumns + numColumns / 2) % numColumns) * (size_t) numBands;
+            std::fill (grid.begin() + (std::ptrdiff_t) reuse, grid.begin() + (std::ptrdiff_t) (reuse + (size_t) numBands), 0.0f);
+        }
+    }
+
+    //==============================================================================
+    enum { numColumns = 2048 };
+
+    int fftSize = 0, columnSamples = 1, numBands = 0;
+    double sampleRate = 44100.0;
+    float normalisationDb = 0.0f;
+    std::atomic<bool> reassigning { true };
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> window, windowDerivative, rampedWindow;
+    std::vector<float> plain, derivative, ramped;
+    double lowestBand = 0.0, bandsPerLogUnit = 1.0;
+
+    juce::SpinLock lock;
+    std::vector<float> grid;
+    juce::int64 finishedColumns = 0;
+    bool started = false;
+    double averageMs = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReassignedSpectrogram)
+};
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "ThreadPlacement.h"
+
+//==============================================================================
+/**
+    Receives an RTP L16 or L24 stream (RFC 3551) and plays it out like an
+    audio device would, in fixed blocks paced by the local clock.
+
+    A single thread does both jobs: it waits on the socket until the next
+    block is due, files every packet that arrives into the jitter buffer and
+    then hands the block to onBlock. Nothing is shared with other threads but
+    the counters, so the buffer itself needs no locking.
+
+    The jitter buffer is a ring addressed by RTP timestamp. Playout runs
+    targetDelay behind the newest packet; the target follows the RFC 3550
+    interarrival jitter estimate, rising at once and falling back slowly.
+    Packets that arrive after their samples were played are counted as late
+    and dropped. Gaps are concealed by repeating the previous packet's worth
+    of audio, fading out over a few tens of milliseconds.
+
+    The sender's clock and ours never quite agree, so the buffer slowly fills
+    or drains. Playout is resampled by a ratio within half a percent of 1 that
+    steers the buffered amount back to the target; the long-term average of
+    that correction is the drift, reported in ppm. If the buffer gets far off
+    target anyway (the sender restarted, or a long outage) playout resyncs.
+*/
+class RtpReceiver  : private juce::Thread
+{
+public:
+    /** What to listen for; the payload format isn't in the packets, so it has to be given. */
+    struct Format
+    {
+        enum class Encoding { l16, l24 };
+
+        int port = 0;                   // 0 disables network input
+        juce::String multicastGroup;
+        Encoding encoding = Encoding::l24;
+        int numChannels = 2;
+        double sampleRate = 48000.0;
+        int payloadType = -1;           // -1 accepts any
+        ThreadPlacement placement;
+
+        bool isEnabled() const noexcept         { return port > 0; }
+        int getBytesPerSample() const noexcept  { return encoding == Encoding::l16 ? 2 : 3; }
+
+        static Format fromArguments (const juce::ArgumentList& args)
+        {
+            Format format;
+
+            if (args.containsOption ("--rtp-port"))
+                format.port = juce::jlimit (0, 65535, args.getValueForOption ("--rtp-port").getIntValue());
+
+            format.multicastGroup = args.getValueForOption ("--rtp-group");
+
+            if (args.getValueForOption ("--rtp-format") == "l16")
+                format.encoding = Encoding::l16;
+
+            if (args.containsOption ("--rtp-channels"))
+                format.numChannels = juce::jlimit (1, 64, args.getValueForOption ("--rtp-channels").getIntValue());
+
+            if (args.containsOption ("--rtp-rate"))
+                format.sampleRate = juce::jlimit (8000.0, 192000.0, args.getValueForOption ("--rtp-rate").getDoubleValue());
+
+            if (args.containsOption ("--rtp-payload-type"))
+                format.payloadType = juce::jlimit (0, 127, args.getValueForOption ("--rtp-payload-type").getIntValue());
+
+            format.placement = ThreadPlacement::fromArguments (args, "--rtp");
+            return format;
+        }
+    };
+
+    struct Counters
+    {
+        juce::uint64 packetsReceived = 0;
+        juce::uint64 packetsLost = 0;       // never arrived (RFC 3550: expected - received)
+        juce::uint64 packetsLate = 0;       // arrived after their samples were played
+        juce::uint64 packetsInvalid = 0;    // not RTP, or not the configured payload
+        juce::uint64 samplesConcealed = 0;
+        int resyncs = 0;
+        double jitterMs = 0.0, bufferMs = 0.0, targetMs = 0.0;
+        double driftPpm = 0.0;              // positive when the sender's clock runs fast
+    };
+
+    explicit RtpReceiver (const Format& formatToUse)
+        : juce::Thread ("RTP receiver"),
+          format (formatToUse)
+    {
+        capacity = juce::nextPowerOfTwo ((int) (format.sampleRate * ringSeconds));
+        ring.setSize (format.numChannels, capacity);
+        ring.clear();
+        present.assign ((size_t) capacity, 0);
+        fetched.setSize (format.numChannels, blockSize * 2 + 8);
+        block.setSize (format.numChannels, blockSize);
+        interpolators.resize ((size_t) format.numChannels);
+        targetDelay = format.sampleRate * minDelaySeconds;
+    }
+
+    ~RtpReceiver() override
+    {
+        stopReceiving();
+    }
+
+    /** Opens the socket and starts the thread; returns false with the reason if the port can't be bound. */
+    bool startReceiving (juce::String& error)
+    {
+        socket.reset (new juce::DatagramSocket (false));
+        socket->setEnablePortReuse (format.multicastGroup.isNotEmpty());
+
+        if (! socket->bindToPort (format.port))
+        {
+            error = "can't listen on UDP port " + juce::String (format.port);
+            return false;
+        }
+
+        if (format.multicastGroup.isNotEmpty() && ! socket->joinMulticast (format.multicastGroup))
+        {
+            error = "can't join multicast group " + format.multicastGroup;
+            return false;
+        }
+
+        startThread();
+        return true;
+    }
+
+    void stopReceiving()
+    {
+        signalThreadShouldExit();
+
+        if (socket != nullptr)
+            socket->shutdown();
+
+        stopThread (2000);
+        socket = nullptr;
+    }
+
+    const Format& getFormat() const noexcept    { return format; }
+
+    Counters getCounters() const
+    {
+        const juce::SpinLock::ScopedLockType sl (countersLock);
+        return counters;
+    }
+
+    /** Called on the receiver thread with each block of blockSize samples, once the stream has started. */
+    std::function<void (const float* const* channelData, int numChannels, int numSamples)> onBlock;
+
+    enum { blockSize = 256 };
+
+private:
+    //==============================================================================
+    void run() override
+    {
+        std::cout << "rtp thread: " << format.placement.applyToCurrentThread() << std::endl;
+
+        auto blockMs = 1000.0 * blockSize / format.sampleRate;
+        auto nextBlockDue = juce::Time::getMillisecondCounterHiRes() + blockMs;
+
+        while (! threadShouldExit())
+        {
+            auto waitMs = (int) std::ceil (nextBlockDue - juce::Time::getMillisecondCounterHiRes());
+            auto ready = socket->waitUntilReady (true, juce::jmax (0, waitMs));
+
+            if (ready < 0)
+                break;
+
+            if (ready > 0)
+                receivePackets();
+
+            auto now = juce::Time::getMillisecondCounterHiRes();
+
+            if (now < nextBlockDue)
+                continue;
+
+            // after a stall (e.g. the machine slept) skip ahead rather than catching up in a burst
+            if (now - nextBlockDue > 200.0)
+                nextBlockDue = now;
+
+            if (started)
+                playBlock();
+
+            nextBlockDue += blockMs;
+        }
+    }
+
+    void receivePackets()
+    {
+        juce::String senderAddress;
+        int senderPort = 0;
+
+        for (;;)
+        {
+            auto numBytes = socket->read (packet, (int) sizeof (packet), false, senderAddress, senderPort);
+
+            if (numBytes <= 0)
+                return;
+
+            fileIntoBuffer (numBytes, juce::Time::getMillisecondCounterHiRes());
+        }
+    }
+
+    //==============================================================================
+    void fileIntoBuffer (int numBytes, double arrivalMs)
+    {
+        auto payloadType = packet[1] & 0x7f;
+
+        if (numBytes < 12 || (packet[0] >> 6) != 2 || (format.payloadType >= 0 && payloadType != format.payloadType))
+        {
+            countInvalid();
+            return;
+        }
+
+        auto sequence = (juce::uint16) (packet[2] << 8 | packet[3]);
+        auto timestamp = readBigEndian32 (packet + 4);
+        auto ssrc = readBigEndian32 (packet + 8);
+
+        auto headerSize = 12 + 4 * (packet[0] & 0x0f);
+
+        if ((packet[0] & 0x10) != 0 && numBytes >= headerSize + 4)
+            headerSize += 4 + 4 * (packet[headerSize + 2] << 8 | packet[headerSize + 3]);
+
+        auto payloadSize = numBytes - headerSize;
+
+        if ((packet[0] & 0x20) != 0)
+            payloadSize -= packet[numBytes - 1];
+
+        auto bytesPerFrame = format.getBytesPerSample() * format.numChannels;
+        auto numFrames = payloadSize / bytesPerFrame;
+
+        if (payloadSize <= 0 || numFrames == 0)
+        {
+            countInvalid();
+            return;
+        }
+
+        if (! started || ssrc != currentSsrc)
+            startStream (ssrc, sequence, timestamp);
+
+        auto position = extendTimestamp (timestamp);
+        packetFrames = numFrames;
+        lastArrivalMs = arrivalMs;
+        updateSequence (sequence);
+        updateJitter (position, arrivalMs);
+
+        if (position + numFrames <= readPosition)
+        {
+            const juce::SpinLock::ScopedLockType sl (countersLock);
+            ++counters.packetsLate;
+
+            // it was late, so the delay is too short for this network: wait one packet longer
+            targetDelay = juce::jmin (targetDelay + numFrames, format.sampleRate * maxDelaySeconds);
+            return;
+        }
+
+        // too far ahead to fit: everything buffered is stale
+        if (position + numFrames - readPosition > capacity - blockSize * 2)
+            resync (position, true);
+
+        newestPosition = juce::jmax (newestPosition, position + numFrames);
+        writePayload (packet + headerSize, position, numFrames);
+    }
+
+    void writePayload (const juce::uint8* payload, juce::int64 position, int numFrames) noexcept
+    {
+        auto bytesPerSample = format.getBytesPerSample();
+        auto scale = format.encoding == Format::Encoding::l16 ? 1.0f / 32768.0f : 1.0f / 8388608.0f;
+
+        for (int i = 0; i < numFrames; ++i, ++position)
+        {
+            if (position < readPosition)
+            {
+                payload += bytesPerSample * format.numChannels;
+                continue;
+            }
+
+            auto slot = (int) (position & (capacity - 1));
+
+            // network byte order
+            for (int ch = 0; ch < format.numChannels; ++ch, payload += bytesPerSample)
+            {
+                auto value = bytesPerSample == 2 ? (int) (juce::int16) (payload[0] << 8 | payload[1])
+                                                 : (int) ((juce::uint32) payload[0] << 24 | (juce::uint32) payload[1] << 16 | (juce::uint32) payload[2] << 8) >> 8;
+                ring.getWritePointer (ch)[slot] = (float) value * scale;
+            }
+
+            present[(size_t) slot] = 1;
+        }
+    }
+
+    //==============================================================================
+    void startStream (juce::uint32 ssrc, juce::uint16 sequence, juce::uint32 timestamp)
+    {
+        {
+            const juce::SpinLock::ScopedLockType sl (countersLock);
+            lostInEarlierStreams = counters.packetsLost;
+        }
+
+        currentSsrc = ssrc;
+        baseSequence = highestSequence = (juce::int64) sequence;
+        receivedThisStream = 0;
+        lastTimestamp = timestamp;
+        extendedTimestamp = (juce::int64) timestamp;
+        jitter = 0.0;
+        lastTransit = 0.0;
+        hasTransit = false;
+        started = true;
+        resync ((juce::int64) timestamp, true);
+    }
+
+    /** Restarts playout targetDelay behind position, keeping what's buffered unless it's all stale. */
+    void resync (juce::int64 position, bool discardBuffered)
+    {
+        auto newReadPosition = position - (juce::int64) targetDelay;
+
+        if (discardBuffered)
+        {
+            std::fill (present.begin(), present.end(), 0);
+            ring.clear();
+        }
+        else
+        {
+            // skipped slots would otherwise look filled when the ring comes round to them again
+            for (auto p = readPosition; p < juce::jmin (newReadPosition, readPosition + capacity); ++p)
+                present[(size_t) (p & (capacity - 1))] = 0;
+        }
+
+        readPosition = newReadPosition;
+        newestPosition = juce::jmax (newestPosition, position);
+        lastPresentPosition = readPosition;
+        smoothedFill = targetDelay;
+        correction = 0.0;
+
+        for (auto& interpolator : interpolators)
+            interpolator.reset();
+
+        const juce::SpinLock::ScopedLockType sl (countersLock);
+        ++counters.resyncs;
+    }
+
+    /** Unwraps the 32-bit RTP timestamp around the last one seen. */
+    juce::int64 extendTimestamp (juce::uint32 timestamp) noexcept
+    {
+        extendedTimestamp += (juce::int32) (timestamp - lastTimestamp);
+        lastTimestamp = timestamp;
+        return extendedTimestamp;
+    }
+
+    void updateSequence (juce::uint16 sequence)
+    {
+        auto extended = highestSequence + (juce::int16) (sequence - (juce::uint16) highestSequence);
+        highestSequence = juce::jmax (highestSequence, extended);
+        ++receivedThisStream;
+
+        auto expected = highestSequence - baseSequence + 1;
+
+        const juce::SpinLock::ScopedLockType sl (countersLock);
+        ++counters.packetsReceived;
+        counters.packetsLost = lostInEarlierStreams + (juce::uint64) juce::jmax ((juce::int64) 0, expected - receivedThisStream);
+    }
+
+    /** RFC 3550 section 6.4.1, in samples, and the delay it calls for. */
+    void updateJitter (juce::int64 position, double arrivalMs) noexcept
+    {
+        auto transit = arrivalMs * 0.001 * format.sampleRate - (double) position;
+
+        if (hasTransit)
+            jitter += (std::abs (transit - lastTransit) - jitter) / 16.0;
+
+        lastTransit = transit;
+        hasTransit = true;
+
+        auto wanted = juce::jlimit (format.sampleRate * minDelaySeconds, format.sampleRate * maxDelaySeconds,
+                                    (double) (packetFrames + blockSize) + 4.0 * jitter);
+
+        // rise at once, fall back over several seconds
+        if (wanted > targetDelay)
+            targetDelay = wanted;
+        else
+            targetDelay += 0.002 * (wanted - targetDelay);
+    }
+
+    //==============================================================================
+    void playBlock()
+    {
+        steerTowardsTarget();
+
+        auto ratio = 1.0 + correction;
+        auto numToFetch = (int) std::ceil (blockSize * ratio) + 4;
+        fetch (numToFetch);
+
+        int numUsed = 0;
+
+        for (int ch = 0; ch < format.numChannels; ++ch)
+            numUsed = interpolators[(size_t) ch].process (ratio, fetched.getReadPointer (ch), block.getWritePointer (ch), blockSize);
+
+        juce::uint64 concealed = 0;
+
+        for (int i = 0; i < numUsed; ++i)
+        {
+            auto slot = (size_t) ((readPosition + i) & (capacity - 1));
+            concealed += present[slot] == 0 ? 1 : 0;
+            present[slot] = 0;
+        }
+
+        readPosition += numUsed;
+
+        {
+            const juce::SpinLock::ScopedLockType sl (countersLock);
+            counters.samplesConcealed += concealed;
+            counters.jitterMs = 1000.0 * jitter / format.sampleRate;
+            counters.bufferMs = 1000.0 * smoothedFill / format.sampleRate;
+            counters.targetMs = 1000.0 * targetDelay / format.sampleRate;
+            counters.driftPpm = driftPpm;
+        }
+
+        if (onBlock != nullptr)
+            onBlock (block.getArrayOfReadPointers(), format.numChannels, blockSize);
+    }
+
+    void steerTowardsTarget()
+    {
+        // nothing is arriving: just conceal, there's nothing to steer by
+        if (juce::Time::getMillisecondCounterHiRes() - lastArrivalMs > stallMs)
+        {
+            correction = 0.0;
+            return;
+        }
+
+        auto fill = (double) (newestPosition - readPosition);
+        smoothedFill += 0.02 * (fill - smoothedFill);
+
+        // hopelessly off: start again from the newest packet rather than crawl back
+        if (std::abs (smoothedFill - targetDelay) > format.sampleRate * maxDelaySeconds)
+        {
+            resync (newestPosition, false);
+            return;
+        }
+
+        // proportional steering: being a target's worth off corrects by settleSeconds' worth of drift
+        correction = juce::jlimit (-maxCorrection, maxCorrection, (smoothedFill - targetDelay) / (format.sampleRate * settleSeconds));
+        driftPpm += 0.001 * (correction * 1.0e6 - driftPpm);
+    }
+
+    /** Copies the next numToFetch samples into fetched, concealing whatever hasn't arrived. */
+    void fetch (int numToFetch) noexcept
+    {
+        auto period = (juce::int64) juce::jmax (packetFrames, (int) (format.sampleRate * 0.001));
+        auto fadeSamples = format.sampleRate * concealmentFadeSeconds;
+
+        for (int i = 0; i < numToFetch; ++i)
+        {
+            auto position = readPosition + i;
+            auto slot = (int) (position & (capacity - 1));
+
+            if (present[(size_t) slot] != 0)
+            {
+                lastPresentPosition = position;
+            }
+            else
+            {
+                // repeat the last packet's worth, fading; written back so longer gaps keep repeating it
+                auto gain = (float) std::exp (-(double) (position - lastPresentPosition) / fadeSamples);
+                auto source = (int) ((position - period) & (capacity - 1));
+
+                for (int ch = 0; ch < format.numChannels; ++ch)
+                    ring.getWritePointer (ch)[slot] = ring.getReadPointer (ch)[source] * gain;
+            }
+
+            for (int ch = 0; ch < format.numChannels; ++ch)
+                fetched.getWritePointer (ch)[i] = ring.getReadPointer (ch)[slot];
+        }
+    }
+
+    //==============================================================================
+    void countInvalid()
+    {
+        const juce::SpinLock::ScopedLockType sl (countersLock);
+        ++counters.packetsInvalid;
+    }
+
+    static juce::uint32 readBigEndian32 (const juce::uint8* p) noexcept
+    {
+        return (juce::uint32) p[0] << 24 | (juce::uint32) p[1] << 16 | (juce::uint32) p[2] << 8 | (juce::uint32) p[3];
+    }
+
+    static constexpr double ringSeconds = 2.0;
+    static constexpr double minDelaySeconds = 0.01;
+    static constexpr double maxDelaySeconds = 0.5;
+    static constexpr double maxCorrection = 0.005;
+    static constexpr double settleSeconds = 4.0;
+    static constexpr double concealmentFadeSeconds = 0.01;
+    static constexpr double stallMs = 250.0;
+
+    const Format format;
+    std::unique_ptr<juce::DatagramSocket> socket;
+    juce::uint8 packet[9000];   // a jumbo frame
+
+    // jitter buffer, touched only by the receiver thread
+    int capacity = 0;
+    juce::AudioBuffer<float> ring, fetched, block;
+    std::vector<juce::uint8> present;
+    std::vector<juce::LagrangeInterpolator> interpolators;
+    juce::int64 readPosition = 0, newestPosition = 0, lastPresentPosition = 0;
+    int packetFrames = 0;
+    double targetDelay = 0.0, smoothedFill = 0.0, correction = 0.0, driftPpm = 0.0;
+
+    // stream state
+    bool started = false;
+    juce::uint32 currentSsrc = 0, lastTimestamp = 0;
+    juce::int64 extendedTimestamp = 0, baseSequence = 0, highestSequence = 0, receivedThisStream = 0;
+    double jitter = 0.0, lastTransit = 0.0, lastArrivalMs = 0.0;
+    bool hasTransit = false;
+    juce::uint64 lostInEarlierStreams = 0;
+
+    juce::SpinLock countersLock;
+    Counters counters;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RtpReceiver)
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "RtpReceiver.h"
+
+//==============================================================================
+/**
+    Streams an audio file as RTP, in real time, for testing RtpReceiver over
+    loopback or the LAN.
+
+    The network can be made worse on purpose: packets can be dropped at
+    random, held back by a random delay (which also reorders them), and the
+    whole stream can run a few ppm fast or slow to exercise drift compensation.
+*/
+class RtpSender
+{
+public:
+    struct Impairments
+    {
+        float lossProbability = 0.0f;
+        double maxJitterMs = 0.0;
+        double driftPpm = 0.0;      // positive runs fast
+    };
+
+    /** Sends the whole file, blocking until done; returns false with the reason if it couldn't start. */
+    static bool sendFile (const juce::File& file, const juce::String& host, const RtpReceiver::Format& format,
+                          double packetMs, const Impairments& impairments, juce::String& error)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+        std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (file));
+
+        if (reader == nullptr)
+        {
+            error = "can't read " + file.getFullPathName();
+            return false;
+        }
+
+        if (reader->sampleRate != format.sampleRate)
+            std::cout << "note: " << file.getFileName() << " is " << reader->sampleRate
+                      << " Hz, sent as-is but labelled " << format.sampleRate << " Hz" << std::endl;
+
+        juce::DatagramSocket socket (false);
+
+        if (! socket.bindToPort (0))
+        {
+            error = "can't open a UDP socket";
+            return false;
+        }
+
+        auto packetFrames = juce::jmax (1, (int) (format.sampleRate * packetMs / 1000.0));
+        auto bytesPerFrame = format.getBytesPerSample() * format.numChannels;
+        juce::AudioBuffer<float> buffer (format.numChannels, packetFrames);
+        juce::Random random;
+
+        struct Pending
+        {
+            double due;
+            std::vector<juce::uint8> bytes;
+        };
+
+        std::vector<Pending> pending;
+        juce::uint16 sequence = (juce::uint16) random.nextInt();
+        auto timestamp = (juce::uint32) random.nextInt();
+        auto ssrc = (juce::uint32) random.nextInt();
+
+        auto packetInterval = packetFrames * 1000.0 / format.sampleRate / (1.0 + impairments.driftPpm * 1.0e-6);
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        int numSent = 0, numDropped = 0;
+
+        for (juce::int64 position = 0; position < reader->lengthInSamples || ! pending.empty();)
+        {
+            auto now = juce::Time::getMillisecondCounterHiRes();
+
+            for (auto it = pending.begin(); it != pending.end();)
+            {
+                if (it->due > now)
+                {
+                    ++it;
+                    continue;
+                }
+
+                socket.write (host, format.port, it->bytes.data(), (int) it->bytes.size());
+                it = pending.erase (it);
+                ++numSent;
+            }
+
+            if (position < reader->lengthInSamples && now >= start + packetInterval * (double) (position / packetFrames))
+            {
+                buffer.clear();
+                reader->read (&buffer, 0, packetFrames, position, true, true);
+
+                Pending p;
+                p.due = now + impairments.maxJitterMs * random.nextFloat();
+                p.bytes.resize ((size_t) (12 + packetFrames * bytesPerFrame));
+                writeHeader (p.bytes.data(), sequence++, timestamp, ssrc);
+                writePayload (buffer, format, p.bytes.data() + 12);
+                timestamp += (juce::uint32) packetFrames;
+                position += packetFrames;
+
+                if (random.nextFloat() < impairments.lossProbability)
+                    ++numDropped;
+                else
+                    pending.push_back (std::move (p));
+
+                continue;
+            }
+
+            juce::Thread::sleep (1);
+        }
+
+        std::cout << "sent " << numSent << " packets, dropped " << numDropped << std::endl;
+        return true;
+    }
+
+private:
+    static void writeHeader (juce::uint8* p, juce::uint16 sequence, juce::uint32 timestamp, juce::uint32 ssrc) noexcept
+    {
+        p[0] = 0x80;                        // version 2, no padding, extension or CSRCs
+        p[1] = (juce::uint8) payloadType;
+        p[2] = (juce::uint8) (sequence >> 8);
+        p[3] = (juce::uint8) sequence;
+        writeBigEndian32 (p + 4, timestamp);
+        writeBigEndian32 (p + 8, ssrc);
+    }
+
+    static void writePayload (const juce::AudioBuffer<float>& buffer, const RtpReceiver::Format& format, juce::uint8* p) noexcept
+    {
+        auto l16 = format.encoding == RtpReceiver::Format::Encoding::l16;
+        auto scale = l16 ? 32767.0f : 8388607.0f;
+
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        {
+            for (int ch = 0; ch < format.numChannels; ++ch)
+            {
+                auto value = juce::roundToInt (juce::jlimit (-1.0f, 1.0f, buffer.getReadPointer (ch)[i]) * scale);
+
+                if (! l16)
+                    *p++ = (juce::uint8) (value >> 16);
+
+                *p++ = (juce::uint8) (value >> 8);
+                *p++ = (juce::uint8) value;
+            }
+        }
+    }
+
+    static void writeBigEndian32 (juce::uint8* p, juce::uint32 value) noexcept
+    {
+        p[0] = (juce::uint8) (value >> 24);
+        p[1] = (juce::uint8) (value >> 16);
+        p[2] = (juce::uint8) (value >> 8);
+        p[3] = (juce::uint8) value;
+    }
+
+    enum { payloadType = 96 };      // dynamic, as is usual for L24 and non-44.1 kHz L16
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+
+//==============================================================================
+/**
+    A fixed-size ring holding the most recent input samples of each channel.
+
+    The audio thread is the only writer; readers on other threads copy any
+    window that ends at or before getWritePosition(). Positions are absolute
+    sample counts since the start of the stream, so readers can ask for a
+    window by where it ends rather than by where the ring happens to wrap.
+
+    The ring is many times longer than the largest FFT frame, so a reader
+    copying a recent window never races with the writer lapping it.
+*/
+class SampleHistory
+{
+public:
+    enum
+    {
+        capacityOrder = 19,                    // ~11 s at 48 kHz
+        capacity      = 1 << capacityOrder,
+        mask          = capacity - 1
+    };
+
+    explicit SampleHistory (int numChannelsToKeep = 1)
+        : numChannels (numChannelsToKeep),
+          buffers ((size_t) numChannelsToKeep, std::vector<float> ((size_t) capacity, 0.0f))
+    {
+    }
+
+    int getNumChannels() const noexcept         { return numChannels; }
+
+    /** Total number of samples written so far. */
+    juce::int64 getWritePosition() const noexcept   { return writePosition.load (std::memory_order_acquire); }
+
+    //==============================================================================
+    /** Called on the audio thread. Missing channels are written as silence. */
+    void write (const float* const* channelData, int numChannelsIn, int numSamples) noexcept
+    {
+        auto start = writePosition.load (std::memory_order_relaxed);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto& buffer = buffers[(size_t) ch];
+            auto* source = ch < numChannelsIn ? channelData[ch] : nullptr;
+
+            for (int done = 0; done < numSamples;)
+            {
+                auto index = (int) ((start + done) & mask);
+                auto chunk = juce::jmin (numSamples - done, capacity - index);
+
+                if (source != nullptr)
+                    memcpy (buffer.data() + index, source + done, (size_t) chunk * sizeof (float));
+                else
+                    juce::zeromem (buffer.data() + index, (size_t) chunk * sizeof (float));
+
+                done += chunk;
+            }
+        }
+
+        writePosition.store (start + numSamples, std::memory_order_release);
+    }
+
+    /** Copies numSamples of one channel, ending at the absolute position endPosition. */
+    void read (int channel, juce::int64 endPosition, float* dest, int numSamples) const noexcept
+    {
+        jassert (numSamples <= capacity / 2);
+
+        auto& buffer = buffers[(size_t) channel];
+        auto start = endPosition - numSamples;
+
+        for (int done = 0; done < numSamples;)
+        {
+            auto index = (int) ((start + done) & mask);
+            auto chunk = juce::jmin (numSamples - done, capacity - index);
+
+            if (start + done < 0)
+            {
+                // before the stream started
+                chunk = (int) juce::jmin ((juce::int64) chunk, -(start + done));
+                juce::zeromem (dest + done, (size_t) chunk * sizeof (float));
+            }
+            else
+            {
+                memcpy (dest + done, buffer.data() + index, (size_t) chunk * sizeof (float));
+            }
+
+            done += chunk;
+        }
+    }
+
+private:
+    const int numChannels;
+    std::vector<std::vector<float>> buffers;
+    std::atomic<juce::int64> writePosition { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleHistory)
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "SampleHistory.h"
+
+//==============================================================================
+/**
+    A time-domain view of the analysed channel, read from the same
+    SampleHistory the FFT uses, so the audio thread does no extra work for it.
+
+    To draw seconds of audio in time proportional to the width rather than to
+    the number of samples, the view keeps min/max summaries of the history at
+    three block sizes (16, 256 and 4096 samples), brought up to date from the
+    newly written samples each time it refreshes. A pixel then combines at
+    most a few dozen summary blocks; when zoomed in far enough that this
+    wouldn't save anything, the samples themselves are drawn.
+
+    With the trigger on, the window is placed so the latest rising edge
+    through the trigger level sits a tenth of the way in, which holds
+    periodic signals still; if there's no edge to be found it free-runs.
+    The mouse wheel changes the timebase and a click toggles the trigger.
+*/
+class ScopeView  : public juce::Component
+{
+public:
+    explicit ScopeView (const SampleHistory& historyToRead)
+        : history (historyToRead)
+    {
+        for (int level = 0; level < numLevels; ++level)
+        {
+            auto numBlocks = (size_t) (SampleHistory::capacity >> blockOrder (level));
+            minima[level].assign (numBlocks, 0.0f);
+            maxima[level].assign (numBlocks, 0.0f);
+        }
+
+        setOpaque (true);
+    }
+
+    /** Safe to call from any thread. */
+    void setSampleRate (double newSampleRate) noexcept      { sampleRate = newSampleRate; }
+
+    /** Brings the summaries up to date and repaints; called by the owner's timer. */
+    void refresh()
+    {
+        summarise();
+        repaint();
+    }
+
+    //==============================================================================
+    void paint (juce::Graphics& g) override
+    {
+        g.fillAll (juce::Colours::black);
+
+        auto bounds = getLocalBounds().toFloat();
+        auto width = juce::jmax (1, getWidth());
+        auto windowSamples = getWindowSamples();
+        auto start = findWindowStart (windowSamples);
+        auto samplesPerPixel = windowSamples / width;
+
+        g.setColour (juce::Colours::darkgrey);
+        g.drawHorizontalLine (juce::roundToInt (bounds.getCentreY()), bounds.getX(), bounds.getRight());
+
+        g.setColour (juce::Colours::lightgreen);
+
+        if (samplesPerPixel < (double) (1 << blockOrder (0)))
+            drawSamples (g, start, windowSamples, samplesPerPixel);
+        else
+            drawSummaries (g, start, samplesPerPixel);
+
+        g.setColour (juce::Colours::grey);
+        g.drawText (formatTimebase (windowSamples) + (! triggered ? "  free" : triggerFound ? "  trig" : "  trig (no edge)"),
+                    getLocalBounds().reduced (6), juce::Justification::topLeft);
+    }
+
+    void mouseWheelMove (const juce::MouseEvent&, const juce::MouseWheelDetails& wheel) override
+    {
+        windowSeconds = juce::jlimit ((double) minWindowSeconds, (double) maxWindowSeconds,
+                                      windowSeconds * std::pow (2.0, -wheel.deltaY * 4.0));
+        repaint();
+    }
+
+    void mouseDown (const juce::MouseEvent&) override
+    {
+        triggered = ! triggered;
+        repaint();
+    }
+
+private:
+    //==============================================================================
+    static constexpr int numLevels = 3;
+    static int blockOrder (int level) noexcept      { return 4 + 4 * level; }
+
+    /** Summarises whole level-0 blocks written since the last call, then the coarser levels above them. */
+    void summarise()
+    {
+        auto writePosition = history.getWritePosition();
+        auto end = writePosition & ~(juce::int64) ((1 << blockOrder (0)) - 1);
+
+        // the input was restarted (e.g. a new sample rate), or this is too far behind to catch up on what's still in the ring: start again from recent input
+        if (end < summarisedEnd || end - summarisedEnd > SampleHistory::capacity / 2)
+        {
+            summarisedEnd = juce::jmax ((juce::int64) 0, end - SampleHistory::capacity / 2)
+                              & ~(juce::int64) ((1 << blockOrder (numLevels - 1)) - 1);
+            validFrom = summarisedEnd;
+        }
+
+        auto block = 1 << blockOrder (0);
+
+        while (summarisedEnd < end)
+        {
+            auto numSamples = (int) juce::jmin ((juce::int64) scratchSize, end - summarisedEnd);
+            scratch.resize ((size_t) scratchSize);
+            history.read (0, summarisedEnd + numSamples, scratch.data(), numSamples);
+
+            for (int i = 0; i < numSamples; i += block)
+            {
+                auto range = juce::FloatVectorOperations::findMinAndMax (scratch.data() + i, block);
+                auto index = (size_t) (((summarisedEnd + i) >> blockOrder (0)) & ((SampleHistory::capacity >> blockOrder (0)) - 1));
+                minima[0][index] = range.getStart();
+                maxima[0][index] = range.getEnd();
+            }
+
+            for (int level = 1; level < numLevels; ++level)
+                summariseLevel (level, summarisedEnd, summarisedEnd + numSamples);
+
+            summarisedEnd += numSamples;
+        }
+    }
+
+    /** Recomputes the blocks of a level that end within [from, to), from the level below. */
+    void summariseLevel (int level, juce::int64 from, juce::int64 to) noexcept
+    {
+        auto order = blockOrder (level);
+        auto ratio = 1 << (order - blockOrder (level - 1));
+        auto lowerMask = (SampleHistory::capacity >> blockOrder (level - 1)) - 1;
+        auto mask = (SampleHistory::capacity >> order) - 1;
+
+        for (auto b = (from >> order) + 1; (b << order) <= to; ++b)
+        {
+            auto lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+            auto first = (b - 1) * ratio;
+
+            for (int i = 0; i < ratio; ++i)
+            {
+                auto index = (size_t) ((first + i) & lowerMask);
+                lo = juce::jmin (lo, minima[level - 1][index]);
+                hi = juce::jmax (hi, maxima[level - 1][index]);
+            }
+
+            minima[level][(size_t) ((b - 1) & mask)] = lo;
+            maxima[level][(size_t) ((b - 1) & mask)] = hi;
+        }
+    }
+
+    /** The oldest position whose samples and summaries are still in the rings. */
+    juce::int64 getOldestValid() const noexcept
+    {
+        return juce::jmax (validFrom, summarisedEnd - SampleHistory::capacity + (1 << blockOrder (numLevels - 1)));
+    }
+
+    /** The timebase in samples, no longer than a reader may copy out of the history at once. */
+    double getWindowSamples() const noexcept
+    {
+        return juce::jlimit (1.0, (double) (SampleHistory::capacity / 2), windowSeconds * sampleRate.load());
+    }
+
+    //==============================================================================
+    /** Where the window starts: trigger-aligned if there's an edge, otherwise the newest input. */
+    double findWindowStart (double windowSamples)
+    {
+        auto newestStart = (double) summarisedEnd - windowSamples;
+        triggerFound = false;
+
+        if (! triggered)
+            return newestStart;
+
+        // the latest edge that still leaves a full window after it
+        auto latestEdge = (juce::int64) (newestStart + windowSamples * preTrigger);
+        auto span = (int) juce::jlimit ((juce::int64) 1024, (juce::int64) scratchSize, (juce::int64) windowSamples * 2);
+
+        if (latestEdge - span < getOldestValid())
+            return newestStart;
+
+        scratch.resize ((size_t) scratchSize);
+        history.read (0, latestEdge, scratch.data(), span);
+
+        auto level = juce::Decibels::decibelsToGain (triggerLevelDb);
+
+        for (int i = span - 1; i > 0; --i)
+        {
+            auto before = scratch[(size_t) (i - 1)], after = scratch[(size_t) i];
+
+            if (before < level && after >= level)
+            {
+                triggerFound = true;
+                auto edge = (double) (latestEdge - span + i - 1) + (double) ((level - before) / (after - before));
+                return edge - windowSamples * preTrigger;
+            }
+        }
+
+        return newestStart;
+    }
+
+    /** Zoomed in: a line through the samples, or each pixel's min/max of the samples it covers. */
+    void drawSamples (juce::Graphics& g, double start, double windowSamples, double samplesPerPixel)
+    {
+        auto first = (juce::int64) std::floor (start);
+        auto numSamples = (int) juce::jmin ((juce::int64) std::ceil (windowSamples) + 1, summarisedEnd - first);
+
+        if (first < getOldestValid() || numSamples < 2)
+            return;
+
+        scratch.resize ((size_t) numSamples);
+        history.read (0, first + numSamples, scratch.data(), numSamples);
+
+        auto height = (float) getHeight();
+
+        if (samplesPerPixel < 1.0)
+        {
+            juce::Path path;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                auto x = (float) (((double) (first + i) - start) / samplesPerPixel);
+                auto y = toY (scratch[(size_t) i], height);
+
+                if (i == 0)
+                    path.startNewSubPath (x, y);
+                else
+                    path.lineTo (x, y);
+            }
+
+            g.strokePath (path, juce::PathStrokeType (1.0f));
+            return;
+        }
+
+        for (int x = 0; x < getWidth(); ++x)
+        {
+            auto from = (int) (start + x * samplesPerPixel - (double) first);
+
+            if (from >= numSamples)
+                break;
+
+            auto count = juce::jmax (1, (int) (start + (x + 1) * samplesPerPixel - (double) first) - from);
+            auto range = juce::FloatVectorOperations::findMinAndMax (scratch.data() + from, juce::jmin (count, numSamples - from));
+            drawColumn (g, x, range.getStart(), range.getEnd(), height);
+        }
+    }
+
+    /** Zoomed out: each pixel combines the summary blocks at the coarsest level that still gives it a few. */
+    void drawSummaries (juce::Graphics& g, double start, double samplesPerPixel)
+    {
+        int level = numLevels - 1;
+
+        while (level > 0 && (double) (1 << blockOrder (level)) * 2.0 > samplesPerPixel)
+            --level;
+
+        auto order = blockOrder (level);
+        auto mask = (SampleHistory::capacity >> order) - 1;
+        auto height = (float) getHeight();
+        auto oldest = getOldestValid();
+
+        for (int x = 0; x < getWidth(); ++x)
+        {
+            auto from = (juce::int64) (start + x * samplesPerPixel);
+            auto to = (juce::int64) (start + (x + 1) * samplesPerPixel);
+
+            if (from < oldest || to > summarisedEnd)
+                continue;
+
+            auto lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+
+            for (auto b = from >> order; b <= (to - 1) >> order; ++b)
+            {
+                lo = juce::jmin (lo, minima[level][(size_t) (b & mask)]);
+                hi = juce::jmax (hi, maxima[level][(size_t) (b & mask)]);
+            }
+
+            drawColumn (g, x, lo, hi, height);
+        }
+    }
+
+    static void drawColumn (juce::Graphics& g, int x, float lo, float hi, float height)
+    {
+        auto top = toY (hi, height), bottom = toY (lo, height);
+        g.fillRect ((float) x, top, 1.0f, juce::jmax (1.0f, bottom - top));
+    }
+
+    static float toY (float sample, float height) noexcept
+    {
+        return juce::jmap (juce::jlimit (-1.0f, 1.0f, sample), -1.0f, 1.0f, height, 0.0f);
+    }
+
+    juce::String formatTimebase (double windowSamples) const
+    {
+        auto seconds = windowSamples / sampleRate.load();
+        return seconds < 1.0 ? juce::String (seconds * 1000.0, seconds < 0.01 ? 1 : 0) + " ms"
+                             : juce::String (seconds, 1) + " s";
+    }
+
+    //==============================================================================
+    enum { scratchSize = 1 << 16 };
+    static constexpr double minWindowSeconds = 0.001, maxWindowSeconds = 10.0;   // the history's length limits it too
+    static constexpr double preTrigger = 0.1;
+    static constexpr float triggerLevelDb = -30.0f;
+
+    const SampleHistory& history;
+    std::atomic<double> sampleRate { 44100.0 };
+
+    std::vector<float> minima[numLevels], maxima[numLevels];
+    juce::int64 summarisedEnd = 0, validFrom = 0;
+    std::vector<float> scratch;
+
+    double windowSeconds = 0.02;
+    bool triggered = true, triggerFound = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ScopeView)
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cmath>
+
+//==============================================================================
+/**
+    A block-level gate that tells the analysis when there is nothing to analyse.
+
+    Runs on the audio thread for every incoming block: one min/max scan and one
+    sum of squares per channel. The gate opens as soon as a block's RMS crosses
+    the threshold (or its peak crosses it by more than peakMarginDb, so clicks
+    count) and closes again once the input has stayed below it for holdSeconds.
+*/
+class SilenceGate
+{
+public:
+    void prepare (double sampleRate) noexcept
+    {
+        holdSamples = (juce::int64) (holdSeconds * sampleRate);
+    }
+
+    /** A threshold of -infinity (or anything below -200 dBFS) keeps the gate open. */
+    void setThreshold (float thresholdDb) noexcept
+    {
+        enabled = thresholdDb > -200.0f;
+        rmsThreshold = juce::Decibels::decibelsToGain (thresholdDb, -1000.0f);
+        peakThreshold = juce::Decibels::decibelsToGain (thresholdDb + peakMarginDb, -1000.0f);
+    }
+
+    /** Called on the audio thread. Returns true when this block opened the gate. */
+    bool process (const float* const* channelData, int numChannels, int numSamples) noexcept
+    {
+        if (! enabled || numSamples <= 0)
+        {
+            auto wasOpen = open.exchange (true);
+            return ! wasOpen;
+        }
+
+        float peak = 0.0f, sumOfSquares = 0.0f;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* data = channelData[ch];
+            auto range = juce::FloatVectorOperations::findMinAndMax (data, numSamples);
+            peak = juce::jmax (peak, -range.getStart(), range.getEnd());
+
+            for (int i = 0; i < numSamples; ++i)
+                sumOfSquares += data[i] * data[i];
+        }
+
+        auto rms = std::sqrt (sumOfSquares / (float) (numSamples * juce::jmax (1, numChannels)));
+
+        if (rms > rmsThreshold || peak > peakThreshold)
+        {
+            silentSamples = 0;
+            auto wasOpen = open.exchange (true);
+            return ! wasOpen;
+        }
+
+        silentSamples += numSamples;
+
+        if (silentSamples > holdSamples)
+            open = false;
+
+        return false;
+    }
+
+    bool isOpen() const noexcept    { return open.load(); }
+
+private:
+    static constexpr float peakMarginDb = 12.0f;
+    static constexpr double holdSeconds = 2.0;
+
+    bool enabled = true;
+    float rmsThreshold = 0.0f, peakThreshold = 0.0f;
+    juce::int64 holdSamples = 88200, silentSamples = 0;
+    std::atomic<bool> open { true };
+};
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//==============================================================================
+/**
+    An approximate nearest-neighbour index over unit-length embeddings (IVF-flat).
+
+    build() clusters the embeddings with spherical k-means into about sqrt(N)
+    lists and stores every embedding with its nearest centroid. A search ranks
+    the centroids against the query and scans only the closest numProbes
+    lists, splitting them across threads; scores are dot products, i.e. cosine
+    similarity for unit-length vectors.
+
+    Each embedding is tagged with the source (an archived file) and the window
+    within it that it came from. Like FingerprintIndex, it's either built in
+    memory or loaded from a file written by save(), optionally memory-mapped.
+    Searches are const and safe from any number of threads.
+*/
+class SimilarityIndex
+{
+public:
+    struct Hit
+    {
+        juce::uint32 source, window;
+        float score;
+    };
+
+    explicit SimilarityIndex (int numDimensions = 0) : dimensions (numDimensions) {}
+
+    int getDimensions() const noexcept                          { return dimensions; }
+    int getNumLists() const noexcept                            { return numLists; }
+    size_t getNumVectors() const noexcept                       { return numVectors; }
+    int getNumSources() const noexcept                          { return names.size(); }
+    const juce::String& getSourceName (int i) const noexcept    { return names[i]; }
+
+    //==============================================================================
+    /** Adds a source; returns the number to tag its embeddings with. */
+    juce::uint32 addSource (const juce::String& name)
+    {
+        names.add (name);
+        return (juce::uint32) names.size() - 1;
+    }
+
+    /** Adds one embedding of getDimensions() values; call build() once they're all added. */
+    void add (juce::uint32 source, juce::uint32 window, const float* embedding)
+    {
+        jassert (mappedFile == nullptr && loadedData.getSize() == 0);
+
+        ownedVectors.insert (ownedVectors.end(), embedding, embedding + dimensions);
+        ownedIds.push_back ({ source, window });
+    }
+
+    /** Clusters what's been added into numListsToUse lists (0 picks about sqrt(N)). */
+    void build (int numListsToUse = 0)
+    {
+        auto n = (int) ownedIds.size();
+
+        if (n == 0)
+            return;
+
+        numLists = juce::jlimit (1, juce::jmin (n, (int) maxLists),
+                                 numListsToUse > 0 ? numListsToUse : (int) std::sqrt ((double) n));
+
+        trainCentroids (n);
+
+        // assign every vector to its closest list, then regroup them list by list
+        std::vector<int> listOf ((size_t) n);
+        parallelFor (n, [&] (int begin, int end)
+        {
+            for (int i = begin; i < end; ++i)
+                listOf[(size_t) i] = closestCentroid (ownedVectors.data() + (size_t) i * (size_t) dimensions);
+        });
+
+        ownedOffsets.assign ((size_t) numLists + 1, 0);
+
+        for (auto l : listOf)
+            ++ownedOffsets[(size_t) l + 1];
+
+        for (size_t i = 1; i < ownedOffsets.size(); ++i)
+            ownedOffsets[i] += ownedOffsets[i - 1];
+
+        std::vector<float> groupedVectors (ownedVectors.size());
+        std::vector<Id> groupedIds (ownedIds.size());
+        auto next = ownedOffsets;
+
+        for (int i = 0; i < n; ++i)
+        {
+            auto slot = next[(size_t) listOf[(size_t) i]]++;
+            std::copy_n (ownedVectors.data() + (size_t) i * (size_t) dimensions, dimensions,
+                         groupedVectors.data() + (size_t) slot * (size_t) dimensions);
+            groupedIds[slot] = ownedIds[(size_t) i];
+        }
+
+        ownedVectors.swap (groupedVectors);
+        ownedIds.swap (groupedIds);
+
+        centroids = ownedCentroids.data();
+        offsets = ownedOffsets.data();
+        vectors = ownedVectors.data();
+        ids = ownedIds.data();
+        numVectors = ownedIds.size();
+    }
+
+    //==============================================================================
+    /** Returns up to k hits, best first, from the numProbes lists closest to the query. */
+    std::vector<Hit> search (const float* query, int k, int numProbes = defaultProbes) const
+    {
+        if (centroids == nullptr || k <= 0)
+            return {};
+
+        numProbes = juce::jlimit (1, numLists, numProbes);
+
+        std::vector<std::pair<float, int>> ranked ((size_t) numLists);
+
+        for (int l = 0; l < numLists; ++l)
+            ranked[(size_t) l] = { dot (query, centroids + (size_t) l * (size_t) dimensions), l };
+
+        std::partial_sort (ranked.begin(), ranked.begin() + numProbes, ranked.end(),
+                           [] (const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+
+        size_t numToScan = 0;
+
+        for (int p = 0; p < numProbes; ++p)
+            numToScan += offsets[ranked[(size_t) p].second + 1] - offsets[ranked[(size_t) p].second];
+
+        // each thread keeps its own top k over every numThreads-th probed list
+        auto numThreads = juce::jlimit (1, juce::jmin (juce::SystemStats::getNumCpus(), numProbes),
+                                        (int) (numToScan / vectorsPerThread));
+        std::vector<std::vector<Hit>> partial ((size_t) numThreads);
+
+        auto scan = [&] (int thread)
+        {
+            std::priority_queue<Hit, std::vector<Hit>, WorseScoreFirst> best;
+
+            for (int p = thread; p < numProbes; p += numThreads)
+            {
+                auto list = ranked[(size_t) p].second;
+
+                for (auto i = offsets[list]; i < offsets[list + 1]; ++i)
+                {
+                    auto score = dot (query, vectors + (size_t) i * (size_t) dimensions);
+
+                    if ((int) best.size() < k)
+                        best.push ({ ids[i].source, ids[i].window, score });
+                    else if (score > best.top().score)
+                    {
+                        best.pop();
+                        best.push ({ ids[i].source, ids[i].window, score });
+                    }
+                }
+            }
+
+            for (; ! best.empty(); best.pop())
+                partial[(size_t) thread].push_back (best.top());
+        };
+
+        std::vector<std::thread> threads;
+
+        for (int t = 1; t < numThreads; ++t)
+            threads.emplace_back (scan, t);
+
+        scan (0);
+
+        for (auto& t : threads)
+            t.join();
+
+        std::vector<Hit> hits;
+
+        for (auto& p : partial)
+            hits.insert (hits.end(), p.begin(), p.end());
+
+        auto numKept = juce::jmin (k, (int) hits.size());
+        std::partial_sort (hits.begin(), hits.begin() + numKept, hits.end(),
+                           [] (const Hit& a, const Hit& b) { return a.score > b.score; });
+        hits.resize ((size_t) numKept);
+        return hits;
+    }
+
+    //==============================================================================
+    /** Writes the index in native (little-endian) byte order. */
+    bool save (const juce::File& file) const
+    {
+        file.deleteFile();
+        juce::FileOutputStream out (file);
+
+        if (out.failedToOpen())
+            return false;
+
+        out.writeInt ((int) magic);
+        out.writeInt (version);
+        out.writeInt (dimensions);
+        out.writeInt (numLists);
+        out.writeInt ((int) numVectors);
+        out.writeInt (names.size());
+        out.write (centroids, (size_t) numLists * (size_t) dimensions * sizeof (float));
+        out.write (offsets, ((size_t) numLists + 1) * sizeof (juce::uint32));
+        out.write (vectors, numVectors * (size_t) dimensions * sizeof (float));
+        out.write (ids, numVectors * sizeof (Id));
+
+        for (auto& name : names)
+            out.writeString (name);
+
+        out.flush();
+        return out.getStatus().wasOk();
+    }
+
+    /** Opens an index written by save(), either memory-mapped or read into memory. */
+    static std::unique_ptr<SimilarityIndex> load (const juce::File& file, bool memoryMap, juce::String& error)
+    {
+        if (juce::ByteOrder::isBigEndian())
+        {
+            error = "similarity indexes can only be read on little-endian machines";
+            return {};
+        }
+
+        std::unique_ptr<SimilarityIndex> index (new SimilarityIndex());
+        const char* data = nullptr;
+        size_t size = 0;
+
+        if (memoryMap)
+        {
+            index->mappedFile.reset (new juce::MemoryMappedFile (file, juce::MemoryMappedFile::readOnly));
+            data = static_cast<const char*> (index->mappedFile->getData());
+            size = index->mappedFile->getSize();
+        }
+        else if (file.loadFileAsData (index->loadedData))
+        {
+            data = static_cast<const char*> (index->loadedData.getData());
+            size = index->loadedData.getSize();
+        }
+
+        if (data == nullptr || ! index->parse (data, size))
+        {
+            error = "can't read a similarity index from " + file.getFullPathName();
+            return {};
+        }
+
+        return index;
+    }
+
+private:
+    //==============================================================================
+    struct Id
+    {
+        juce::uint32 source, window;
+    };
+
+    struct WorseScoreFirst
+    {
+        bool operator() (const Hit& a, const Hit& b) const noexcept    { return a.score > b.score; }
+    };
+
+    float dot (const float* a, const float* b) const noexcept
+    {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        int i = 0;
+
+        for (; i + 4 <= dimensions; i += 4)
+        {
+            s0 += a[i] * b[i];
+            s1 += a[i + 1] * b[i + 1];
+            s2 += a[i + 2] * b[i + 2];
+            s3 += a[i + 3] * b[i + 3];
+        }
+
+        for (; i < dimensions; ++i)
+            s0 += a[i] * b[i];
+
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    int closestCentroid (const float* v) const noexcept
+    {
+        int best = 0;
+        float bestScore = -2.0f;
+
+        for (int l = 0; l < numLists; ++l)
+        {
+            auto score = dot (v, ownedCentroids.data() + (size_t) l * (size_t) dimensions);
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                best = l;
+            }
+        }
+
+        return best;
+    }
+
+    /** Spherical k-means on a random sample of the vectors. */
+    void trainCentroids (int n)
+    {
+        juce::Random random (1);
+        auto* data = ownedVectors.data();
+
+        std::vector<int> sample;
+
+        for (int i = 0; i < n; ++i)
+            sample.push_back (i);
+
+        for (int i = n; --i > 0;)
+            std::swap (sample[(size_t) i], sample[(size_t) random.nextInt (i + 1)]);
+
+        sample.resize ((size_t) juce::jmin (n, numLists * (int) trainingVectorsPerList));
+
+        ownedCentroids.resize ((size_t) numLists * (size_t) dimensions);
+
+        for (int l = 0; l < numLists; ++l)
+            std::copy_n (data + (size_t) sample[(size_t) l] * (size_t) dimensions, dimensions,
+                         ownedCentroids.data() + (size_t) l * (size_t) dimensions);
+
+        std::vector<int> assignment (sample.size());
+        std::vector<double> sums ((size_t) numLists * (size_t) dimensions);
+        std::vector<int> counts ((size_t) numLists);
+
+        for (int iteration = 0; iteration < trainingIterations; ++iteration)
+        {
+            parallelFor ((int) sample.size(), [&] (int begin, int end)
+            {
+                for (int i = begin; i < end; ++i)
+                    assignment[(size_t) i] = closestCentroid (data + (size_t) sample[(size_t) i] * (size_t) dimensions);
+            });
+
+            std::fill (sums.begin(), sums.end(), 0.0);
+            std::fill (counts.begin(), counts.end(), 0);
+
+            for (size_t i = 0; i < sample.size(); ++i)
+            {
+                auto l = (size_t) assignment[i];
+                auto* v = data + (size_t) sample[i] * (size_t) dimensions;
+                ++counts[l];
+
+                for (int d = 0; d < dimensions; ++d)
+                    sums[l * (size_t) dimensions + (size_t) d] += v[d];
+            }
+
+            for (int l = 0; l < numLists; ++l)
+            {
+                auto* centroid = ownedCentroids.data() + (size_t) l * (size_t) dimensions;
+
+                // an empty list restarts from a random vector
+                if (counts[(size_t) l] == 0)
+                {
+                    std::copy_n (data + (size_t) sample[(size_t) random.nextInt ((int) sample.size())] * (size_t) dimensions,
+                                 dimensions, centroid);
+                    continue;
+                }
+
+                double norm = 0.0;
+
+                for (int d = 0; d < dimensions; ++d)
+                    norm += sums[(size_t) l * (size_t) dimensions + (size_t) d] * sums[(size_t) l * (size_t) dimensions + (size_t) d];
+
+                auto scale = norm > 0.0 ? 1.0 / std::sqrt (norm) : 0.0;
+
+                for (int d = 0; d < dimensions; ++d)
+                    centroid[d] = (float) (sums[(size_t) l * (size_t) dimensions + (size_t) d] * scale);
+            }
+        }
+    }
+
+    static void parallelFor (int n, const std::function<void (int begin, int end)>& body)
+    {
+        auto numThreads = juce::jlimit (1, juce::SystemStats::getNumCpus(), n / 1024);
+        std::vector<std::thread> threads;
+
+        for (int t = 1; t < numThreads; ++t)
+            threads.emplace_back (body, n * t / numThreads, n * (t + 1) / numThreads);
+
+        body (0, n / numThreads);
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    bool parse (const char* data, size_t size)
+    {
+        const size_t headerSize = 24;
+
+        if (size < headerSize)
+            return false;
+
+        auto readInt = [data] (size_t offset) { return (int) juce::ByteOrder::littleEndianInt (data + offset); };
+
+        if ((juce::uint32) readInt (0) != magic || readInt (4) != version)
+            return false;
+
+        dimensions = readInt (8);
+        numLists = readInt (12);
+        numVectors = (size_t) (juce::uint32) readInt (16);
+        auto numNames = readInt (20);
+
+        auto centroidsAt = headerSize;
+        auto offsetsAt = centroidsAt + (size_t) numLists * (size_t) dimensions * sizeof (float);
+        auto vectorsAt = offsetsAt + ((size_t) numLists + 1) * sizeof (juce::uint32);
+        auto idsAt = vectorsAt + numVectors * (size_t) dimensions * sizeof (float);
+        auto namesAt = idsAt + numVectors * sizeof (Id);
+
+        if (dimensions <= 0 || numLists <= 0 || namesAt > size || (numNames > 0 && data[size - 1] != 0))
+            return false;
+
+        centroids = reinterpret_cast<const float*> (data + centroidsAt);
+        offsets = reinterpret_cast<const juce::uint32*> (data + offsetsAt);
+        vectors = reinterpret_cast<const float*> (data + vectorsAt);
+        ids = reinterpret_cast<const Id*> (data + idsAt);
+
+        if (offsets[numLists] != numVectors)
+            return false;
+
+        for (auto* name = data + namesAt; names.size() < numNames; name += strlen (name) + 1)
+        {
+            if (name >= data + size)
+                return false;
+
+            names.add (juce::String::fromUTF8 (name));
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    enum
+    {
+        maxLists                = 4096,
+        trainingVectorsPerList  = 64,
+        trainingIterations      = 10,
+        defaultProbes           = 16,
+        vectorsPerThread        = 16384,
+        version                 = 1
+    };
+
+    static constexpr juce::uint32 magic = 0x584d4953;   // "SIMX"
+
+    int dimensions = 0, numLists = 0;
+    juce::StringArray names;
+    std::vector<float> ownedVectors, ownedCentroids;
+    std::vector<Id> ownedIds;
+    std::vector<juce::uint32> ownedOffsets;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    juce::MemoryBlock loadedData;
+
+    const float* centroids = nullptr;
+    const juce::uint32* offsets = nullptr;
+    const float* vectors = nullptr;
+    const Id* ids = nullptr;
+    size_t numVectors = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SimilarityIndex)
+};
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "DoubleFFT.h"
+#include "FrameKernels.h"
+#include "TemperedScale.h"
+
+/** The FFT each sample type runs on: JUCE's for float, DoubleFFT (same interface) for double. */
+template <typename SampleType> struct SpectrumFFT           { using Type = juce::dsp::FFT; };
+template <> struct SpectrumFFT<double>                      { using Type = DoubleFFT; };
+
+//==============================================================================
+/**
+    Windowing, FFT and tempered-scale banding for one channel.
+
+    Has no threads or locks of its own: the AnalysisEngine drives it from its
+    worker, and anything else (headless tools, offline indexers) can drive it
+    directly with frames of getFFTSize() samples.
+
+    Optionally it also takes the real cepstrum of each frame (the inverse FFT
+    of the log magnitudes, run on the same FFT object), whose peaks show
+    echoes and periodicities, and from its first few coefficients a smooth
+    spectral envelope per band. The envelope is summed from a cosine table
+    at the band centres rather than transformed back, so the whole stage
+    costs one extra inverse transform and allocates nothing per frame.
+
+    It's a template on the sample type its frames are windowed and
+    transformed in. SpectrumAnalyser (float) is what the display and the
+    real-time tools use; PreciseSpectrumAnalyser (double) lowers the
+    rounding noise of the window and transform by well over 100 dB and
+    reads levels down to -200 dB instead of -100, for measurements of deep
+    dynamic range, at a few times the cost. Either takes frames of float or
+    double samples, and both give their levels in float dB; the sums they
+    form along the way are double in both.
+
+    The windowing and banding run through FrameKernels specialised for the
+    FFT order, picked when the analyser is prepared.
+*/
+template <typename SampleType>
+class GenericSpectrumAnalyser
+{
+public:
+    GenericSpectrumAnalyser() = default;
+
+    /** (Re)allocates everything for a new FFT order or sample rate. */
+    void prepare (int newFftOrder, double newSampleRate, int groupNotes = 2)
+    {
+        fftOrder = newFftOrder;
+        fftSize = 1 << fftOrder;
+        sampleRate = newSampleRate;
+
+        forwardFFT.reset (new FFT (fftOrder));
+        window.resize ((size_t) fftSize);
+        juce::dsp::WindowingFunction<SampleType>::fillWindowingTables (window.data(), (size_t) fftSize,
+                                                                       juce::dsp::WindowingFunction<SampleType>::hann, true);
+        fftData.assign ((size_t) (2 * fftSize), SampleType());
+        computeLevels = Kernels::getLevelsFunction (fftOrder);
+        normalisationDb = juce::Decibels::gainToDecibels ((float) fftSize);
+
+        scale.build (groupNotes, fftSize, sampleRate, minFreq, maxFreq);
+        levels.assign ((size_t) scale.getNumBands(), (float) mindB);
+
+        prepareCepstrum();
+    }
+
+    /** Turns the cepstral stage on or off; while off it costs nothing. */
+    void setCepstrumEnabled (bool shouldBeEnabled)
+    {
+        cepstrumEnabled = shouldBeEnabled;
+        prepareCepstrum();
+    }
+
+    bool isCepstrumEnabled() const noexcept             { return cepstrumEnabled; }
+
+    /** Analyses one frame of getFFTSize() samples into getLevels(). */
+    template <typename InputType>
+    void process (const InputType* frame) noexcept
+    {
+        // first apply a windowing function to our data
+        Kernels::template getWindowFunction<InputType> (fftOrder) (frame, window.data(), fftData.data(), fftSize);   // [1]
+
+        // then render our FFT data..
+        forwardFFT->performFrequencyOnlyForwardTransform (fftData.data());        // [2]
+
+        computeBandLevels();
+
+        if (cepstrumEnabled)
+            computeCepstrum();
+    }
+
+    /** Windows one frame and leaves its complex spectrum in spectrum: getFFTSize() / 2 + 1 bins, re and im interleaved. */
+    template <typename InputType, typename OutputType>
+    void transform (const InputType* frame, OutputType* spectrum) noexcept
+    {
+        Kernels::template getWindowFunction<InputType> (fftOrder) (frame, window.data(), fftData.data(), fftSize);
+        forwardFFT->performRealOnlyForwardTransform (fftData.data(), true);
+
+        std::copy (fftData.begin(), fftData.begin() + fftSize + 2, spectrum);
+    }
+
+    /** Bands getFFTSize() / 2 bin magnitudes worked out elsewhere (e.g. averaged over frames) into getLevels(). */
+    void processMagnitudes (const SampleType* magnitudes) noexcept
+    {
+        std::copy (magnitudes, magnitudes + fftSize / 2, fftData.begin());
+        computeBandLevels();
+    }
+
+    //==============================================================================
+    int getFFTOrder() const noexcept                    { return fftOrder; }
+    int getFFTSize() const noexcept                     { return fftSize; }
+    double getSampleRate() const noexcept               { return sampleRate; }
+    int getNumBands() const noexcept                    { return (int) levels.size(); }
+    const TemperedScale& getScale() const noexcept      { return scale; }
+
+    /** Band levels in dB, between mindB and maxdB. */
+    const std::vector<float>& getLevels() const noexcept    { return levels; }
+
+    /** Bin magnitudes of the last frame (getFFTSize() / 2 values). */
+    const SampleType* getMagnitudes() const noexcept    { return fftData.data(); }
+
+    /** The last frame's real cepstrum, getFFTSize() / 2 values indexed by quefrency in samples. */
+    const SampleType* getCepstrum() const noexcept      { return cepstrumData.data(); }
+
+    /** The last frame's smooth spectral envelope per band, in dB like getLevels().
+        It follows the average log magnitude, so it runs below the levels, which take each band's loudest bin.
+    */
+    const std::vector<float>& getEnvelope() const noexcept  { return envelope; }
+
+    struct CepstralPeak
+    {
+        double quefrencySeconds = 0.0;  // the echo's delay, or the period of whatever repeats
+        float strength = 0.0f;          // the coefficient itself, in nepers; ~0.1 and up is distinct
+    };
+
+    /** The strongest cepstral peak between two quefrencies (limited to half a frame). */
+    CepstralPeak findCepstralPeak (double minSeconds, double maxSeconds) const noexcept
+    {
+        CepstralPeak peak;
+
+        if (! cepstrumEnabled)
+            return peak;
+
+        auto first = juce::jmax (1, (int) (minSeconds * sampleRate));
+        auto last = juce::jmin (fftSize / 2 - 1, (int) (maxSeconds * sampleRate));
+
+        for (int n = first; n <= last; ++n)
+        {
+            if (cepstrumData[(size_t) n] > peak.strength)
+            {
+                peak.strength = (float) cepstrumData[(size_t) n];
+                peak.quefrencySeconds = n / sampleRate;
+            }
+        }
+
+        return peak;
+    }
+
+    /** The range levels are clamped to; in double, rounding noise is low enough to read twice as deep. */
+    static constexpr float mindB = std::is_same<SampleType, double>::value ? -200.0f : -100.0f;
+    static constexpr float maxdB =    0.0f;
+
+private:
+    using FFT = typename SpectrumFFT<SampleType>::Type;
+    using Kernels = FrameKernels<SampleType>;
+
+    void computeBandLevels() noexcept
+    {
+        computeLevels (fftData.data(), scale.getBars(), levels.data(), fftSize, mindB, maxdB);
+    }
+
+    //==============================================================================
+    void prepareCepstrum()
+    {
+        if (! cepstrumEnabled || fftSize == 0)
+            return;
+
+        cepstrumData.assign ((size_t) (2 * fftSize), SampleType());
+        envelope.assign (levels.size(), (float) mindB);
+
+        // the envelope keeps the quefrencies shorter than the lifter: detail finer than
+        // about 1 / lifterSeconds in frequency, such as harmonics, is smoothed away
+        lifterLength = juce::jlimit (2, fftSize / 2, (int) (lifterSeconds * sampleRate));
+        envelopeCosines.resize (levels.size() * (size_t) lifterLength);
+
+        auto& frequencies = scale.getFrequencies();
+
+        for (size_t b = 0; b < levels.size(); ++b)
+            for (int n = 0; n < lifterLength; ++n)
+                envelopeCosines[b * (size_t) lifterLength + (size_t) n]
+                    = (SampleType) ((n == 0 ? 1.0 : 2.0) * std::cos (juce::MathConstants<double>::twoPi * frequencies[b] * n / sampleRate));
+    }
+
+    void computeCepstrum() noexcept
+    {
+        auto numBins = fftSize / 2 + 1;
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            cepstrumData[(size_t) (2 * k)] = std::log (juce::jmax (fftData[(size_t) k], (SampleType) 1.0e-9));
+            cepstrumData[(size_t) (2 * k + 1)] = SampleType();
+        }
+
+        forwardFFT->performRealOnlyInverseTransform (cepstrumData.data());
+
+        // the log magnitude is even, so the cepstrum is too: a cosine series over its first half
+        auto toDb = 20.0 / std::log (10.0);
+
+        for (size_t b = 0; b < envelope.size(); ++b)
+        {
+            auto* cosines = envelopeCosines.data() + b * (size_t) lifterLength;
+            double logMagnitude = 0.0;
+
+            for (int n = 0; n < lifterLength; ++n)
+                logMagnitude += (double) (cepstrumData[(size_t) n] * cosines[n]);
+
+            envelope[b] = juce::jlimit (mindB, maxdB, (float) (logMagnitude * toDb) - normalisationDb);
+        }
+    }
+
+    //==============================================================================
+    static constexpr double lifterSeconds = 0.001;
+
+    int fftOrder = 0, fftSize = 0;
+    double sampleRate = 44100.0;
+    float normalisationDb = 0.0f;
+    float minFreq = 20.0f;
+    float maxFreq = 22000.0f;
+
+    std::unique_ptr<FFT> forwardFFT;
+    std::vector<SampleType> window, fftData;
+    typename Kernels::LevelsFunction computeLevels = nullptr;
+    TemperedScale scale;
+    std::vector<float> levels;
+
+    bool cepstrumEnabled = false;
+    std::vector<SampleType> cepstrumData, envelopeCosines;
+    std::vector<float> envelope;
+    int lifterLength = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GenericSpectrumAnalyser)
+};
+
+template <typename SampleType> constexpr float GenericSpectrumAnalyser<SampleType>::mindB;
+template <typename SampleType> constexpr float GenericSpectrumAnalyser<SampleType>::maxdB;
+template <typename SampleType> constexpr double GenericSpectrumAnalyser<SampleType>::lifterSeconds;
+
+using SpectrumAnalyser = GenericSpectrumAnalyser<float>;
+using PreciseSpectrumAnalyser = GenericSpectrumAnalyser<double>;
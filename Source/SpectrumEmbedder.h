@@ -0,0 +1,147 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+//==============================================================================
+/**
+    Summarises band levels over overlapping windows, for similarity search.
+
+    Frames are accumulated into blocks of blockSeconds; every blocksPerWindow
+    consecutive blocks make a window, so windows overlap by all but one block.
+    A window's embedding is the mean level of each band with the overall level
+    removed, followed by each band's standard deviation, normalised to unit
+    length so that the dot product of two embeddings is their cosine
+    similarity. Windows with no level variation at all (digital silence)
+    aren't emitted.
+*/
+class SpectrumEmbedder
+{
+public:
+    static constexpr double blockSeconds = 1.0;
+    enum { blocksPerWindow = 2 };
+
+    /** Called with the window's index (its start, in blocks) and its embedding of getDimensions() values. */
+    using Callback = std::function<void (juce::uint32 window, const float* embedding)>;
+
+    void prepare (int newNumBands, double newSampleRate)
+    {
+        numBands = newNumBands;
+        sampleRate = newSampleRate;
+        blocks.assign ((size_t) blocksPerWindow, Block ((size_t) numBands));
+        embedding.resize ((size_t) getDimensions());
+        currentBlock = 0;
+    }
+
+    int getDimensions() const noexcept      { return 2 * numBands; }
+
+    //==============================================================================
+    /** Adds one frame of band levels (in dB), centred on the given absolute sample position. */
+    void addFrame (const float* levels, juce::int64 centrePosition, const Callback& callback)
+    {
+        auto block = (juce::int64) ((double) centrePosition / (sampleRate * blockSeconds));
+
+        while (currentBlock < block)
+            finishBlock (callback);
+
+        auto& b = blocks[(size_t) (currentBlock % blocksPerWindow)];
+
+        for (int i = 0; i < numBands; ++i)
+        {
+            b.sum[(size_t) i] += levels[i];
+            b.sumOfSquares[(size_t) i] += (double) levels[i] * levels[i];
+        }
+
+        ++b.numFrames;
+    }
+
+    /** Emits the last window at the end of a stream. */
+    void flush (const Callback& callback)
+    {
+        finishBlock (callback);
+    }
+
+private:
+    struct Block
+    {
+        explicit Block (size_t n) : sum (n, 0.0), sumOfSquares (n, 0.0) {}
+
+        void clear()
+        {
+            std::fill (sum.begin(), sum.end(), 0.0);
+            std::fill (sumOfSquares.begin(), sumOfSquares.end(), 0.0);
+            numFrames = 0;
+        }
+
+        std::vector<double> sum, sumOfSquares;
+        int numFrames = 0;
+    };
+
+    void finishBlock (const Callback& callback)
+    {
+        if (currentBlock >= blocksPerWindow - 1)
+            emitWindow ((juce::uint32) (currentBlock - (blocksPerWindow - 1)), callback);
+
+        ++currentBlock;
+        blocks[(size_t) (currentBlock % blocksPerWindow)].clear();
+    }
+
+    void emitWindow (juce::uint32 window, const Callback& callback)
+    {
+        int numFrames = 0;
+
+        for (auto& b : blocks)
+            numFrames += b.numFrames;
+
+        if (numFrames == 0)
+            return;
+
+        double overall = 0.0;
+
+        for (int i = 0; i < numBands; ++i)
+        {
+            double sum = 0.0, sumOfSquares = 0.0;
+
+            for (auto& b : blocks)
+            {
+                sum += b.sum[(size_t) i];
+                sumOfSquares += b.sumOfSquares[(size_t) i];
+            }
+
+            auto mean = sum / numFrames;
+            embedding[(size_t) i] = (float) mean;
+            embedding[(size_t) (numBands + i)] = (float) (deviationWeight * std::sqrt (juce::jmax (0.0, sumOfSquares / numFrames - mean * mean)));
+            overall += mean;
+        }
+
+        overall /= numBands;
+        double norm = 0.0;
+
+        for (int i = 0; i < numBands; ++i)
+            embedding[(size_t) i] -= (float) overall;
+
+        for (auto v : embedding)
+            norm += (double) v * v;
+
+        if (norm < 1.0e-6)
+            return;
+
+        auto scale = (float) (1.0 / std::sqrt (norm));
+
+        for (auto& v : embedding)
+            v *= scale;
+
+        callback (window, embedding.data());
+    }
+
+    static constexpr double deviationWeight = 0.5;
+
+    int numBands = 0;
+    double sampleRate = 44100.0;
+    std::vector<Block> blocks;
+    std::vector<float> embedding;
+    juce::int64 currentBlock = 0;
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+    Keeps the last few minutes (or hours) of band levels for freeze and scrub.
+
+    Levels are quantised to 8 bits over the displayed dB range and packed into
+    fixed-size chunks. Within a chunk, each frame is stored either raw or as
+    Rice-coded deltas against the previous frame, whichever is smaller, so a
+    frame never costs more than 1 + 8 * numBands bits. Chunks are allocated as
+    they fill up, and the oldest are recycled once the requested duration is
+    stored, so memory never exceeds the worst case reported by getMemoryLimit():
+    about 26 MB for an hour at 60 frames/s with 120 bands, and usually far less.
+
+    Thread-safe: one thread pushes while another reads.
+*/
+class SpectrumHistory
+{
+public:
+    SpectrumHistory (double framesPerSecondToKeep, double minutesToKeep, float mindBToUse, float maxdBToUse)
+        : framesPerSecond (framesPerSecondToKeep),
+          capacityFrames ((juce::int64) (framesPerSecondToKeep * minutesToKeep * 60.0)),
+          mindB (mindBToUse), maxdB (maxdBToUse)
+    {
+    }
+
+    /** Starts storing frames of a band count; keeps what's stored if the count hasn't changed. */
+    void prepare (int newNumBands)
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (newNumBands != numBands)
+            reset (newNumBands);
+    }
+
+    /** Clears everything and starts storing frames of a new band count. */
+    void reset (int newNumBands)
+    {
+        const juce::ScopedLock sl (lock);
+
+        numBands = newNumBands;
+        chunks.clear();
+        spareChunks.clear();
+        firstFrame = nextFrame = 0;
+        previous.assign ((size_t) numBands, 0);
+        current.assign ((size_t) numBands, 0);
+
+        auto worstFrameBits = 1 + 8 * numBands;
+        auto worstFramesPerChunk = juce::jmax (1, (chunkBytes * 8) / worstFrameBits);
+        maxChunks = (int) ((capacityFrames + worstFramesPerChunk - 1) / worstFramesPerChunk) + 1;
+    }
+
+    bool isEnabled() const noexcept                 { return capacityFrames > 0; }
+    double getFramesPerSecond() const noexcept      { return framesPerSecond; }
+
+    //==============================================================================
+    /** Appends one frame of band levels in dB. */
+    void push (const float* levels)
+    {
+        if (! isEnabled())
+            return;
+
+        const juce::ScopedLock sl (lock);
+
+        for (int b = 0; b < numBands; ++b)
+            current[(size_t) b] = quantise (levels[b]);
+
+        auto keyFrame = chunks.empty() || chunks.back()->numFrames == 0;
+        auto bits = keyFrame ? rawBits() : juce::jmin (rawBits(), deltaBits (bestRiceParameter()));
+
+        if (keyFrame || chunks.back()->bitsFree() < bits)
+        {
+            startChunk();
+            bits = rawBits();
+        }
+
+        auto& chunk = *chunks.back();
+        BitWriter writer (chunk);
+
+        if (bits == rawBits())
+        {
+            writer.write (0, 1);
+
+            for (auto q : current)
+                writer.write (q, 8);
+        }
+        else
+        {
+            auto k = bestRiceParameter();
+            writer.write (1, 1);
+            writer.write ((juce::uint32) k, 3);
+
+            for (int b = 0; b < numBands; ++b)
+                writeRice (writer, zigzag (current[(size_t) b] - previous[(size_t) b]), k);
+        }
+
+        chunk.numFrames++;
+        previous.swap (current);
+        ++nextFrame;
+
+        // drop whole chunks while what's left still covers the requested duration
+        while (chunks.size() > 1 && nextFrame - chunks[1]->firstFrame >= capacityFrames)
+            dropOldestChunk();
+    }
+
+    /** Decodes one frame into levels (numBands values); returns false if it isn't stored any more. */
+    bool read (juce::int64 frame, std::vector<float>& levels) const
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (frame < firstFrame || frame >= nextFrame)
+            return false;
+
+        auto found = std::upper_bound (chunks.begin(), chunks.end(), frame,
+                                       [] (juce::int64 f, const std::unique_ptr<Chunk>& c) { return f < c->firstFrame; });
+
+        if (found == chunks.begin())
+            return false;
+
+        auto* chunk = (found - 1)->get();
+
+        std::vector<int> values ((size_t) numBands, 0);
+        BitReader reader (*chunk);
+
+        for (auto f = chunk->firstFrame; f <= frame; ++f)
+        {
+            if (reader.read (1) == 0)
+            {
+                for (auto& v : values)
+                    v = (int) reader.read (8);
+            }
+            else
+            {
+                auto k = (int) reader.read (3);
+
+                for (auto& v : values)
+                    v += unzigzag (readRice (reader, k));
+            }
+        }
+
+        levels.resize ((size_t) numBands);
+
+        for (int b = 0; b < numBands; ++b)
+            levels[(size_t) b] = mindB + (maxdB - mindB) * (float) values[(size_t) b] / 255.0f;
+
+        return true;
+    }
+
+    /** The oldest stored frame and one past the newest, as absolute frame numbers. */
+    juce::Range<juce::int64> getStoredFrames() const
+    {
+        const juce::ScopedLock sl (lock);
+        return { firstFrame, nextFrame };
+    }
+
+    size_t getMemoryUsed() const
+    {
+        const juce::ScopedLock sl (lock);
+        return (chunks.size() + spareChunks.size()) * (sizeof (Chunk) + (size_t) chunkBytes);
+    }
+
+    size_t getMemoryLimit() const
+    {
+        const juce::ScopedLock sl (lock);
+        return (size_t) maxChunks * (sizeof (Chunk) + (size_t) chunkBytes);
+    }
+
+private:
+    //==============================================================================
+    enum { chunkBytes = 8192, maxRiceQuotient = 16 };
+
+    struct Chunk
+    {
+        std::vector<juce::uint8> bytes = std::vector<juce::uint8> ((size_t) chunkBytes, 0);
+        juce::int64 firstFrame = 0;
+        int numFrames = 0;
+        int bitsUsed = 0;
+
+        int bitsFree() const noexcept       { return chunkBytes * 8 - bitsUsed; }
+    };
+
+    struct BitWriter
+    {
+        explicit BitWriter (Chunk& c) : chunk (c) {}
+
+        void write (juce::uint32 value, int numBits) noexcept
+        {
+            for (int i = numBits; --i >= 0;)
+            {
+                auto& byte = chunk.bytes[(size_t) (chunk.bitsUsed >> 3)];
+                auto mask = (juce::uint8) (0x80 >> (chunk.bitsUsed & 7));
+                byte = (juce::uint8) (((value >> i) & 1) != 0 ? (byte | mask) : (byte & ~mask));
+                ++chunk.bitsUsed;
+            }
+        }
+
+        Chunk& chunk;
+    };
+
+    struct BitReader
+    {
+        explicit BitReader (const Chunk& c) : chunk (c) {}
+
+        juce::uint32 read (int numBits) noexcept
+        {
+            juce::uint32 value = 0;
+
+            for (int i = 0; i < numBits; ++i, ++position)
+                value = (value << 1) | (juce::uint32) ((chunk.bytes[(size_t) (position >> 3)] >> (7 - (position & 7))) & 1);
+
+            return value;
+        }
+
+        const Chunk& chunk;
+        int position = 0;
+    };
+
+    //==============================================================================
+    int quantise (float db) const noexcept
+    {
+        return juce::roundToInt (juce::jlimit (0.0f, 1.0f, (db - mindB) / (maxdB - mindB)) * 255.0f);
+    }
+
+    static juce::uint32 zigzag (int v) noexcept     { return (juce::uint32) (v >= 0 ? v * 2 : -v * 2 - 1); }
+    static int unzigzag (juce::uint32 v) noexcept   { return (v & 1) != 0 ? -(int) ((v + 1) >> 1) : (int) (v >> 1); }
+
+    int rawBits() const noexcept                    { return 1 + 8 * numBands; }
+
+    static int riceBits (juce::uint32 v, int k) noexcept
+    {
+        auto q = (int) (v >> k);
+        // quotients too long for unary are escaped and stored as 9 raw bits
+        return q < maxRiceQuotient ? q + 1 + k : maxRiceQuotient + 9;
+    }
+
+    int deltaBits (int k) const noexcept
+    {
+        int bits = 1 + 3;
+
+        for (int b = 0; b < numBands; ++b)
+            bits += riceBits (zigzag (current[(size_t) b] - previous[(size_t) b]), k);
+
+        return bits;
+    }
+
+    int bestRiceParameter() const noexcept
+    {
+        int best = 0;
+
+        for (int k = 1; k < 8; ++k)
+            if (deltaBits (k) < deltaBits (best))
+                best = k;
+
+        return best;
+    }
+
+    static void writeRice (BitWriter& writer, juce::uint32 v, int k) noexcept
+    {
+        auto q = (int) (v >> k);
+
+        if (q >= maxRiceQuotient)
+        {
+            for (int i = 0; i < maxRiceQuotient; ++i)
+                writer.write (1, 1);
+
+            writer.write (v, 9);
+            return;
+        }
+
+        for (int i = 0; i < q; ++i)
+            writer.write (1, 1);
+
+        writer.write (0, 1);
+        writer.write (v & ((1u << k) - 1), k);
+    }
+
+    static juce::uint32 readRice (BitReader& reader, int k) noexcept
+    {
+        juce::uint32 q = 0;
+
+        while (q < maxRiceQuotient && reader.read (1) != 0)
+            ++q;
+
+        if (q == maxRiceQuotient)
+            return reader.read (9);
+
+        return (q << k) | reader.read (k);
+    }
+
+    void startChunk()
+    {
+        if ((int) chunks.size() >= maxChunks)
+            dropOldestChunk();
+
+        std::unique_ptr<Chunk> chunk;
+
+        if (! spareChunks.empty())
+        {
+            chunk = std::move (spareChunks.back());
+            spareChunks.pop_back();
+        }
+        else
+        {
+            chunk.reset (new Chunk());
+        }
+
+        chunk->firstFrame = nextFrame;
+        chunk->numFrames = 0;
+        chunk->bitsUsed = 0;
+        chunks.push_back (std::move (chunk));
+    }
+
+    void dropOldestChunk()
+    {
+        spareChunks.push_back (std::move (chunks.front()));
+        chunks.pop_front();
+        firstFrame = chunks.empty() ? nextFrame : chunks.front()->firstFrame;
+    }
+
+    //==============================================================================
+    const double framesPerSecond;
+    const juce::int64 capacityFrames;
+    const float mindB, maxdB;
+
+    juce::CriticalSection lock;
+    int numBands = 0, maxChunks = 1;
+    std::deque<std::unique_ptr<Chunk>> chunks;
+    std::vector<std::unique_ptr<Chunk>> spareChunks;
+    juce::int64 firstFrame = 0, nextFrame = 0;
+    std::vector<int> previous, current;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumHistory)
+};
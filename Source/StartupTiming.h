@@ -0,0 +1,20 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Times startup from as near the start of the process as the app can get:
+    the clock starts at the first call to start() or getElapsedMs(), which the
+    application object's constructor makes as main() creates it.
+*/
+struct StartupTiming
+{
+    static void start() noexcept            { getElapsedMs(); }
+
+    static double getElapsedMs() noexcept
+    {
+        static const double start = juce::Time::getMillisecondCounterHiRes();
+        return juce::Time::getMillisecondCounterHiRes() - start;
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    Inter-channel phase correlation per band, from the cross-spectrum of a
+    left and a right frame.
+
+    For each band of the same tempered-scale map the bars use, the real part
+    of the cross-spectrum and the power of each channel are summed over the
+    band's bins and smoothed over time; their ratio Re{L R*} / sqrt(|L|^2 |R|^2)
+    is +1 where the channels are the same, 0 where they're unrelated and -1
+    where one is the other inverted, i.e. where a mono downmix cancels.
+
+    Like SpectrumAnalyser it has no threads or locks; whoever owns it feeds it
+    pairs of frames of getFFTSize() samples.
+*/
+class StereoCorrelation
+{
+public:
+    StereoCorrelation() = default;
+
+    /** (Re)allocates everything and forgets the averages. */
+    void prepare (int fftOrder, double sampleRate, int groupNotes = 2)
+    {
+        analyser.prepare (fftOrder, sampleRate, groupNotes);
+
+        auto numBands = (size_t) analyser.getNumBands();
+        cross.assign (numBands, 0.0);
+        leftPower.assign (numBands, 0.0);
+        rightPower.assign (numBands, 0.0);
+        correlations.assign (numBands, 1.0f);
+        active.assign (numBands, false);
+        totalCross = totalLeft = totalRight = 0.0;
+        overall = 1.0f;
+
+        left.resize ((size_t) (analyser.getFFTSize() + 2));
+        right.resize ((size_t) (analyser.getFFTSize() + 2));
+
+        // band power of a full-scale sine, as SpectrumAnalyser normalises it
+        referencePower = std::pow ((double) analyser.getFFTSize(), 2.0);
+    }
+
+    /** Adds one frame of each channel; smoothing is how much of the running average it replaces (0 to 1]. */
+    void process (const float* leftFrame, const float* rightFrame, float smoothing) noexcept
+    {
+        analyser.transform (leftFrame, left.data());
+        analyser.transform (rightFrame, right.data());
+
+        auto& bars = analyser.getScale().getBars();
+        auto numBins = analyser.getFFTSize() / 2 + 1;
+
+        for (size_t b = 0; b < bars.size() && b < cross.size(); ++b)
+        {
+            // bars that share a bin all get that bin
+            auto first = bars[b].dataIdx;
+            auto last = juce::jmin (numBins - 1, juce::jmax (first, bars[b].endIdx));
+            double c = 0.0, l = 0.0, r = 0.0;
+
+            for (int k = first; k <= last; ++k)
+            {
+                auto lr = (double) left[(size_t) (2 * k)],  li = (double) left[(size_t) (2 * k + 1)];
+                auto rr = (double) right[(size_t) (2 * k)], ri = (double) right[(size_t) (2 * k + 1)];
+
+                c += lr * rr + li * ri;
+                l += lr * lr + li * li;
+                r += rr * rr + ri * ri;
+            }
+
+            cross[b] += smoothing * (c - cross[b]);
+            leftPower[b] += smoothing * (l - leftPower[b]);
+            rightPower[b] += smoothing * (r - rightPower[b]);
+
+            active[b] = juce::jmax (leftPower[b], rightPower[b]) > referencePower * activeThreshold;
+            correlations[b] = active[b] ? toCorrelation (cross[b], leftPower[b], rightPower[b]) : 1.0f;
+        }
+
+        // summed over the bins rather than the bands, which share some of them
+        double c = 0.0, l = 0.0, r = 0.0;
+
+        for (int k = 1; k < numBins; ++k)
+        {
+            auto lr = (double) left[(size_t) (2 * k)],  li = (double) left[(size_t) (2 * k + 1)];
+            auto rr = (double) right[(size_t) (2 * k)], ri = (double) right[(size_t) (2 * k + 1)];
+
+            c += lr * rr + li * ri;
+            l += lr * lr + li * li;
+            r += rr * rr + ri * ri;
+        }
+
+        totalCross += smoothing * (c - totalCross);
+        totalLeft += smoothing * (l - totalLeft);
+        totalRight += smoothing * (r - totalRight);
+        overall = toCorrelation (totalCross, totalLeft, totalRight);
+    }
+
+    //==============================================================================
+    int getFFTSize() const noexcept                         { return analyser.getFFTSize(); }
+    int getNumBands() const noexcept                        { return (int) correlations.size(); }
+    const std::vector<float>& getFrequencies() const noexcept   { return analyser.getScale().getFrequencies(); }
+
+    /** Per band, from -1 to +1; bands too quiet to judge read +1. */
+    const std::vector<float>& getCorrelations() const noexcept  { return correlations; }
+
+    /** Whether a band has enough signal for its correlation to mean anything. */
+    bool isActive (int band) const noexcept                 { return active[(size_t) band]; }
+
+    /** Over the whole spectrum, power-weighted. */
+    float getOverall() const noexcept                       { return overall; }
+
+    /** The frequency ranges of consecutive active bands correlated below threshold: what a mono downmix loses. */
+    std::vector<juce::Range<float>> findOutOfPhaseRegions (float threshold) const
+    {
+        std::vector<juce::Range<float>> regions;
+        auto& frequencies = getFrequencies();
+
+        for (int b = 0; b < getNumBands(); ++b)
+        {
+            if (! active[(size_t) b] || correlations[(size_t) b] >= threshold)
+                continue;
+
+            auto first = b;
+
+            while (b + 1 < getNumBands() && active[(size_t) (b + 1)] && correlations[(size_t) (b + 1)] < threshold)
+                ++b;
+
+            regions.push_back ({ frequencies[(size_t) first], frequencies[(size_t) b] });
+        }
+
+        return regions;
+    }
+
+private:
+    static float toCorrelation (double c, double l, double r) noexcept
+    {
+        auto norm = std::sqrt (l * r);
+        return norm > 0.0 ? (float) juce::jlimit (-1.0, 1.0, c / norm) : 1.0f;
+    }
+
+    static constexpr double activeThreshold = 1.0e-7;   // -70 dB
+
+    SpectrumAnalyser analyser;
+    std::vector<float> left, right;
+    std::vector<double> cross, leftPower, rightPower;
+    std::vector<float> correlations;
+    std::vector<bool> active;
+    double totalCross = 0.0, totalLeft = 0.0, totalRight = 0.0;
+    double referencePower = 1.0;
+    float overall = 1.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StereoCorrelation)
+};
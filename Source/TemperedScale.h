@@ -0,0 +1,134 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+class Bar {
+public:
+    int posX;
+    int dataIdx;
+    int endIdx;
+    float factor;
+};
+
+//==============================================================================
+/**
+    Maps the equal tempered scale onto the bins of an FFT frame.
+
+    Each Bar either reads a single bin (optionally interpolated with the bin below
+    it when several bars share the same data) or spans a range of bins.
+*/
+class TemperedScale
+{
+public:
+    /**
+         * Precalculate the actual X-coordinate on screen for each analyzer bar
+         *
+         * Since the frequency scale is logarithmic, each position in the X-axis actually represents a power of 10.
+         * To improve performace, the position of each frequency is calculated in advance and stored in an array.
+         * Canvas space usage is optimized to accommodate exactly the frequency range the user needs.
+         * Positions need to be recalculated whenever the frequency range, FFT size or canvas size change.
+         *
+         *                                 +------------------------ canvas --------------------------+
+         *                                   |                                                                         |
+         *    |-------------------|-----|-------------|-------------------!-------------------|-------|------------|
+         *    1                  10       |            100                  1K                 10K         |           100K (Hz)
+         * (10^0)           (10^1)   |          (10^2)               (10^3)              (10^4)   |          (10^5)
+         *                              |-------------|<--- logWidth ---->|--------------------------|
+         *                  minFreq--> 20                   (pixels)                                22K <--maxFreq
+         *                          (10^1.3)                                                     (10^4.34)
+         *                           minLog
+         */
+    void build(int groupNotes, int newFftSize, double newSampleRate, float minFreq = 20.0f, float maxFreq = 22000.0f) {
+        fftSize = newFftSize;
+        sampleRate = newSampleRate;
+        temperedScale.clear();
+        allBars.clear();
+
+        float root24 = pow(2.0f, 1.0f / 24.0f);
+        float c0 = 440.0f * pow(root24, -114.0f); // ~16.35 Hz
+        float freq = 0.0f;
+
+        int i = 0;
+
+        // generate a table of frequencies based on the equal tempered scale
+        // https://en.wikipedia.org/wiki/Equal_temperament
+        while ((freq = c0 * pow(root24, i)) <= maxFreq) {
+            if (freq >= minFreq && i % groupNotes == 0) {
+                temperedScale.push_back(freq);
+            }
+            i++;
+        }
+
+        int prevBin = 0;
+        int prevIdx = 0;
+        int nBars = 0;
+
+        for (int index = 0; index < temperedScale.size(); index++) {
+            float freq = temperedScale[index];
+            // which FFT bin best represents this frequency?
+            float bin = freqToBin(freq);
+            int idx = 0;
+            int nextBin = 0;
+
+            // start from the last used FFT bin
+            if (prevBin > 0 && prevBin + 1 <= bin) {
+                idx = prevBin + 1;
+            } else {
+                idx = bin;
+            }
+
+            // FFT does not provide many coefficients for low frequencies, so several bars may end up using the same data
+            if (idx == prevIdx) {
+                nBars++;
+            } else {
+                // update previous bars using the same index with an interpolation factor
+                if (nBars > 1) {
+                    for (int iFactor = 0; iFactor < nBars; iFactor++) {
+                        float factor = ((float)iFactor + 1) / (float)nBars;
+                        allBars[allBars.size() - nBars + iFactor].factor = factor;
+                    }
+                }
+                prevIdx = idx;
+                nBars = 1;
+            }
+
+            prevBin = nextBin = bin;
+
+            // check if there's another band after this one
+            if (index + 1 < temperedScale.size()) {
+                nextBin = freqToBin(temperedScale[index + 1]);
+                // and use half the bins in between for this band
+                if (nextBin - bin > 1) {
+                    prevBin += round((nextBin - bin) / 2);
+                }
+            }
+
+            int endIdx = prevBin - idx > 0 ? prevBin : 0;
+
+            Bar bar;
+            bar.posX = index;
+            bar.dataIdx = idx;
+            bar.endIdx = endIdx;
+            bar.factor = 0;
+
+            allBars.push_back(bar);
+        }
+    }
+
+    float freqToBin(double freq) const {
+        float bin = round((freq * fftSize) / sampleRate);
+
+        return bin < (fftSize / 2) ? bin : fftSize - 1;
+    }
+
+    const std::vector<float>& getFrequencies() const { return temperedScale; }
+    const std::vector<Bar>& getBars() const          { return allBars; }
+    int getNumBands() const                          { return (int) temperedScale.size(); }
+
+private:
+    std::vector<float> temperedScale;
+    std::vector<Bar> allBars;
+    int fftSize = 0;
+    double sampleRate = 44100.0;
+};
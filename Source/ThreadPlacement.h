@@ -0,0 +1,203 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+//==============================================================================
+/**
+    Where a worker thread should run and at which priority.
+
+    Built from command line options sharing a prefix, e.g. for "--analysis":
+
+        --analysis-cpus=2,3         pin to these logical cores
+        --analysis-numa=1           pin to every core of this NUMA node (Linux)
+        --analysis-rt-priority=70   SCHED_FIFO priority 1-99 where allowed
+
+    Each worker calls applyToCurrentThread() as the first thing in its run()
+    and logs the returned report, which describes the placement that actually
+    took effect (requests the OS refuses are reported, not fatal).
+*/
+struct ThreadPlacement
+{
+    std::vector<int> cpus;
+    int numaNode = -1;
+    int realtimePriority = 0;
+
+    bool isDefault() const noexcept     { return cpus.empty() && numaNode < 0 && realtimePriority <= 0; }
+
+    static ThreadPlacement fromArguments (const juce::ArgumentList& args, const juce::String& prefix)
+    {
+        ThreadPlacement placement;
+
+        auto cpuList = args.getValueForOption (prefix + "-cpus");
+
+        if (cpuList.isNotEmpty())
+            placement.cpus = parseCpuList (cpuList);
+
+        auto node = args.getValueForOption (prefix + "-numa");
+
+        if (node.isNotEmpty())
+            placement.numaNode = node.getIntValue();
+
+        auto priority = args.getValueForOption (prefix + "-rt-priority");
+
+        if (priority.isNotEmpty())
+            placement.realtimePriority = juce::jlimit (1, 99, priority.getIntValue());
+
+        return placement;
+    }
+
+    /** Parses "0-3,8,10-11" style lists, as used by taskset and sysfs. */
+    static std::vector<int> parseCpuList (const juce::String& text)
+    {
+        std::vector<int> result;
+
+        for (auto& token : juce::StringArray::fromTokens (text.trim(), ",", ""))
+        {
+            if (token.contains ("-"))
+            {
+                auto first = token.upToFirstOccurrenceOf ("-", false, false).getIntValue();
+                auto last  = token.fromFirstOccurrenceOf ("-", false, false).getIntValue();
+
+                for (int cpu = first; cpu <= last; ++cpu)
+                    result.push_back (cpu);
+            }
+            else if (token.trim().isNotEmpty())
+            {
+                result.push_back (token.getIntValue());
+            }
+        }
+
+        return result;
+    }
+
+    //==============================================================================
+    /** Applies the placement to the calling thread and returns a report of the effective placement. */
+    juce::String applyToCurrentThread() const
+    {
+        juce::String report;
+        auto targetCpus = cpus;
+
+        if (numaNode >= 0)
+        {
+            auto nodeCpus = juce::File ("/sys/devices/system/node/node" + juce::String (numaNode) + "/cpulist");
+
+            if (nodeCpus.existsAsFile())
+            {
+                // explicit cores narrow the node down rather than adding to it
+                targetCpus.clear();
+
+                for (auto cpu : parseCpuList (nodeCpus.loadFileAsString()))
+                    if (cpus.empty() || std::find (cpus.begin(), cpus.end(), cpu) != cpus.end())
+                        targetCpus.push_back (cpu);
+            }
+            else
+            {
+                report << "NUMA node " << juce::String (numaNode) << " not found; ";
+            }
+        }
+
+        if (! targetCpus.empty())
+            report << applyAffinity (targetCpus);
+
+        if (realtimePriority > 0)
+            report << applyPriority (realtimePriority);
+
+        return report + describeCurrentThread();
+    }
+
+    /** Describes the affinity, scheduling policy and current core of the calling thread. */
+    static juce::String describeCurrentThread()
+    {
+       #if JUCE_LINUX
+        juce::String text;
+
+        cpu_set_t set;
+        CPU_ZERO (&set);
+
+        if (pthread_getaffinity_np (pthread_self(), sizeof (set), &set) == 0)
+        {
+            juce::StringArray allowed;
+
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET (cpu, &set))
+                    allowed.add (juce::String (cpu));
+
+            text << "cpus=" << allowed.joinIntoString (",");
+        }
+
+        text << " running-on=" << juce::String (sched_getcpu());
+        return text + " " + describeScheduling();
+       #elif JUCE_MAC || JUCE_BSD
+        return describeScheduling();
+       #else
+        return "placement report not available on this platform";
+       #endif
+    }
+
+private:
+    juce::String applyAffinity (const std::vector<int>& targetCpus) const
+    {
+       #if JUCE_LINUX
+        cpu_set_t set;
+        CPU_ZERO (&set);
+
+        for (auto cpu : targetCpus)
+            if (juce::isPositiveAndBelow (cpu, (int) CPU_SETSIZE))
+                CPU_SET (cpu, &set);
+
+        if (pthread_setaffinity_np (pthread_self(), sizeof (set), &set) != 0)
+            return "affinity refused; ";
+
+        return {};
+       #else
+        // elsewhere JUCE only takes a 32-bit mask, and macOS treats it as a hint
+        juce::uint32 mask = 0;
+
+        for (auto cpu : targetCpus)
+            if (juce::isPositiveAndBelow (cpu, 32))
+                mask |= (juce::uint32) 1 << cpu;
+
+        juce::Thread::setCurrentThreadAffinityMask (mask);
+        return {};
+       #endif
+    }
+
+    static juce::String applyPriority (int priority)
+    {
+       #if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+        sched_param param;
+        param.sched_priority = juce::jlimit (sched_get_priority_min (SCHED_FIFO),
+                                             sched_get_priority_max (SCHED_FIFO),
+                                             priority);
+
+        if (pthread_setschedparam (pthread_self(), SCHED_FIFO, &param) != 0)
+            return "SCHED_FIFO refused (needs CAP_SYS_NICE or an rtprio limit); ";
+
+        return {};
+       #else
+        juce::ignoreUnused (priority);
+        juce::Thread::setCurrentThreadPriority (10);
+        return {};
+       #endif
+    }
+
+   #if JUCE_LINUX || JUCE_MAC || JUCE_BSD
+    static juce::String describeScheduling()
+    {
+        int policy = 0;
+        sched_param param;
+
+        if (pthread_getschedparam (pthread_self(), &policy, &param) != 0)
+            return {};
+
+        juce::String name (policy == SCHED_FIFO ? "SCHED_FIFO" : policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER");
+        return "policy=" + name + " priority=" + juce::String (param.sched_priority);
+    }
+   #endif
+};
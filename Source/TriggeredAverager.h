@@ -0,0 +1,338 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include "SampleHistory.h"
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    Captures frames aligned to trigger events and averages them coherently.
+
+    A trigger is an edge through a level, either on the analysed signal itself
+    or on an external channel such as a tachometer or a test sequence's sync
+    output, with hysteresis so noise near the level doesn't retrigger. Each
+    edge is located to a fraction of a sample.
+
+    Every trigger's frame starts a fixed part of a frame before the edge. The
+    SampleHistory already holds seconds of input, so those frames are read
+    straight out of it once the input has caught up, with no pre-trigger
+    buffering of their own. Each frame is transformed, turned by the edge's
+    sub-sample offset so all frames line up exactly, and added to a running
+    complex sum.
+
+    Signal that repeats with the trigger adds up in phase while uncorrelated
+    noise doesn't, so the noise floor of the coherent average drops by
+    another 3 dB every time the number of frames doubles, which a power
+    average never does. Both are kept, so the difference can be seen.
+    Averaging is cumulative until maxAverages frames, then exponential over
+    that many.
+*/
+class TriggeredAverager  : private juce::Thread
+{
+public:
+    struct Settings
+    {
+        enum class Source { off, level, external };
+
+        Source source = Source::off;
+        int externalChannel = 1;
+        float levelDb = -20.0f;         // the edge's level, in dBFS
+        bool rising = true;
+        float preTrigger = 0.25f;       // the part of each frame before the edge
+        double holdoffSeconds = -1.0;   // minimum time between triggers; -1 for half a frame
+        int maxAverages = 0;            // 0 averages everything since the last reset
+
+        bool isEnabled() const noexcept     { return source != Source::off; }
+
+        static Settings fromArguments (const juce::ArgumentList& args)
+        {
+            Settings settings;
+            auto source = args.getValueForOption ("--trigger");
+
+            if (source == "level")              settings.source = Source::level;
+            else if (source == "external")      settings.source = Source::external;
+
+            if (args.containsOption ("--trigger-channel"))
+                settings.externalChannel = juce::jmax (0, args.getValueForOption ("--trigger-channel").getIntValue() - 1);
+
+            if (args.containsOption ("--trigger-level"))
+                settings.levelDb = juce::jlimit (-90.0f, 0.0f, args.getValueForOption ("--trigger-level").getFloatValue());
+
+            settings.rising = args.getValueForOption ("--trigger-slope") != "falling";
+
+            if (args.containsOption ("--trigger-pre"))
+                settings.preTrigger = juce::jlimit (0.0f, 1.0f, args.getValueForOption ("--trigger-pre").getFloatValue());
+
+            if (args.containsOption ("--trigger-holdoff"))
+                settings.holdoffSeconds = juce::jmax (0.0, args.getValueForOption ("--trigger-holdoff").getDoubleValue());
+
+            if (args.containsOption ("--trigger-averages"))
+                settings.maxAverages = juce::jmax (0, args.getValueForOption ("--trigger-averages").getIntValue());
+
+            return settings;
+        }
+    };
+
+    TriggeredAverager (const SampleHistory& historyToRead, const Settings& settingsToUse)
+        : juce::Thread ("Triggered averager"),
+          history (historyToRead),
+          settings (settingsToUse),
+          triggerChannel (settings.source == Settings::Source::external ? juce::jmin (settings.externalChannel, history.getNumChannels() - 1) : 0)
+    {
+    }
+
+    ~TriggeredAverager() override
+    {
+        stopAveraging();
+    }
+
+    /** Starts over from the current input position. */
+    void prepare (int fftOrder, double newSampleRate, int groupNotes)
+    {
+        const juce::ScopedLock sl (lock);
+
+        sampleRate = newSampleRate;
+        analyser.prepare (fftOrder, sampleRate, groupNotes);
+
+        auto fftSize = analyser.getFFTSize();
+        frame.resize ((size_t) fftSize);
+        spectrum.resize ((size_t) (fftSize + 2));
+        magnitudes.resize ((size_t) (fftSize / 2));
+        scan.resize ((size_t) scanBlockSize);
+
+        preTriggerSamples = juce::roundToInt (settings.preTrigger * (float) fftSize);
+        holdoffSamples = settings.holdoffSeconds < 0.0 ? (double) fftSize / 2.0 : settings.holdoffSeconds * sampleRate;
+
+        scanPosition = history.getWritePosition();
+        lastTrigger = -1.0e18;
+        armed = false;
+        previousSample = 0.0f;
+        pending.clear();
+        resetAverages();
+    }
+
+    void startAveraging()   { startThread(); }
+    void stopAveraging()    { stopThread (2000); }
+
+    /** Clears the averages; triggering carries on. */
+    void reset()
+    {
+        const juce::ScopedLock sl (lock);
+        resetAverages();
+    }
+
+    struct Result
+    {
+        int numAverages = 0;
+        double triggerRateHz = 0.0;
+        juce::int64 missedTriggers = 0;     // came faster than they could be analysed
+        std::vector<float> coherent, power; // band levels in dB
+    };
+
+    /** Returns false if nothing has been averaged since the last call. */
+    bool pullResult (Result& result)
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (! updated)
+            return false;
+
+        updated = false;
+        result.numAverages = numAverages;
+        result.triggerRateHz = triggerRateHz;
+        result.missedTriggers = missedTriggers;
+
+        auto numBins = (int) magnitudes.size();
+        auto weight = numAverages > 0 ? 1.0 / weightSum : 0.0;
+
+        for (int k = 0; k < numBins; ++k)
+            magnitudes[(size_t) k] = (float) (std::hypot (sumRe[(size_t) k], sumIm[(size_t) k]) * weight);
+
+        analyser.processMagnitudes (magnitudes.data());
+        result.coherent = analyser.getLevels();
+
+        for (int k = 0; k < numBins; ++k)
+            magnitudes[(size_t) k] = (float) std::sqrt (sumPower[(size_t) k] * weight);
+
+        analyser.processMagnitudes (magnitudes.data());
+        result.power = analyser.getLevels();
+        return true;
+    }
+
+private:
+    //==============================================================================
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (pollIntervalMs);
+
+            const juce::ScopedLock sl (lock);
+            findTriggers();
+            averageReadyFrames();
+        }
+    }
+
+    /** Scans the trigger channel up to the newest input for edges through the level. */
+    void findTriggers()
+    {
+        auto writePosition = history.getWritePosition();
+
+        // fell so far behind that the ring has been overwritten: start afresh from now
+        if (writePosition - scanPosition > SampleHistory::capacity / 2)
+        {
+            scanPosition = writePosition;
+            armed = false;
+        }
+
+        auto threshold = juce::Decibels::decibelsToGain (settings.levelDb);
+        auto rearm = settings.rising ? threshold * 0.5f : threshold * 1.5f;
+
+        while (scanPosition < writePosition)
+        {
+            auto numSamples = (int) juce::jmin ((juce::int64) scanBlockSize, writePosition - scanPosition);
+            history.read (triggerChannel, scanPosition + numSamples, scan.data(), numSamples);
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                auto x = scan[(size_t) i];
+
+                if (! armed)
+                {
+                    armed = settings.rising ? x < rearm : x > rearm;
+                }
+                else if (settings.rising ? x >= threshold : x <= threshold)
+                {
+                    // where between the last sample and this one the signal crossed the level
+                    auto fraction = (double) ((threshold - previousSample) / (x - previousSample));
+                    addTrigger ((double) (scanPosition + i - 1) + juce::jlimit (0.0, 1.0, fraction));
+                    armed = false;
+                }
+
+                previousSample = x;
+            }
+
+            scanPosition += numSamples;
+        }
+    }
+
+    void addTrigger (double position)
+    {
+        if (position - lastTrigger < holdoffSamples)
+            return;
+
+        if (lastTrigger > 0.0)
+            triggerRateHz += 0.1 * (sampleRate / (position - lastTrigger) - triggerRateHz);
+
+        lastTrigger = position;
+
+        if (pending.size() >= maxPendingTriggers)
+        {
+            pending.pop_front();
+            ++missedTriggers;
+        }
+
+        pending.push_back (position);
+    }
+
+    /** Averages the frames of the triggers whose input has all arrived. */
+    void averageReadyFrames()
+    {
+        auto fftSize = analyser.getFFTSize();
+        auto writePosition = history.getWritePosition();
+
+        while (! pending.empty())
+        {
+            auto trigger = pending.front();
+            auto whole = (juce::int64) std::floor (trigger);
+            auto frameEnd = whole - preTriggerSamples + fftSize;
+
+            if (frameEnd > writePosition)
+                return;
+
+            pending.pop_front();
+
+            if (writePosition - frameEnd > SampleHistory::capacity / 2)
+            {
+                ++missedTriggers;
+                continue;
+            }
+
+            history.read (0, frameEnd, frame.data(), fftSize);
+            analyser.transform (frame.data(), spectrum.data());
+            addFrame (trigger - (double) whole);
+        }
+    }
+
+    /** Adds the spectrum in, advanced by the edge's fraction of a sample so every frame lines up. */
+    void addFrame (double fraction) noexcept
+    {
+        auto numBins = (int) magnitudes.size();
+        auto fftSize = analyser.getFFTSize();
+
+        // cumulative to begin with, then exponential over maxAverages frames
+        auto decay = settings.maxAverages > 0 && numAverages >= settings.maxAverages
+                        ? 1.0 - 1.0 / settings.maxAverages : 1.0;
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            auto re = (double) spectrum[(size_t) (2 * k)];
+            auto im = (double) spectrum[(size_t) (2 * k + 1)];
+            auto angle = juce::MathConstants<double>::twoPi * k * fraction / fftSize;
+            auto c = std::cos (angle), s = std::sin (angle);
+
+            sumRe[(size_t) k] = sumRe[(size_t) k] * decay + (re * c - im * s);
+            sumIm[(size_t) k] = sumIm[(size_t) k] * decay + (re * s + im * c);
+            sumPower[(size_t) k] = sumPower[(size_t) k] * decay + (re * re + im * im);
+        }
+
+        weightSum = weightSum * decay + 1.0;
+        ++numAverages;
+        updated = true;
+    }
+
+    void resetAverages()
+    {
+        auto numBins = magnitudes.size();
+        sumRe.assign (numBins, 0.0);
+        sumIm.assign (numBins, 0.0);
+        sumPower.assign (numBins, 0.0);
+        weightSum = 0.0;
+        numAverages = 0;
+        missedTriggers = 0;
+        updated = true;
+    }
+
+    //==============================================================================
+    enum { pollIntervalMs = 20, scanBlockSize = 4096 };
+    static constexpr size_t maxPendingTriggers = 64;
+
+    const SampleHistory& history;
+    const Settings settings;
+    const int triggerChannel;
+
+    juce::CriticalSection lock;
+    SpectrumAnalyser analyser;
+    double sampleRate = 44100.0;
+    std::vector<float> frame, spectrum, magnitudes, scan;
+    int preTriggerSamples = 0;
+    double holdoffSamples = 0.0;
+
+    juce::int64 scanPosition = 0;
+    bool armed = false;
+    float previousSample = 0.0f;
+    double lastTrigger = 0.0, triggerRateHz = 0.0;
+    std::deque<double> pending;
+
+    std::vector<double> sumRe, sumIm, sumPower;
+    double weightSum = 0.0;
+    int numAverages = 0;
+    juce::int64 missedTriggers = 0;
+    bool updated = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TriggeredAverager)
+};
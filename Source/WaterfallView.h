@@ -0,0 +1,125 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "ReassignedSpectrogram.h"
+
+//==============================================================================
+/**
+    A scrolling spectrogram of the tempered-scale bands, newest on the right
+    and low bands at the bottom, read from the ReassignedSpectrogram the
+    analysis thread fills.
+
+    Each refresh copies the columns finished since the last one into a ring
+    of image columns, so drawing costs the same however fast the input
+    scrolls. The label says whether the display is reassigned and what the
+    extra transforms cost per frame, against the hop they have to fit in. A
+    click toggles reassignment, to compare the two.
+*/
+class WaterfallView  : public juce::Component
+{
+public:
+    explicit WaterfallView (ReassignedSpectrogram& spectrogramToRead)
+        : spectrogram (spectrogramToRead)
+    {
+        for (int i = 0; i < paletteSize; ++i)
+        {
+            auto t = (float) i / (float) (paletteSize - 1);
+            palette[i] = juce::Colour::fromHSV (0.7f - 0.55f * t, 0.9f, t, 1.0f);
+        }
+
+        setOpaque (true);
+    }
+
+    /** Copies in the newly finished columns and repaints; called by the owner's timer. */
+    void refresh()
+    {
+        auto numBands = spectrogram.getNumBands();
+        auto columnSamples = spectrogram.getColumnSamples();
+
+        // a new frame size, hop or banding: the old columns don't line up with the new ones
+        if (numBands != imageBands || columnSamples != imageColumnSamples)
+        {
+            imageBands = numBands;
+            imageColumnSamples = columnSamples;
+            image = juce::Image (juce::Image::RGB, imageWidth, juce::jmax (1, numBands), true);
+            nextColumn = spectrogram.getNumFinishedColumns();
+            writeX = 0;
+        }
+
+        auto finished = spectrogram.getNumFinishedColumns();
+
+        // restarted, or hidden for longer than the image covers
+        if (finished < nextColumn || finished - nextColumn > imageWidth)
+            nextColumn = juce::jmax ((juce::int64) 0, finished - imageWidth);
+
+        column.resize ((size_t) juce::jmax (1, numBands));
+
+        if (nextColumn < finished)
+        {
+            juce::Image::BitmapData pixels (image, juce::Image::BitmapData::writeOnly);
+
+            for (; nextColumn < finished; ++nextColumn)
+            {
+                auto held = spectrogram.readColumn (nextColumn, column.data());
+
+                for (int b = 0; b < numBands; ++b)
+                {
+                    auto level = held ? column[(size_t) b] : SpectrumAnalyser::mindB;
+                    auto index = juce::roundToInt (juce::jmap (level, SpectrumAnalyser::mindB, SpectrumAnalyser::maxdB,
+                                                               0.0f, (float) (paletteSize - 1)));
+                    pixels.setPixelColour (writeX, numBands - 1 - b, palette[juce::jlimit (0, paletteSize - 1, index)]);
+                }
+
+                writeX = (writeX + 1) % imageWidth;
+            }
+        }
+
+        repaint();
+    }
+
+    //==============================================================================
+    void paint (juce::Graphics& g) override
+    {
+        g.fillAll (juce::Colours::black);
+
+        if (imageBands <= 0)
+            return;
+
+        // the ring's oldest column is at writeX: draw from there to its end, then its start
+        auto width = getWidth(), height = getHeight();
+        auto split = juce::roundToInt ((float) width * (float) (imageWidth - writeX) / (float) imageWidth);
+
+        g.drawImage (image, 0, 0, split, height, writeX, 0, imageWidth - writeX, imageBands);
+        g.drawImage (image, split, 0, width - split, height, 0, 0, writeX, imageBands);
+
+        auto frameMs = spectrogram.getAverageMs();
+        auto hopMs = 1000.0 * imageColumnSamples / spectrogram.getSampleRate();
+
+        g.setColour (juce::Colours::grey);
+        g.drawText (juce::String (spectrogram.isReassigning() ? "reassigned" : "plain") + "  "
+                      + juce::String (frameMs, 2) + " ms per frame ("
+                      + juce::String (juce::roundToInt (100.0 * frameMs / hopMs)) + "% of hop)",
+                    getLocalBounds().reduced (6), juce::Justification::topLeft);
+    }
+
+    void mouseDown (const juce::MouseEvent&) override
+    {
+        spectrogram.setReassigning (! spectrogram.isReassigning());
+        repaint();
+    }
+
+private:
+    //==============================================================================
+    enum { imageWidth = 512, paletteSize = 256 };
+
+    ReassignedSpectrogram& spectrogram;
+    juce::Colour palette[paletteSize];
+
+    juce::Image image;
+    int imageBands = 0, imageColumnSamples = 0, writeX = 0;
+    juce::int64 nextColumn = 0;
+    std::vector<float> column;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaterfallView)
+};
@@ -0,0 +1,421 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "PcmFormat.h"
+
+#if JUCE_LINUX
+ #include <poll.h>
+ #include <sys/inotify.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+/**
+    Follows a WAV file that another program is still recording into, and plays
+    the newly appended samples out like an audio device would.
+
+    Recorders usually leave the data chunk's size at 0 (or 0xffffffff) until
+    they close the file, or update it now and then, so the end of the data is
+    taken from the file's size; the header's size is trusted only once another
+    chunk follows the data, which means the file is finished.
+
+    On Linux the thread sleeps on inotify until the file changes; elsewhere it
+    polls. New samples are read with a plain buffered stream from where the
+    last read stopped, converted by PcmFormat, and handed to onBlock in blocks
+    paced by the local clock so the analysis sees a steady stream even when the
+    recorder writes in bursts. If the writer gets more than maxLatencySeconds
+    ahead, playout skips forward rather than falling further behind. If the
+    file is replaced or truncated (the recorder started a new take) it's
+    reopened and followed from its end.
+*/
+class WavTailFollower  : private juce::Thread
+{
+public:
+    struct Status
+    {
+        bool following = false;     // false until the file exists and has a readable header
+        double sampleRate = 0.0;
+        int numChannels = 0;
+        double latencyMs = 0.0;     // how far playout is behind the writer
+        double skippedSeconds = 0.0;
+        int reopens = 0;
+        juce::String error;
+    };
+
+    WavTailFollower (const juce::File& fileToFollow, double maxLatencySecondsToUse)
+        : juce::Thread ("WAV follower"),
+          file (fileToFollow),
+          maxLatencySeconds (maxLatencySecondsToUse)
+    {
+    }
+
+    ~WavTailFollower() override
+    {
+        stopFollowing();
+    }
+
+    void startFollowing()   { startThread(); }
+    void stopFollowing()    { stopThread (2000); }
+
+    const juce::File& getFile() const noexcept      { return file; }
+
+    Status getStatus() const
+    {
+        const juce::SpinLock::ScopedLockType sl (statusLock);
+        return status;
+    }
+
+    /** Called on the follower thread once the file's format is known, before any blocks. */
+    std::function<void (double sampleRate, int numChannels)> onFormatChanged;
+
+    /** Called on the follower thread with each block of blockSize samples. */
+    std::function<void (const float* const* channelData, int numChannels, int numSamples)> onBlock;
+
+    enum { blockSize = 256 };
+
+private:
+    //==============================================================================
+    void run() override
+    {
+        openWatch();
+
+        while (! threadShouldExit())
+        {
+            if (stream == nullptr && ! open())
+            {
+                waitForChange (500);
+                continue;
+            }
+
+            auto available = findAvailableFrames();
+
+            if (available < 0)
+            {
+                // shrank or vanished: a new take
+                close();
+
+                const juce::SpinLock::ScopedLockType sl (statusLock);
+                ++status.reopens;
+                continue;
+            }
+
+            auto backlog = available - position;
+
+            if (backlog > (juce::int64) (format.sampleRate * maxLatencySeconds))
+            {
+                auto target = available - (juce::int64) (format.sampleRate * maxLatencySeconds / 2.0);
+                addSkipped ((double) (target - position) / format.sampleRate);
+                position = target;
+                backlog = available - position;
+            }
+
+            updateLatency (backlog);
+
+            if (backlog < blockSize)
+            {
+                waitForChange (100);
+                nextBlockDue = juce::Time::getMillisecondCounterHiRes();
+                continue;
+            }
+
+            auto waitMs = (int) (nextBlockDue - juce::Time::getMillisecondCounterHiRes());
+
+            // past half the allowed latency, drain without waiting so skips stay rare
+            if (waitMs > 0 && backlog < (juce::int64) (format.sampleRate * maxLatencySeconds / 2.0))
+                wait (waitMs);
+
+            // more than one block behind the pace: catch up a block at a time, without bursting
+            nextBlockDue = juce::jmax (nextBlockDue + blockMs, juce::Time::getMillisecondCounterHiRes() - blockMs);
+
+            if (! playBlock())
+                close();
+        }
+
+        close();
+        closeWatch();
+    }
+
+    //==============================================================================
+    bool open()
+    {
+        stream.reset (new juce::FileInputStream (file));
+
+        juce::String error;
+
+        if (stream->failedToOpen() || ! readHeader (error))
+        {
+            stream = nullptr;
+
+            // a missing or still-empty file is normal while waiting for the recorder
+            if (error.isNotEmpty())
+                setError (error);
+
+            return false;
+        }
+
+        position = juce::jmax ((juce::int64) 0, findAvailableFrames());
+        raw.resize ((size_t) (blockSize * format.getBytesPerFrame()));
+        block.setSize (format.numChannels, blockSize);
+        blockMs = 1000.0 * blockSize / format.sampleRate;
+        nextBlockDue = juce::Time::getMillisecondCounterHiRes();
+
+        {
+            const juce::SpinLock::ScopedLockType sl (statusLock);
+            status.following = true;
+            status.sampleRate = format.sampleRate;
+            status.numChannels = format.numChannels;
+            status.error = {};
+        }
+
+        std::cout << "following " << file.getFullPathName() << ": " << format.numChannels << " channels at "
+                  << format.sampleRate << " Hz" << std::endl;
+
+        if (onFormatChanged != nullptr)
+            onFormatChanged (format.sampleRate, format.numChannels);
+
+        return true;
+    }
+
+    void close()
+    {
+        if (stream == nullptr)
+            return;
+
+        stream = nullptr;
+        position = 0;   // so the next take isn't measured against this one's length
+
+        const juce::SpinLock::ScopedLockType sl (statusLock);
+        status.following = false;
+    }
+
+    /** Finds the fmt and data chunks; leaves error empty if the header just isn't all there yet. */
+    bool readHeader (juce::String& error)
+    {
+        char id[4];
+
+        if (stream->read (id, 4) != 4 || memcmp (id, "RIFF", 4) != 0)
+        {
+            if (stream->getTotalLength() >= 12)
+                error = file.getFileName() + " isn't a WAV file";
+
+            return false;
+        }
+
+        stream->readInt();
+
+        if (stream->read (id, 4) != 4 || memcmp (id, "WAVE", 4) != 0)
+            return false;
+
+        bool haveFormat = false;
+
+        while (stream->read (id, 4) == 4)
+        {
+            auto chunkSize = (juce::uint32) stream->readInt();
+            auto chunkStart = stream->getPosition();
+
+            if (memcmp (id, "fmt ", 4) == 0)
+            {
+                auto tag = (int) (juce::uint16) stream->readShort();
+                format.numChannels = (int) (juce::uint16) stream->readShort();
+                format.sampleRate = (double) stream->readInt();
+                stream->readInt();
+                stream->readShort();
+                auto bits = (int) (juce::uint16) stream->readShort();
+
+                // WAVE_FORMAT_EXTENSIBLE keeps the real tag at the start of its subformat GUID
+                if (tag == 0xfffe && chunkSize >= 40)
+                {
+                    stream->setPosition (chunkStart + 24);
+                    tag = (int) (juce::uint16) stream->readShort();
+                }
+
+                if (tag == 1 && bits == 16)         format.encoding = PcmFormat::Encoding::s16le;
+                else if (tag == 1 && bits == 24)    format.encoding = PcmFormat::Encoding::s24le;
+                else if (tag == 1 && bits == 32)    format.encoding = PcmFormat::Encoding::s32le;
+                else if (tag == 3 && bits == 32)    format.encoding = PcmFormat::Encoding::f32le;
+                else
+                {
+                    error = file.getFileName() + ": only 16, 24 and 32-bit PCM and 32-bit float can be followed";
+                    return false;
+                }
+
+                if (format.numChannels < 1 || format.sampleRate < 1000.0)
+                {
+                    error = file.getFileName() + " has a broken fmt chunk";
+                    return false;
+                }
+
+                haveFormat = true;
+            }
+            else if (memcmp (id, "data", 4) == 0)
+            {
+                if (! haveFormat)
+                {
+                    error = file.getFileName() + " has its data before its format";
+                    return false;
+                }
+
+                dataStart = chunkStart;
+                dataSizeField = chunkStart - 4;
+                return true;
+            }
+
+            stream->setPosition (chunkStart + chunkSize + (chunkSize & 1));
+        }
+
+        return false;
+    }
+
+    /** How many whole frames the data chunk holds now, or -1 if the file has shrunk or gone. */
+    juce::int64 findAvailableFrames()
+    {
+        auto fileSize = stream->getTotalLength();
+        auto bytesInFile = fileSize - dataStart;
+
+        if (fileSize <= 0 || bytesInFile < 0 || (position > 0 && bytesInFile < position * format.getBytesPerFrame()))
+            return -1;
+
+        stream->setPosition (dataSizeField);
+        auto declared = (juce::int64) (juce::uint32) stream->readInt();
+        auto bytes = bytesInFile;
+
+        // another chunk after the data means the recorder has finished and the size is final;
+        // a size it updated mid-recording has more samples after it instead
+        if (declared != 0 && declared != 0xffffffff && declared < bytesInFile
+             && isChunkAt (dataStart + declared + (declared & 1), fileSize))
+            bytes = declared;
+
+        return bytes / format.getBytesPerFrame();
+    }
+
+    /** True if what's at this offset looks like a chunk header: a printable id and a size that fits. */
+    bool isChunkAt (juce::int64 offset, juce::int64 fileSize)
+    {
+        juce::uint8 id[4];
+
+        if (offset + 8 > fileSize || ! stream->setPosition (offset) || stream->read (id, 4) != 4)
+            return false;
+
+        for (auto c : id)
+            if (c < 0x20 || c > 0x7e)
+                return false;
+
+        return offset + 8 + (juce::int64) (juce::uint32) stream->readInt() <= fileSize;
+    }
+
+    bool playBlock()
+    {
+        auto numBytes = (int) raw.size();
+
+        if (! stream->setPosition (dataStart + position * format.getBytesPerFrame())
+             || stream->read (raw.data(), numBytes) != numBytes)
+            return false;
+
+        format.convert (raw.data(), blockSize, block.getArrayOfWritePointers());
+        position += blockSize;
+
+        if (onBlock != nullptr)
+            onBlock (block.getArrayOfReadPointers(), format.numChannels, blockSize);
+
+        return true;
+    }
+
+    //==============================================================================
+    void openWatch()
+    {
+       #if JUCE_LINUX
+        // watch the folder rather than the file, so that a new take under the same name is noticed too
+        inotifyFd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+
+        if (inotifyFd >= 0)
+            inotify_add_watch (inotifyFd, file.getParentDirectory().getFullPathName().toRawUTF8(),
+                               IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE);
+       #endif
+    }
+
+    void closeWatch()
+    {
+       #if JUCE_LINUX
+        if (inotifyFd >= 0)
+            ::close (inotifyFd);
+
+        inotifyFd = -1;
+       #endif
+    }
+
+    /** Sleeps until the folder changes or timeoutMs passes. */
+    void waitForChange (int timeoutMs)
+    {
+       #if JUCE_LINUX
+        if (inotifyFd >= 0)
+        {
+            // wake every pollIntervalMs anyway, to notice stopThread()
+            pollfd fd { inotifyFd, POLLIN, 0 };
+
+            for (int waited = 0; waited < timeoutMs && ! threadShouldExit(); waited += pollIntervalMs)
+            {
+                if (poll (&fd, 1, pollIntervalMs) > 0)
+                {
+                    char events[4096];
+
+                    while (read (inotifyFd, events, sizeof (events)) > 0)
+                    {}
+
+                    return;
+                }
+            }
+
+            return;
+        }
+       #endif
+
+        wait (juce::jmin (timeoutMs, (int) pollIntervalMs));
+    }
+
+    //==============================================================================
+    void updateLatency (juce::int64 backlog)
+    {
+        const juce::SpinLock::ScopedLockType sl (statusLock);
+        status.latencyMs = 1000.0 * (double) backlog / format.sampleRate;
+    }
+
+    void addSkipped (double seconds)
+    {
+        const juce::SpinLock::ScopedLockType sl (statusLock);
+        status.skippedSeconds += seconds;
+    }
+
+    void setError (const juce::String& error)
+    {
+        const juce::SpinLock::ScopedLockType sl (statusLock);
+
+        if (status.error != error)
+            std::cout << error << std::endl;
+
+        status.error = error;
+    }
+
+    enum { pollIntervalMs = 20 };
+
+    const juce::File file;
+    const double maxLatencySeconds;
+
+    std::unique_ptr<juce::FileInputStream> stream;
+    PcmFormat format;
+    juce::int64 dataStart = 0, dataSizeField = 0, position = 0;
+    std::vector<char> raw;
+    juce::AudioBuffer<float> block;
+    double blockMs = 0.0, nextBlockDue = 0.0;
+
+   #if JUCE_LINUX
+    int inotifyFd = -1;
+   #endif
+
+    juce::SpinLock statusLock;
+    Status status;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WavTailFollower)
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+    Band levels from a continuous wavelet transform (Morlet) evaluated only at
+    the tempered-scale band centres, so the time-frequency tiling follows the
+    display's log axis: each band is as wide as the gap to its neighbours at
+    every frequency, and low bands integrate over proportionally longer times.
+
+    The transform is FFT-based. Each band has a Gaussian kernel in the
+    frequency domain, precomputed over just the bins where it's significant
+    and already rotated to the newest instant at which the whole wavelet
+    fits inside the frame; a band's coefficient is then one short complex
+    dot product with the frame's spectrum, with no inverse transform.
+
+    The wavelets of low bands are far longer than a frame, so the input is
+    also kept decimated by 2, 4, 8... (each stage a [1 3 3 1] / 8 low-pass,
+    which is flat far below the new Nyquist where those bands sit and deep
+    near it where aliases come from). Every band is placed on the fastest
+    level whose frame its wavelet fits in, and every level has a frame of
+    the same size, so all bands cost about the same and a decimated level
+    is only transformed again once it has moved on by an eighth of a frame.
+
+    Levels are calibrated to read the same as SpectrumAnalyser's for a steady
+    sine at a band's centre. After a reset, a band reads mindB until enough
+    input has been pushed to fill its level's frame, rather than the level
+    of a frame that's still partly zeros; isSettled() says when they all have.
+    It has no threads or locks of its own.
+*/
+class WaveletAnalyser
+{
+public:
+    WaveletAnalyser() = default;
+
+    /** Designs one wavelet per centre frequency, frames of 2^fftOrder samples, and clears the input. */
+    void prepare (const std::vector<float>& centreFrequencies, int fftOrder, double newSampleRate)
+    {
+        fftSize = 1 << fftOrder;
+        sampleRate = newSampleRate;
+        numBands = (int) centreFrequencies.size();
+
+        fft.reset (new juce::dsp::FFT (fftOrder));
+        fftData.assign ((size_t) (2 * fftSize), 0.0f);
+        scales.clear();
+        levels.assign ((size_t) numBands, (float) SpectrumAnalyser::mindB);
+
+        int numLevels = 1;
+
+        for (int b = 0; b < numBands; ++b)
+        {
+            scales.push_back (designScale (b, centreFrequencies));
+            numLevels = juce::jmax (numLevels, scales.back().level + 1);
+        }
+
+        stages.resize ((size_t) numLevels);
+
+        for (auto& stage : stages)
+            stage.ring.assign ((size_t) fftSize, 0.0f);
+
+        reset();
+    }
+
+    /** Clears the input, e.g. after a gap. */
+    void reset() noexcept
+    {
+        for (auto& stage : stages)
+        {
+            std::fill (stage.ring.begin(), stage.ring.end(), 0.0f);
+            stage.writeIndex = 0;
+            stage.sinceUpdate = updateInterval();
+            stage.z[0] = stage.z[1] = stage.z[2] = 0.0f;
+            stage.odd = false;
+        }
+
+        numPushed = 0;
+        std::fill (levels.begin(), levels.end(), (float) SpectrumAnalyser::mindB);
+    }
+
+    /** Adds input samples to every level; cheap, as nothing is transformed until update(). */
+    void push (const float* samples, int numSamples) noexcept
+    {
+        auto mask = fftSize - 1;
+        auto numStages = (int) stages.size();
+        numPushed += numSamples;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto x = samples[i];
+
+            for (int l = 0; l < numStages; ++l)
+            {
+                auto& stage = stages[(size_t) l];
+                stage.ring[(size_t) stage.writeIndex] = x;
+                stage.writeIndex = (stage.writeIndex + 1) & mask;
+                ++stage.sinceUpdate;
+
+                if (l + 1 == numStages)
+                    break;
+
+                // every other output of the low-pass goes on to the next level
+                auto y = (x + 3.0f * stage.z[0] + 3.0f * stage.z[1] + stage.z[2]) * 0.125f;
+                stage.z[2] = stage.z[1];
+                stage.z[1] = stage.z[0];
+                stage.z[0] = x;
+                stage.odd = ! stage.odd;
+
+                if (stage.odd)
+                    break;
+
+                x = y;
+            }
+        }
+    }
+
+    /** Transforms the levels that have moved on enough and updates getLevels() from them. */
+    void update() noexcept
+    {
+        for (int l = 0; l < (int) stages.size(); ++l)
+        {
+            auto& stage = stages[(size_t) l];
+
+            // the full-rate level holds the shortest wavelets, so it's redone whenever there's anything new
+            if (stage.sinceUpdate == 0 || (l > 0 && stage.sinceUpdate < updateInterval()))
+                continue;
+
+            stage.sinceUpdate = 0;
+
+            auto split = (size_t) stage.writeIndex;
+            std::copy (stage.ring.begin() + (std::ptrdiff_t) split, stage.ring.end(), fftData.begin());
+            std::copy (stage.ring.begin(), stage.ring.begin() + (std::ptrdiff_t) split, fftData.begin() + (std::ptrdiff_t) (fftSize - (int) split));
+            fft->performRealOnlyForwardTransform (fftData.data(), true);
+
+            auto settled = numPushed >= getFrameLength (l);
+
+            for (int b = 0; b < numBands; ++b)
+                if (scales[(size_t) b].level == l)
+                    levels[(size_t) b] = settled ? evaluate (scales[(size_t) b]) : SpectrumAnalyser::mindB;
+        }
+    }
+
+    //==============================================================================
+    int getNumBands() const noexcept                        { return numBands; }
+    int getNumLevels() const noexcept                       { return (int) stages.size(); }
+
+    /** Band levels in dB, between SpectrumAnalyser::mindB and maxdB. */
+    const std::vector<float>& getLevels() const noexcept    { return levels; }
+
+    /** How much input the slowest level's frame covers: what to push after a reset before every band reads true. */
+    int getHistoryLength() const noexcept                   { return getFrameLength (getNumLevels() - 1); }
+
+    /** True once every band has had a full frame of input since the last reset. */
+    bool isSettled() const noexcept                         { return numPushed >= getHistoryLength(); }
+
+    /** How far behind the newest input a band's level is centred, in seconds. */
+    double getDelaySeconds (int band) const noexcept
+    {
+        auto& scale = scales[(size_t) band];
+        return (fftSize - 1 - scale.centre) * (double) (1 << scale.level) / sampleRate;
+    }
+
+private:
+    //==============================================================================
+    struct Scale
+    {
+        int level = 0;
+        int firstBin = 0;
+        int centre = 0;                 // where in its level's frame the wavelet is centred
+        std::vector<float> kernel;      // re and im interleaved, from firstBin
+    };
+
+    struct Stage
+    {
+        std::vector<float> ring;
+        int writeIndex = 0, sinceUpdate = 0;
+        float z[3] = {};
+        bool odd = false;
+    };
+
+    int updateInterval() const noexcept     { return fftSize / 8; }
+
+    /** How much input a level's frame covers. */
+    int getFrameLength (int level) const noexcept      { return fftSize << juce::jmax (0, level); }
+
+    Scale designScale (int band, const std::vector<float>& frequencies) const
+    {
+        auto f = (double) frequencies[(size_t) band];
+
+        // half-power width reaching halfway to the neighbouring bands, as FilterbankAnalyser does
+        auto below = band > 0 ? (double) frequencies[(size_t) (band - 1)] : f * f / (double) frequencies[(size_t) juce::jmin (1, numBands - 1)];
+        auto above = band + 1 < numBands ? (double) frequencies[(size_t) (band + 1)] : f * f / below;
+        auto sigmaHz = juce::jmax (1.0e-3, (above - below) * 0.5) / (2.0 * std::sqrt (std::log (2.0)));
+
+        // the wavelet is a Gaussian of 1 / (2 pi sigma) seconds; it fits in a frame once ±4 of those do
+        auto sigmaSeconds = 1.0 / (juce::MathConstants<double>::twoPi * sigmaHz);
+        Scale scale;
+
+        while (scale.level < maxLevels - 1 && 8.0 * sigmaSeconds * sampleRate / (double) (1 << scale.level) > fftSize)
+            ++scale.level;
+
+        auto levelRate = sampleRate / (double) (1 << scale.level);
+        auto hzPerBin = levelRate / fftSize;
+        auto halfWidth = (int) std::ceil (4.0 * sigmaSeconds * levelRate);
+        scale.centre = juce::jmax (fftSize / 2, fftSize - 1 - halfWidth);
+
+        auto first = juce::jmax (0, (int) std::floor ((f - 4.0 * sigmaHz) / hzPerBin));
+        auto last = juce::jmin (fftSize / 2, (int) std::ceil ((f + 4.0 * sigmaHz) / hzPerBin));
+        scale.firstBin = first;
+
+        // a full-scale sine's bin is fftSize / 2; SpectrumAnalyser (with its normalised Hann) reads it as 1/2 (-6 dB)
+        auto gain = 1.0 / fftSize;
+
+        for (int k = first; k <= last; ++k)
+        {
+            auto offset = (k * hzPerBin - f) / sigmaHz;
+            auto magnitude = gain * std::exp (-0.5 * offset * offset);
+            auto phase = juce::MathConstants<double>::twoPi * k * scale.centre / fftSize;
+
+            scale.kernel.push_back ((float) (magnitude * std::cos (phase)));
+            scale.kernel.push_back ((float) (magnitude * std::sin (phase)));
+        }
+
+        return scale;
+    }
+
+    /** The band's coefficient at its wavelet's centre, from the spectrum in fftData. */
+    float evaluate (const Scale& scale) const noexcept
+    {
+        auto* x = fftData.data() + 2 * scale.firstBin;
+        auto* k = scale.kernel.data();
+        auto n = (int) scale.kernel.size();
+        float re = 0.0f, im = 0.0f;
+
+        for (int i = 0; i < n; i += 2)
+        {
+            re += x[i] * k[i] - x[i + 1] * k[i + 1];
+            im += x[i] * k[i + 1] + x[i + 1] * k[i];
+        }
+
+        return juce::jlimit (SpectrumAnalyser::mindB, SpectrumAnalyser::maxdB,
+                             10.0f * std::log10 (juce::jmax (re * re + im * im, 1.0e-12f)));
+    }
+
+    //==============================================================================
+    static constexpr int maxLevels = 12;
+
+    int fftSize = 0, numBands = 0;
+    double sampleRate = 44100.0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> fftData;
+    std::vector<Scale> scales;
+    std::vector<Stage> stages;
+    std::vector<float> levels;
+    juce::int64 numPushed = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveletAnalyser)
+};